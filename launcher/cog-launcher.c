@@ -7,7 +7,9 @@
  */
 
 #include "cog-launcher.h"
+#include "cog-render-pool.h"
 #include <glib-unix.h>
+#include <inttypes.h>
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
@@ -66,6 +68,7 @@ static struct {
 #if HAVE_WEBKIT_AUTOPLAY
     WebKitAutoplayPolicy autoplay_policy;
 #endif
+    int render_pool_views;
 } s_options = {
     .scale_factor = 1.0,
     .device_scale_factor = 1.0,
@@ -133,6 +136,8 @@ struct _CogLauncher {
     guint sigterm_source;
 
     CogViewport *viewport;
+
+    CogRenderPool *render_pool;
 };
 
 G_DEFINE_TYPE(CogLauncher, cog_launcher, G_TYPE_APPLICATION)
@@ -175,6 +180,41 @@ on_action_open(G_GNUC_UNUSED GAction *action, GVariant *param, CogLauncher *laun
     webkit_web_view_load_uri(cog_launcher_get_visible_view(launcher), g_variant_get_string(param, NULL));
 }
 
+static void
+on_render_done(const char *uri, const char *path, gboolean success, CogLauncher *launcher)
+{
+    g_message("Render %s into %s: %s", uri, path, success ? "done" : "failed");
+
+    GApplication    *application = G_APPLICATION(launcher);
+    GDBusConnection *connection = g_application_get_dbus_connection(application);
+    if (!connection)
+        return;
+
+    g_autofree char  *interface = g_strconcat(g_application_get_application_id(application), ".RenderPool", NULL);
+    g_autoptr(GError) error = NULL;
+    if (!g_dbus_connection_emit_signal(connection, NULL, g_application_get_dbus_object_path(application), interface,
+                                       "RenderDone", g_variant_new("(ssb)", uri, path, success), &error))
+        g_warning("Cannot emit render completion signal: %s", error->message);
+}
+
+static void
+on_action_render(G_GNUC_UNUSED GAction *action, GVariant *param, CogLauncher *launcher)
+{
+    g_return_if_fail(g_variant_is_of_type(param, G_VARIANT_TYPE("(suus)")));
+
+    const char *uri, *path;
+    uint32_t    width, height;
+    g_variant_get(param, "(&suu&s)", &uri, &width, &height, &path);
+
+    if (width == 0 || height == 0) {
+        g_warning("Invalid render size %" PRIu32 "x%" PRIu32 " for %s", width, height, uri);
+        on_render_done(uri, path, FALSE, launcher);
+        return;
+    }
+
+    cog_render_pool_submit(launcher->render_pool, uri, width, height, path);
+}
+
 static gboolean
 on_signal_quit(CogLauncher *launcher)
 {
@@ -415,6 +455,14 @@ cog_launcher_startup(GApplication *application)
 
     self->viewport = cog_viewport_new();
     cog_viewport_add(self->viewport, view);
+
+    if (s_options.render_pool_views > 0) {
+        self->render_pool = cog_render_pool_new(self->shell, s_options.render_pool_views,
+                                                (CogRenderPoolDoneFunc) on_render_done, self, &error);
+        if (!self->render_pool)
+            g_error("Cannot create render pool: %s", error->message);
+        cog_launcher_add_action(self, "render", on_action_render, G_VARIANT_TYPE("(suus)"));
+    }
 }
 
 static void
@@ -430,6 +478,7 @@ cog_launcher_dispose(GObject *object)
 {
     CogLauncher *launcher = COG_LAUNCHER(object);
 
+    g_clear_pointer(&launcher->render_pool, cog_render_pool_free);
     g_clear_object(&launcher->shell);
     g_clear_object(&launcher->viewport);
 
@@ -1217,6 +1266,8 @@ static GOptionEntry s_cli_options[] = {
     {"autoplay-policy", 0, 0, G_OPTION_ARG_CALLBACK, option_entry_parse_autoplay,
      "Autoplay policy. Valid options are: allow, allow-without-sound, and deny", NULL},
 #endif
+    {"render-pool", '\0', 0, G_OPTION_ARG_INT, &s_options.render_pool_views,
+     "Number of views rendering pages requested with the 'render' action (default: 0, disabled)", "VIEWS"},
     {G_OPTION_REMAINING, '\0', 0, G_OPTION_ARG_FILENAME_ARRAY, &s_options.arguments, "", "[URL]"},
     {NULL}};
 
@@ -0,0 +1,288 @@
+/*
+ * cog-render-pool.c
+ * Copyright (C) 2024 Igalia S.L.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "cog-render-pool.h"
+
+#include <inttypes.h>
+
+/*
+ * Time to wait after a page has finished loading before its last frame is
+ * saved, to give it a chance to run scripts and paint, and maximum time to
+ * wait for a page to load.
+ */
+#define RENDER_POOL_SETTLE_TIME_MS 250
+#define RENDER_POOL_JOB_TIMEOUT_S  30
+
+typedef struct {
+    char    *uri;
+    char    *path;
+    unsigned width;
+    unsigned height;
+    int64_t  submit_time;
+} RenderJob;
+
+typedef struct {
+    CogRenderPool *pool;
+    CogViewport   *viewport;
+    CogView       *view;
+
+    RenderJob *job; /* NULL while idle. */
+    gboolean   job_started;
+    gboolean   job_failed;
+    unsigned   timeout_source;
+} RenderSlot;
+
+struct _CogRenderPool {
+    RenderSlot *slots;
+    unsigned    n_slots;
+    GQueue      pending; /* RenderJob */
+
+    CogRenderPoolDoneFunc done_func;
+    void                 *userdata;
+
+    uint64_t completed;
+    uint64_t failed;
+};
+
+static void
+render_job_free(RenderJob *job)
+{
+    g_free(job->uri);
+    g_free(job->path);
+    g_free(job);
+}
+
+static void render_pool_dispatch(CogRenderPool *pool);
+
+static void
+render_slot_start(RenderSlot *slot, RenderJob *job)
+{
+    g_debug("%s: view %p, %ux%u %s", G_STRFUNC, slot->view, job->width, job->height, job->uri);
+
+    slot->job = job;
+    slot->job_started = FALSE;
+    slot->job_failed = FALSE;
+
+    /* Drop the frame of the previous job, so it cannot be saved for this one. */
+    g_object_set(slot->view, "keep-last-frame", FALSE, NULL);
+    g_object_set(slot->view, "width", job->width, "height", job->height, "keep-last-frame", TRUE, NULL);
+
+    webkit_web_view_load_uri(WEBKIT_WEB_VIEW(slot->view), job->uri);
+}
+
+static void
+render_slot_finish(RenderSlot *slot)
+{
+    RenderJob     *job = g_steal_pointer(&slot->job);
+    CogRenderPool *pool = slot->pool;
+
+    g_clear_handle_id(&slot->timeout_source, g_source_remove);
+
+    gboolean success = FALSE;
+    if (!slot->job_failed)
+        g_signal_emit_by_name(slot->view, "write-snapshot", job->path, &success);
+
+    if (success)
+        pool->completed++;
+    else
+        pool->failed++;
+
+    g_debug("%s: view %p, %s %s in %.3f ms (%" PRIu64 " completed, %" PRIu64 " failed)",
+            G_STRFUNC, slot->view, job->uri, success ? "rendered" : "failed",
+            (g_get_monotonic_time() - job->submit_time) / 1000.0, pool->completed, pool->failed);
+
+    if (pool->done_func)
+        pool->done_func(job->uri, job->path, success, pool->userdata);
+    render_job_free(job);
+
+    /* Reuse the view (and its web process) for the next job, or unload the page until there is one. */
+    if (g_queue_is_empty(&pool->pending))
+        webkit_web_view_load_uri(WEBKIT_WEB_VIEW(slot->view), "about:blank");
+    else
+        render_pool_dispatch(pool);
+}
+
+static gboolean
+on_render_slot_settled(RenderSlot *slot)
+{
+    slot->timeout_source = 0;
+    render_slot_finish(slot);
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean
+on_render_slot_timeout(RenderSlot *slot)
+{
+    g_warning("Rendering %s timed out", slot->job->uri);
+
+    slot->timeout_source = 0;
+    slot->job_failed = TRUE;
+
+    /* Loading the next page (or a blank one) stops the current load. */
+    render_slot_finish(slot);
+    return G_SOURCE_REMOVE;
+}
+
+static void
+on_render_slot_load_changed(WebKitWebView *view G_GNUC_UNUSED, WebKitLoadEvent event, RenderSlot *slot)
+{
+    if (!slot->job)
+        return;
+
+    /* Ignore the end of a previous load which was superseded by the job. */
+    if (event == WEBKIT_LOAD_STARTED) {
+        slot->job_started = TRUE;
+        return;
+    }
+    if (event != WEBKIT_LOAD_FINISHED || !slot->job_started)
+        return;
+
+    g_clear_handle_id(&slot->timeout_source, g_source_remove);
+    if (slot->job_failed) {
+        render_slot_finish(slot);
+    } else {
+        slot->timeout_source =
+            g_timeout_add(RENDER_POOL_SETTLE_TIME_MS, G_SOURCE_FUNC(on_render_slot_settled), slot);
+    }
+}
+
+static gboolean
+on_render_slot_load_failed(WebKitWebView  *view G_GNUC_UNUSED,
+                           WebKitLoadEvent event G_GNUC_UNUSED,
+                           const char     *failing_uri,
+                           GError         *error,
+                           RenderSlot     *slot)
+{
+    if (!slot->job || g_error_matches(error, WEBKIT_NETWORK_ERROR, WEBKIT_NETWORK_ERROR_CANCELLED))
+        return TRUE;
+
+    g_warning("Cannot render %s: %s", failing_uri, error->message);
+    slot->job_failed = TRUE;
+    return TRUE;
+}
+
+static void
+on_render_slot_web_process_terminated(WebKitWebView                     *view G_GNUC_UNUSED,
+                                      WebKitWebProcessTerminationReason reason G_GNUC_UNUSED,
+                                      RenderSlot                        *slot)
+{
+    /* A new web process is launched when the view loads the next page. */
+    if (slot->job) {
+        g_warning("Web process terminated while rendering %s", slot->job->uri);
+        slot->job_failed = TRUE;
+        render_slot_finish(slot);
+    }
+}
+
+static void
+render_pool_dispatch(CogRenderPool *pool)
+{
+    for (unsigned i = 0; i < pool->n_slots && !g_queue_is_empty(&pool->pending); i++) {
+        RenderSlot *slot = &pool->slots[i];
+        if (!slot->job) {
+            render_slot_start(slot, g_queue_pop_head(&pool->pending));
+            slot->timeout_source = g_timeout_add_seconds(RENDER_POOL_JOB_TIMEOUT_S,
+                                                         G_SOURCE_FUNC(on_render_slot_timeout), slot);
+        }
+    }
+}
+
+/*
+ * Creates a pool of views for rendering pages into image files. Each view
+ * is visible in its own viewport, and as views are unrelated to each other
+ * WebKit gives each one of them its own web process, which allows rendering
+ * in parallel. Views are kept around and reused between jobs.
+ *
+ * The views must support the "keep-last-frame" property and the
+ * "write-snapshot" action signal, which the headless platform provides.
+ */
+CogRenderPool *
+cog_render_pool_new(CogShell *shell, unsigned n_views, CogRenderPoolDoneFunc done_func, void *userdata, GError **error)
+{
+    g_return_val_if_fail(COG_IS_SHELL(shell), NULL);
+    g_return_val_if_fail(n_views > 0, NULL);
+
+    g_autoptr(CogRenderPool) pool = g_new0(CogRenderPool, 1);
+    pool->done_func = done_func;
+    pool->userdata = userdata;
+    g_queue_init(&pool->pending);
+
+    pool->slots = g_new0(RenderSlot, n_views);
+    for (unsigned i = 0; i < n_views; i++) {
+        RenderSlot *slot = &pool->slots[pool->n_slots++];
+        slot->pool = pool;
+        slot->view = cog_view_new("settings", cog_shell_get_web_settings(shell), "web-context",
+                                  cog_shell_get_web_context(shell), "use-key-bindings", FALSE, NULL);
+
+        if (!g_signal_lookup("write-snapshot", G_OBJECT_TYPE(slot->view)) ||
+            !g_object_class_find_property(G_OBJECT_GET_CLASS(slot->view), "keep-last-frame")) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, "Views of type %s cannot save frames",
+                        G_OBJECT_TYPE_NAME(slot->view));
+            return NULL;
+        }
+
+        cog_platform_init_web_view(cog_platform_get(), WEBKIT_WEB_VIEW(slot->view));
+        g_signal_connect(slot->view, "load-changed", G_CALLBACK(on_render_slot_load_changed), slot);
+        g_signal_connect(slot->view, "load-failed", G_CALLBACK(on_render_slot_load_failed), slot);
+        g_signal_connect(slot->view, "web-process-terminated", G_CALLBACK(on_render_slot_web_process_terminated),
+                         slot);
+
+        /* Only the visible view of a viewport gets painted. */
+        slot->viewport = cog_viewport_new();
+        cog_viewport_add(slot->viewport, slot->view);
+
+        /* Start the web process right away. */
+        webkit_web_view_load_uri(WEBKIT_WEB_VIEW(slot->view), "about:blank");
+    }
+
+    g_debug("%s: %u views", G_STRFUNC, n_views);
+    return g_steal_pointer(&pool);
+}
+
+void
+cog_render_pool_free(CogRenderPool *pool)
+{
+    if (!pool)
+        return;
+
+    g_queue_clear_full(&pool->pending, (GDestroyNotify) render_job_free);
+
+    for (unsigned i = 0; i < pool->n_slots; i++) {
+        RenderSlot *slot = &pool->slots[i];
+        g_clear_handle_id(&slot->timeout_source, g_source_remove);
+        g_clear_pointer(&slot->job, render_job_free);
+        if (slot->view)
+            g_signal_handlers_disconnect_by_data(slot->view, slot);
+        g_clear_object(&slot->viewport);
+        g_clear_object(&slot->view);
+    }
+
+    g_free(pool->slots);
+    g_free(pool);
+}
+
+/*
+ * Queues loading a page at the given size, and writing its rendering into
+ * a PAM image file at path. The done function passed when creating the
+ * pool is called once the job has been completed.
+ */
+void
+cog_render_pool_submit(CogRenderPool *pool, const char *uri, unsigned width, unsigned height, const char *path)
+{
+    g_return_if_fail(pool);
+    g_return_if_fail(uri && path);
+
+    RenderJob *job = g_new0(RenderJob, 1);
+    job->uri = g_strdup(uri);
+    job->path = g_strdup(path);
+    job->width = width;
+    job->height = height;
+    job->submit_time = g_get_monotonic_time();
+    g_queue_push_tail(&pool->pending, job);
+
+    render_pool_dispatch(pool);
+}
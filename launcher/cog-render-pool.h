@@ -0,0 +1,29 @@
+/*
+ * cog-render-pool.h
+ * Copyright (C) 2024 Igalia S.L.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include "../core/cog.h"
+
+G_BEGIN_DECLS
+
+typedef struct _CogRenderPool CogRenderPool;
+
+typedef void (*CogRenderPoolDoneFunc)(const char *uri, const char *path, gboolean success, void *userdata);
+
+CogRenderPool *cog_render_pool_new(CogShell             *shell,
+                                   unsigned              n_views,
+                                   CogRenderPoolDoneFunc done_func,
+                                   void                 *userdata,
+                                   GError              **error);
+void           cog_render_pool_free(CogRenderPool *pool);
+
+void cog_render_pool_submit(CogRenderPool *pool, const char *uri, unsigned width, unsigned height, const char *path);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(CogRenderPool, cog_render_pool_free)
+
+G_END_DECLS
@@ -0,0 +1,107 @@
+/*
+ * cog-hash.h
+ * Copyright (C) 2024 Igalia S.L.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Hashing of pixel data to detect which parts of a frame changed, following
+ * XXH64: four independent accumulators consume 32 bytes per round, which
+ * lets the CPU interleave the multiplications, and the lanes are merged and
+ * mixed at the end, so that a change in any input bit affects the whole
+ * hash. Input comes in runs of 32-bit pixels, which may be fed one after
+ * the other to hash a region made of several rows.
+ */
+
+#define COG_HASH_PRIME64_1 UINT64_C(0x9E3779B185EBCA87)
+#define COG_HASH_PRIME64_2 UINT64_C(0xC2B2AE3D27D4EB4F)
+#define COG_HASH_PRIME64_3 UINT64_C(0x165667B19E3779F9)
+#define COG_HASH_PRIME64_4 UINT64_C(0x85EBCA77C2B2AE63)
+
+typedef struct {
+    uint64_t v[4];
+} CogHash64;
+
+static inline uint64_t
+cog_hash_rotl64(uint64_t x, unsigned r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t
+cog_hash_read64(const uint8_t *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof v);
+    return v;
+}
+
+static inline uint64_t
+cog_hash_round(uint64_t acc, uint64_t input)
+{
+    return cog_hash_rotl64(acc + input * COG_HASH_PRIME64_2, 31) * COG_HASH_PRIME64_1;
+}
+
+static inline void
+cog_hash64_init(CogHash64 *h)
+{
+    h->v[0] = COG_HASH_PRIME64_1 + COG_HASH_PRIME64_2;
+    h->v[1] = COG_HASH_PRIME64_2;
+    h->v[2] = 0;
+    h->v[3] = -COG_HASH_PRIME64_1;
+}
+
+/* The size must be a multiple of the pixel size, four bytes. */
+static inline void
+cog_hash64_update(CogHash64 *h, const uint8_t *p, size_t size)
+{
+    uint64_t v0 = h->v[0], v1 = h->v[1], v2 = h->v[2], v3 = h->v[3];
+
+    for (; size >= 32; p += 32, size -= 32) {
+        v0 = cog_hash_round(v0, cog_hash_read64(p));
+        v1 = cog_hash_round(v1, cog_hash_read64(p + 8));
+        v2 = cog_hash_round(v2, cog_hash_read64(p + 16));
+        v3 = cog_hash_round(v3, cog_hash_read64(p + 24));
+    }
+    for (; size >= 8; p += 8, size -= 8)
+        v0 = cog_hash_round(v0, cog_hash_read64(p));
+    if (size) {
+        uint32_t tail;
+        memcpy(&tail, p, sizeof tail);
+        v1 = cog_hash_round(v1, tail);
+    }
+
+    h->v[0] = v0, h->v[1] = v1, h->v[2] = v2, h->v[3] = v3;
+}
+
+static inline uint64_t
+cog_hash64_final(const CogHash64 *h)
+{
+    uint64_t acc = cog_hash_rotl64(h->v[0], 1) + cog_hash_rotl64(h->v[1], 7) + cog_hash_rotl64(h->v[2], 12) +
+                   cog_hash_rotl64(h->v[3], 18);
+    for (unsigned i = 0; i < 4; i++)
+        acc = (acc ^ cog_hash_round(0, h->v[i])) * COG_HASH_PRIME64_1 + COG_HASH_PRIME64_4;
+
+    acc ^= acc >> 33;
+    acc *= COG_HASH_PRIME64_2;
+    acc ^= acc >> 29;
+    acc *= COG_HASH_PRIME64_3;
+    acc ^= acc >> 32;
+    return acc;
+}
+
+static inline uint64_t
+cog_hash64(const uint8_t *p, size_t size)
+{
+    CogHash64 h;
+    cog_hash64_init(&h);
+    cog_hash64_update(&h, p, size);
+    return cog_hash64_final(&h);
+}
@@ -0,0 +1,273 @@
+/*
+ * cog-drm-frame-scheduler.c
+ * Copyright (C) 2024 Igalia S.L.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "cog-drm-frame-scheduler.h"
+
+#include <inttypes.h>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+/*
+ * Telling WebKit that a frame is complete right after the page flip makes
+ * it start painting the next frame right away, and then the frame waits
+ * for almost a whole refresh period before being shown. Instead, the next
+ * vertical blank is predicted from the timestamp of the page flip, and
+ * frame completion is delayed so that painting ends shortly before it.
+ *
+ * The time needed to produce a frame is measured from the moment WebKit is
+ * told that it can paint until the frame gets committed, and the largest
+ * of the recent measurements is used as prediction. A safety margin is
+ * added on top, which doubles each time a frame misses the vertical blank
+ * it was meant for, and shrinks slowly while frames are on time.
+ */
+
+#define RENDER_TIME_SAMPLES 16
+#define MARGIN_MIN_US       500
+#define MARGIN_INITIAL_US   2000
+
+struct _CogDrmFrameScheduler {
+    CogDrmFrameSchedulerFunc frame_complete;
+    void                    *userdata;
+
+    GSource *source;
+    bool     enabled;
+    bool     immediate; /* Requested with COG_PLATFORM_DRM_FRAME_SCHEDULING. */
+    bool     monotonic; /* Page flip timestamps use the monotonic clock. */
+    int64_t  period;
+
+    int64_t dispatch_time; /* Zero when no frame has been requested. */
+    int64_t target_vblank;
+    int64_t render_time;
+
+    int64_t  render_times[RENDER_TIME_SAMPLES];
+    unsigned n_render_times;
+    unsigned next_render_time;
+    int64_t  margin;
+
+    struct {
+        uint64_t frames;
+        uint64_t frames_delayed;
+        uint64_t frames_missed;
+        uint64_t delay_us;
+    } stats;
+};
+
+static gboolean
+frame_scheduler_source_dispatch(GSource *source, GSourceFunc callback, void *userdata)
+{
+    g_source_set_ready_time(source, -1);
+    return callback(userdata);
+}
+
+static gboolean
+frame_scheduler_dispatch(CogDrmFrameScheduler *self)
+{
+    self->dispatch_time = g_get_monotonic_time();
+    self->frame_complete(self->userdata);
+    return G_SOURCE_CONTINUE;
+}
+
+static int64_t
+frame_scheduler_get_period(const drmModeModeInfo *mode)
+{
+    if (mode->clock && mode->htotal && mode->vtotal)
+        return (int64_t) mode->htotal * mode->vtotal * 1000 / mode->clock;
+    if (mode->vrefresh)
+        return G_USEC_PER_SEC / mode->vrefresh;
+    return 0;
+}
+
+static int64_t
+frame_scheduler_predict_render_time(const CogDrmFrameScheduler *self)
+{
+    int64_t render_time = 0;
+    for (unsigned i = 0; i < self->n_render_times; i++)
+        render_time = MAX(render_time, self->render_times[i]);
+    return render_time;
+}
+
+/*
+ * Creates a frame scheduler which calls frame_complete when WebKit should
+ * start painting the next frame. Scheduling falls back to calling it right
+ * after each page flip when page flip timestamps do not use the monotonic
+ * clock, or the COG_PLATFORM_DRM_FRAME_SCHEDULING environment variable is
+ * set to "immediate".
+ */
+CogDrmFrameScheduler *
+cog_drm_frame_scheduler_new(int                      drm_fd,
+                            const drmModeModeInfo   *mode,
+                            CogDrmFrameSchedulerFunc frame_complete,
+                            void                    *userdata)
+{
+    g_assert(mode);
+    g_assert(frame_complete);
+
+    static GSourceFuncs funcs = {
+        .dispatch = frame_scheduler_source_dispatch,
+    };
+
+    CogDrmFrameScheduler *self = g_new0(CogDrmFrameScheduler, 1);
+    self->frame_complete = frame_complete;
+    self->userdata = userdata;
+    self->margin = MARGIN_INITIAL_US;
+
+    uint64_t monotonic = 0;
+    self->monotonic = !drmGetCap(drm_fd, DRM_CAP_TIMESTAMP_MONOTONIC, &monotonic) && monotonic;
+    if (self->monotonic)
+        self->period = frame_scheduler_get_period(mode);
+    else
+        g_debug("%s: Page flip timestamps are not monotonic.", __func__);
+
+    const char *scheduling = g_getenv("COG_PLATFORM_DRM_FRAME_SCHEDULING");
+    if (scheduling && g_strcmp0(scheduling, "immediate") != 0 && g_strcmp0(scheduling, "deadline") != 0) {
+        g_warning("Invalid value '%s' for COG_PLATFORM_DRM_FRAME_SCHEDULING, using 'deadline'.", scheduling);
+        scheduling = NULL;
+    }
+    self->immediate = g_strcmp0(scheduling, "immediate") == 0;
+    self->enabled = self->period > 0 && !self->immediate;
+
+    self->source = g_source_new(&funcs, sizeof(GSource));
+    g_source_set_name(self->source, "cog: frame scheduler");
+    g_source_set_priority(self->source, G_PRIORITY_HIGH);
+    g_source_set_callback(self->source, G_SOURCE_FUNC(frame_scheduler_dispatch), self, NULL);
+    g_source_attach(self->source, g_main_context_get_thread_default());
+
+    g_debug("%s: Refresh period %" PRIi64 " us, deadline scheduling %s.", __func__, self->period,
+            self->enabled ? "enabled" : "disabled");
+    return self;
+}
+
+void
+cog_drm_frame_scheduler_free(CogDrmFrameScheduler *self)
+{
+    if (!self)
+        return;
+
+    if (self->stats.frames) {
+        g_debug("%s: %" PRIu64 " frames, %" PRIu64 " delayed by %.3f ms on average, %" PRIu64
+                " missed their vertical blank, final margin %.3f ms",
+                __func__, self->stats.frames, self->stats.frames_delayed,
+                self->stats.frames_delayed ? self->stats.delay_us / 1000.0 / self->stats.frames_delayed : 0.0,
+                self->stats.frames_missed, self->margin / 1000.0);
+    }
+
+    if (self->source) {
+        g_source_destroy(self->source);
+        g_source_unref(self->source);
+    }
+    g_free(self);
+}
+
+/*
+ * Allows disabling deadline scheduling, e.g. when the refresh rate is
+ * variable and the display waits for the next frame anyway.
+ */
+void
+cog_drm_frame_scheduler_set_enabled(CogDrmFrameScheduler *self, bool enabled)
+{
+    g_assert(self);
+    self->enabled = enabled && self->period > 0 && !self->immediate;
+}
+
+/*
+ * Updates the refresh period after the mode of the CRTC has changed. The
+ * render time measurements are kept, but the previous target vertical blank
+ * has no meaning for the new mode.
+ */
+void
+cog_drm_frame_scheduler_set_mode(CogDrmFrameScheduler *self, const drmModeModeInfo *mode)
+{
+    g_assert(self);
+    g_assert(mode);
+
+    const int64_t period = self->monotonic ? frame_scheduler_get_period(mode) : 0;
+    if (!period)
+        self->enabled = false;
+
+    self->period = period;
+    self->target_vblank = 0;
+    self->margin = MARGIN_INITIAL_US;
+    g_debug("%s: Refresh period %" PRIi64 " us.", __func__, self->period);
+}
+
+/*
+ * Records the time when a frame requested from WebKit has been committed,
+ * which is used to predict how long the next ones will take.
+ */
+void
+cog_drm_frame_scheduler_frame_committed(CogDrmFrameScheduler *self)
+{
+    g_assert(self);
+
+    if (!self->dispatch_time)
+        return;
+
+    self->render_time = g_get_monotonic_time() - self->dispatch_time;
+    self->dispatch_time = 0;
+
+    /* Idle periods, when WebKit does not paint right away, say nothing about render times. */
+    if (self->render_time >= self->period)
+        return;
+
+    self->render_times[self->next_render_time] = self->render_time;
+    self->next_render_time = (self->next_render_time + 1) % RENDER_TIME_SAMPLES;
+    self->n_render_times = MIN(self->n_render_times + 1, RENDER_TIME_SAMPLES);
+}
+
+/*
+ * Schedules the frame complete notification after the page flip which
+ * happened at the given time, as reported by the DRM event.
+ */
+void
+cog_drm_frame_scheduler_page_flip(CogDrmFrameScheduler *self, unsigned sec, unsigned usec)
+{
+    g_assert(self);
+
+    self->stats.frames++;
+
+    if (!self->enabled) {
+        frame_scheduler_dispatch(self);
+        return;
+    }
+
+    const int64_t flip_time = (int64_t) sec * G_USEC_PER_SEC + usec;
+
+    /* Frames produced quickly enough which were shown a vertical blank later than targeted. */
+    if (self->target_vblank && self->render_time < self->period && flip_time > self->target_vblank + self->period / 2) {
+        self->stats.frames_missed++;
+        self->margin = MIN(self->margin * 2, self->period / 2);
+    } else {
+        self->margin = MAX(self->margin - self->margin / 16, MARGIN_MIN_US);
+    }
+
+    self->target_vblank = flip_time + self->period;
+    const int64_t start_time = self->target_vblank - frame_scheduler_predict_render_time(self) - self->margin;
+    const int64_t now = g_get_monotonic_time();
+
+    if (start_time <= now || !self->n_render_times) {
+        frame_scheduler_dispatch(self);
+        return;
+    }
+
+    self->stats.frames_delayed++;
+    self->stats.delay_us += start_time - now;
+    g_source_set_ready_time(self->source, start_time);
+}
+
+/*
+ * Schedules the frame complete notification when no page flip is going to
+ * trigger it, e.g. after committing a frame failed. Nothing is done if the
+ * notification is already scheduled.
+ */
+void
+cog_drm_frame_scheduler_resume(CogDrmFrameScheduler *self)
+{
+    g_assert(self);
+
+    if (g_source_get_ready_time(self->source) < 0)
+        g_source_set_ready_time(self->source, 0);
+}
@@ -0,0 +1,35 @@
+/*
+ * cog-drm-frame-scheduler.h
+ * Copyright (C) 2024 Igalia S.L.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+G_BEGIN_DECLS
+
+typedef struct _drmModeModeInfo      drmModeModeInfo;
+typedef struct _CogDrmFrameScheduler CogDrmFrameScheduler;
+
+typedef void (*CogDrmFrameSchedulerFunc)(void *userdata);
+
+CogDrmFrameScheduler *cog_drm_frame_scheduler_new(int                      drm_fd,
+                                                  const drmModeModeInfo   *mode,
+                                                  CogDrmFrameSchedulerFunc frame_complete,
+                                                  void                    *userdata);
+void                  cog_drm_frame_scheduler_free(CogDrmFrameScheduler *self);
+
+void cog_drm_frame_scheduler_set_enabled(CogDrmFrameScheduler *self, bool enabled);
+void cog_drm_frame_scheduler_set_mode(CogDrmFrameScheduler *self, const drmModeModeInfo *mode);
+void cog_drm_frame_scheduler_page_flip(CogDrmFrameScheduler *self, unsigned sec, unsigned usec);
+void cog_drm_frame_scheduler_frame_committed(CogDrmFrameScheduler *self);
+void cog_drm_frame_scheduler_resume(CogDrmFrameScheduler *self);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(CogDrmFrameScheduler, cog_drm_frame_scheduler_free)
+
+G_END_DECLS
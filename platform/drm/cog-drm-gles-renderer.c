@@ -7,6 +7,7 @@
 
 #include "../../core/cog.h"
 #include "../common/cog-gl-utils.h"
+#include "cog-drm-frame-scheduler.h"
 #include "cog-drm-renderer.h"
 #include <drm_fourcc.h>
 #include <drm_mode.h>
@@ -14,6 +15,9 @@
 #include <errno.h>
 #include <gbm.h>
 #include <glib-unix.h>
+#include <linux/sync_file.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
 #include <wayland-util.h>
 #include <wpe/fdo-egl.h>
 #include <wpe/fdo.h>
@@ -22,13 +26,53 @@
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(drmModePlane, drmModeFreePlane)
 
+/*
+ * A presented frame is either a BO from the GBM surface, or a BO imported
+ * from an image exported by WebKit, which is scanned out directly.
+ */
+typedef struct {
+    struct gbm_bo                     *bo;
+    struct wpe_fdo_egl_exported_image *image; /* Only for direct scanout. */
+    uint64_t                           plane_rotation;
+} CogDrmGlesFrame;
+
+/*
+ * WebKit exports the same few buffers over and over, one per buffer of its
+ * swapchain, so the BO imported from each one (and its frame buffer) is kept
+ * for the next time the buffer is exported. Exported images and EGLImages
+ * are allocated anew for each frame, so entries are matched on the GEM
+ * handle of the buffer instead, which cannot be reused for another buffer
+ * while the cached BO holds it. The least recently used idle entry is
+ * replaced by a new buffer.
+ */
+#define SCANOUT_CACHE_SIZE 4
+
+typedef struct {
+    struct gbm_bo *bo;
+    uint32_t       handle; /* Zero for stale entries, which are never matched. */
+    uint64_t       last_used;
+} CogDrmGlesScanoutBuffer;
+
+/* Buffer layout and plane state which decide whether the plane accepts a frame. */
+typedef struct {
+    uint32_t format;
+    uint64_t modifier;
+    uint64_t rotation;
+    uint32_t width, height;
+} CogDrmGlesScanoutConfig;
+
+#define SCANOUT_CONFIGS_SIZE 4
+
+/* Consecutive failed atomic commits after which legacy mode setting is tried instead. */
+#define ATOMIC_COMMIT_MAX_FAILURES 3
+
 typedef struct {
     CogDrmRenderer base;
 
     struct gbm_device  *gbm_device;
     struct gbm_surface *gbm_surface;
-    struct gbm_bo      *current_bo;
-    struct gbm_bo      *next_bo;
+    CogDrmGlesFrame     current_frame;
+    CogDrmGlesFrame     next_frame;
     uint32_t            gbm_format;
 
     /*
@@ -39,6 +83,18 @@ typedef struct {
      */
     uint32_t width, height;
 
+    /*
+     * Size of the GBM surface, which is the size of the mode unless the
+     * display controller scales the output up or down to the mode size.
+     * Mode setting is then done with atomic commits, because the legacy
+     * API does not support scaling.
+     */
+    uint32_t scanout_width, scanout_height;
+    CogDrmModesetPropertyIds modeset_prop_id;
+
+    /* Set along with the mode, zero if variable refresh rate is not used. */
+    uint32_t vrr_enabled_prop_id;
+
     CogGLRendererRotation rotation;
 
     EGLDisplay egl_display;
@@ -49,6 +105,7 @@ typedef struct {
     CogGLRenderer gl_render;
 
     struct wpe_view_backend_exportable_fdo *exportable;
+    CogDrmFrameScheduler                   *frame_scheduler;
 
     drmEventContext drm_context;
     unsigned        drm_fd_source;
@@ -57,41 +114,88 @@ typedef struct {
     uint32_t        plane_id;
     drmModeModeInfo mode;
     bool            mode_set;
+    bool            flip_pending;
     bool            atomic_modesetting;
+    unsigned        atomic_commit_failures;
+    bool            async_page_flip;
 
-    struct {
-      int type_id, fb_id, crtc_id;
-      int crtc_x, crtc_y, crtc_w, crtc_h;
-      int src_x, src_y, src_w, src_h;
-    } prop_id;
-} CogDrmGlesRenderer;
+    /*
+     * Configurations checked for direct scanout with a test commit. Accepted
+     * ones are not checked again, and the last rejected one is not tried
+     * again until the mode or the rotation change.
+     */
+    CogDrmGlesScanoutConfig scanout_accepted[SCANOUT_CONFIGS_SIZE];
+    unsigned                n_scanout_accepted;
+    CogDrmGlesScanoutConfig scanout_rejected;
+    bool                    scanout_rejected_valid;
+    CogDrmGlesScanoutBuffer scanout_cache[SCANOUT_CACHE_SIZE];
+    uint64_t                scanout_cache_clock;
 
-static void
-cog_drm_gles_renderer_handle_egl_image(void *data, struct wpe_fdo_egl_exported_image *image)
-{
-    CogDrmGlesRenderer *self = data;
+    /* Rotation done by the display controller, only used for direct scanout. */
+    uint32_t rotation_prop_id;
+    uint64_t rotation_supported;
 
-    if (!eglMakeCurrent(self->egl_display, self->egl_surface, self->egl_surface, self->egl_context)) {
-        g_critical("%s: Cannot activate EGL context for rendering (%#04x)", __func__, eglGetError());
-        return;
-    }
+    CogDrmPlanePropertyIds prop_id;
 
-    glViewport(0, 0, self->mode.hdisplay, self->mode.vdisplay);
-    glClearColor(0, 0, 0, 0);
-    glClear(GL_COLOR_BUFFER_BIT);
+    /* Reused for every atomic commit, rewound before adding properties. */
+    drmModeAtomicReq *req;
 
-    cog_gl_renderer_paint(&self->gl_render, wpe_fdo_egl_exported_image_get_egl_image(image), self->rotation);
+    /*
+     * Explicit synchronization: the fence signaled when painting a frame is
+     * done gets passed to the atomic commit, instead of having the kernel
+     * wait on the buffer, and the commit returns a fence signaled when the
+     * frame is shown. Both are kept until the page flip to measure waits.
+     */
+    struct {
+        uint32_t in_fence_fd_prop_id;
+        uint32_t out_fence_ptr_prop_id;
+        int      render_fd; /* Not yet committed. */
+        int      in_fd;
+        int32_t  out_fd;
+        int64_t  commit_time;
+    } fence;
 
-    if (G_UNLIKELY(!eglSwapBuffers(self->egl_display, self->egl_surface))) {
-        g_critical("%s: eglSwapBuffers failed (%#04x)", __func__, eglGetError());
-        return;
-    }
+    struct {
+        uint64_t frames;
+        uint64_t frames_scanout;
+        uint64_t scanout_imported;
+        uint64_t scanout_tested;
+        uint64_t fb_created;
+        uint64_t fenced_frames;
+        uint64_t render_wait_us;
+        uint64_t render_wait_max_us;
+        uint64_t display_latency_us;
+    } stats;
+    CogDrmPresentStats present_stats;
+} CogDrmGlesRenderer;
 
-    wpe_view_backend_exportable_fdo_egl_dispatch_release_exported_image(self->exportable, image);
+/*
+ * The GBM surface hands out the same few BOs over and over, so each one gets
+ * a frame buffer the first time it is used, which is kept as its user data
+ * and removed when libgbm destroys the BO. BOs imported for direct scanout
+ * keep theirs while they stay in the scanout cache.
+ */
+typedef struct {
+    int      drm_fd;
+    uint32_t fb_id;
+} CogDrmGlesFramebuffer;
 
-    int drm_fd = gbm_device_get_fd(self->gbm_device);
+static void
+cog_drm_gles_framebuffer_destroy(struct gbm_bo *bo G_GNUC_UNUSED, void *data)
+{
+    CogDrmGlesFramebuffer *fb = data;
+    drmModeRmFB(fb->drm_fd, fb->fb_id);
+    g_slice_free(CogDrmGlesFramebuffer, fb);
+}
 
-    struct gbm_bo *bo = gbm_surface_lock_front_buffer(self->gbm_surface);
+static uint32_t
+cog_drm_gles_renderer_get_fb_for_bo(CogDrmGlesRenderer *self, struct gbm_bo *bo)
+{
+    CogDrmGlesFramebuffer *fb = gbm_bo_get_user_data(bo);
+    if (fb)
+        return fb->fb_id;
+
+    int drm_fd = gbm_device_get_fd(self->gbm_device);
 
     uint32_t handles[4], strides[4], offsets[4];
     uint64_t modifiers[4];
@@ -113,76 +217,529 @@ cog_drm_gles_renderer_handle_egl_image(void *data, struct wpe_fdo_egl_exported_i
      */
     uint32_t fb_id = 0;
     uint32_t flags = (modifiers[0] && modifiers[0] != DRM_FORMAT_MOD_INVALID) ? DRM_MODE_FB_MODIFIERS : 0;
-    int ret = drmModeAddFB2WithModifiers(drm_fd, self->mode.hdisplay, self->mode.vdisplay, self->gbm_format, handles,
-                                         strides, offsets, modifiers, &fb_id, flags);
+    const uint32_t width = gbm_bo_get_width(bo);
+    const uint32_t height = gbm_bo_get_height(bo);
+    const uint32_t format = gbm_bo_get_format(bo);
+    int ret = drmModeAddFB2WithModifiers(drm_fd, width, height, format, handles, strides, offsets, modifiers, &fb_id,
+                                         flags);
     if (ret) {
         handles[0] = gbm_bo_get_handle(bo).u32;
         handles[1] = handles[2] = handles[3] = 0;
         strides[0] = gbm_bo_get_stride(bo);
         strides[1] = strides[2] = strides[3] = 0;
         offsets[0] = offsets[1] = offsets[2] = offsets[3] = 0;
-        ret = drmModeAddFB2(drm_fd, self->mode.hdisplay, self->mode.vdisplay, self->gbm_format, handles, strides,
-                            offsets, &fb_id, 0);
+        ret = drmModeAddFB2(drm_fd, width, height, format, handles, strides, offsets, &fb_id, 0);
     }
     if (ret) {
         g_warning("%s: Cannot create framebuffer (%s)", __func__, g_strerror(errno));
-        gbm_surface_release_buffer(self->gbm_surface, bo);
+        return 0;
+    }
+
+    fb = g_slice_new(CogDrmGlesFramebuffer);
+    *fb = (CogDrmGlesFramebuffer){drm_fd, fb_id};
+    gbm_bo_set_user_data(bo, fb, cog_drm_gles_framebuffer_destroy);
+
+    self->stats.fb_created++;
+    return fb_id;
+}
+
+static bool
+cog_drm_gles_renderer_add_plane_properties(CogDrmGlesRenderer    *self,
+                                           drmModeAtomicReq      *req,
+                                           uint32_t               fb_id,
+                                           const CogDrmGlesFrame *frame)
+{
+    /* The source rectangle is in frame buffer coordinates, before rotation. */
+    const uint64_t src_w = gbm_bo_get_width(frame->bo);
+    const uint64_t src_h = gbm_bo_get_height(frame->bo);
+
+    int32_t ret = 0;
+    ret |= drmModeAtomicAddProperty(req, self->plane_id, self->prop_id.fb_id, fb_id) < 0;
+    ret |= drmModeAtomicAddProperty(req, self->plane_id, self->prop_id.crtc_id, self->crtc_id) < 0;
+    ret |= drmModeAtomicAddProperty(req, self->plane_id, self->prop_id.src_x, 0) < 0;
+    ret |= drmModeAtomicAddProperty(req, self->plane_id, self->prop_id.src_y, 0) < 0;
+    ret |= drmModeAtomicAddProperty(req, self->plane_id, self->prop_id.src_w, src_w << 16) < 0;
+    ret |= drmModeAtomicAddProperty(req, self->plane_id, self->prop_id.src_h, src_h << 16) < 0;
+    ret |= drmModeAtomicAddProperty(req, self->plane_id, self->prop_id.crtc_x, 0) < 0;
+    ret |= drmModeAtomicAddProperty(req, self->plane_id, self->prop_id.crtc_y, 0) < 0;
+    ret |= drmModeAtomicAddProperty(req, self->plane_id, self->prop_id.crtc_w, self->mode.hdisplay) < 0;
+    ret |= drmModeAtomicAddProperty(req, self->plane_id, self->prop_id.crtc_h, self->mode.vdisplay) < 0;
+    if (self->rotation_prop_id)
+        ret |= drmModeAtomicAddProperty(req, self->plane_id, self->rotation_prop_id, frame->plane_rotation) < 0;
+    return ret == 0;
+}
+
+static void
+cog_drm_gles_renderer_release_frame(CogDrmGlesRenderer *self, CogDrmGlesFrame *frame)
+{
+    if (!frame->bo)
         return;
+
+    /* Imported BOs are owned by the scanout cache. */
+    if (frame->image) {
+        wpe_view_backend_exportable_fdo_egl_dispatch_release_exported_image(self->exportable, frame->image);
+    } else {
+        gbm_surface_release_buffer(self->gbm_surface, frame->bo);
+    }
+
+    *frame = (CogDrmGlesFrame){NULL, NULL, 0};
+}
+
+static inline bool
+cog_drm_gles_renderer_is_scaled(const CogDrmGlesRenderer *self)
+{
+    return self->scanout_width != self->mode.hdisplay || self->scanout_height != self->mode.vdisplay;
+}
+
+/*
+ * Legacy mode setting cannot scale nor rotate the plane, nor show images
+ * exported by WebKit, so it is only tried when atomic commits keep failing
+ * for frames which do not need any of that. Legacy page flips also keep the
+ * rotation last set on the plane, which must not be rotated either.
+ */
+static bool
+cog_drm_gles_renderer_can_fall_back(const CogDrmGlesRenderer *self, const CogDrmGlesFrame *frame)
+{
+    const uint64_t rotation_0 = cog_drm_renderer_rotation_to_plane(COG_GL_RENDERER_ROTATION_0);
+    if (self->current_frame.bo && self->current_frame.plane_rotation != rotation_0)
+        return false;
+
+    return !frame->image && !cog_drm_gles_renderer_is_scaled(self) && frame->plane_rotation == rotation_0;
+}
+
+static bool
+cog_drm_gles_renderer_add_modeset_properties(CogDrmGlesRenderer *self, drmModeAtomicReq *req, uint32_t *blob_id)
+{
+    if (drmModeCreatePropertyBlob(gbm_device_get_fd(self->gbm_device), &self->mode, sizeof(drmModeModeInfo), blob_id))
+        return false;
+
+    int32_t ret = 0;
+    ret |=
+        drmModeAtomicAddProperty(req, self->connector_id, self->modeset_prop_id.connector_crtc_id, self->crtc_id) < 0;
+    ret |= drmModeAtomicAddProperty(req, self->crtc_id, self->modeset_prop_id.crtc_mode_id, *blob_id) < 0;
+    ret |= drmModeAtomicAddProperty(req, self->crtc_id, self->modeset_prop_id.crtc_active, 1) < 0;
+    if (self->vrr_enabled_prop_id)
+        ret |= drmModeAtomicAddProperty(req, self->crtc_id, self->vrr_enabled_prop_id, 1) < 0;
+    return ret == 0;
+}
+
+static inline void
+cog_drm_gles_renderer_close_fence(int *fd)
+{
+    if (*fd >= 0) {
+        close(*fd);
+        *fd = -1;
+    }
+}
+
+/*
+ * Returns the monotonic time in microseconds at which a fence with a single
+ * point was signaled, or -1 if not signaled yet or not a single fence.
+ */
+static int64_t
+cog_drm_gles_renderer_get_fence_time(int fd)
+{
+    struct sync_fence_info fence_info = {
+        .status = 0,
+    };
+    struct sync_file_info  file_info = {
+        .num_fences = 1,
+        .sync_fence_info = (uint64_t) (uintptr_t) &fence_info,
+    };
+    if (fd < 0 || ioctl(fd, SYNC_IOC_FILE_INFO, &file_info) || file_info.status != 1)
+        return -1;
+    return fence_info.timestamp_ns / 1000;
+}
+
+static bool
+cog_drm_gles_renderer_add_fence_properties(CogDrmGlesRenderer *self, drmModeAtomicReq *req)
+{
+    int32_t ret = 0;
+    if (self->fence.render_fd >= 0 && self->fence.in_fence_fd_prop_id) {
+        ret |=
+            drmModeAtomicAddProperty(req, self->plane_id, self->fence.in_fence_fd_prop_id, self->fence.render_fd) < 0;
+    }
+    if (self->fence.out_fence_ptr_prop_id) {
+        cog_drm_gles_renderer_close_fence(&self->fence.out_fd);
+        ret |= drmModeAtomicAddProperty(req, self->crtc_id, self->fence.out_fence_ptr_prop_id,
+                                        (uint64_t) (uintptr_t) &self->fence.out_fd) < 0;
+    }
+    return ret == 0;
+}
+
+/*
+ * Flips to a frame without waiting for the vertical blank. Atomic commits
+ * may then change only the frame buffer, so the rest of the plane state
+ * must be the same as for the frame on screen.
+ */
+static bool
+cog_drm_gles_renderer_flip_async(CogDrmGlesRenderer *self, const CogDrmGlesFrame *frame, uint32_t fb_id)
+{
+    const CogDrmGlesFrame *current = &self->current_frame;
+    if (!self->async_page_flip || !self->mode_set || !current->bo || frame->plane_rotation != current->plane_rotation ||
+        gbm_bo_get_width(frame->bo) != gbm_bo_get_width(current->bo) ||
+        gbm_bo_get_height(frame->bo) != gbm_bo_get_height(current->bo))
+        return false;
+
+    int drm_fd = gbm_device_get_fd(self->gbm_device);
+    int ret;
+    if (self->atomic_modesetting) {
+        drmModeAtomicSetCursor(self->req, 0);
+        ret = drmModeAtomicAddProperty(self->req, self->plane_id, self->prop_id.fb_id, fb_id) < 0;
+        if (!ret) {
+            const uint32_t flags = DRM_MODE_PAGE_FLIP_EVENT | DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_ASYNC;
+            ret = drmModeAtomicCommit(drm_fd, self->req, flags, self);
+        }
+    } else {
+        ret = drmModePageFlip(drm_fd, self->crtc_id, fb_id, DRM_MODE_PAGE_FLIP_EVENT | DRM_MODE_PAGE_FLIP_ASYNC, self);
+    }
+
+    if (ret) {
+        self->present_stats.async_rejected++;
+        return false;
     }
-    gbm_bo_set_user_data(bo, GINT_TO_POINTER(fb_id), NULL);
+    return true;
+}
+
+static void
+cog_drm_gles_renderer_present(CogDrmGlesRenderer *self, CogDrmGlesFrame *frame, uint32_t fb_id)
+{
+    int drm_fd = gbm_device_get_fd(self->gbm_device);
+
+    cog_drm_present_stats_begin(&self->present_stats);
 
-    if (G_UNLIKELY(!self->mode_set)) {
+    if (G_UNLIKELY(!self->mode_set) && !cog_drm_gles_renderer_is_scaled(self)) {
         int ret = drmModeSetCrtc(drm_fd, self->crtc_id, fb_id, 0, 0, &self->connector_id, 1, &self->mode);
         if (ret) {
             g_warning("%s: Cannot set mode (%s)", __func__, g_strerror(errno));
+            cog_drm_gles_renderer_release_frame(self, frame);
             return;
         }
         self->mode_set = true;
+
+        if (self->vrr_enabled_prop_id &&
+            drmModeObjectSetProperty(drm_fd, self->crtc_id, DRM_MODE_OBJECT_CRTC, self->vrr_enabled_prop_id, 1)) {
+            g_warning("%s: Cannot enable variable refresh rate (%s)", __func__, g_strerror(errno));
+        }
     }
 
-    self->next_bo = bo;
+    self->next_frame = *frame;
+    self->stats.frames++;
+
+    if (cog_drm_gles_renderer_flip_async(self, frame, fb_id)) {
+        /* Fences cannot be passed along, the kernel waits for rendering implicitly. */
+        cog_drm_gles_renderer_close_fence(&self->fence.render_fd);
+        self->flip_pending = true;
+        cog_drm_present_stats_commit(&self->present_stats, true);
+        cog_drm_frame_scheduler_frame_committed(self->frame_scheduler);
+        return;
+    }
 
     if (self->atomic_modesetting) {
-        int32_t ret = 0;
+        int32_t ret = -1;
         uint32_t flags = DRM_MODE_PAGE_FLIP_EVENT | DRM_MODE_ATOMIC_NONBLOCK;
 
-        drmModeAtomicReq *req = drmModeAtomicAlloc();
-        ret |= drmModeAtomicAddProperty(req, self->plane_id, self->prop_id.fb_id, fb_id) < 0;
-        ret |= drmModeAtomicAddProperty(req, self->plane_id, self->prop_id.crtc_id, self->crtc_id) < 0;
-        ret |= drmModeAtomicAddProperty(req, self->plane_id, self->prop_id.src_x, 0) < 0;
-        ret |= drmModeAtomicAddProperty(req, self->plane_id, self->prop_id.src_y, 0) < 0;
-        ret |= drmModeAtomicAddProperty(req, self->plane_id, self->prop_id.src_w, ((uint64_t) self->mode.hdisplay) << 16) < 0;
-        ret |= drmModeAtomicAddProperty(req, self->plane_id, self->prop_id.src_h, ((uint64_t) self->mode.vdisplay) << 16) < 0;
-        ret |= drmModeAtomicAddProperty(req, self->plane_id, self->prop_id.crtc_x, 0) < 0;
-        ret |= drmModeAtomicAddProperty(req, self->plane_id, self->prop_id.crtc_y, 0) < 0;
-        ret |= drmModeAtomicAddProperty(req, self->plane_id, self->prop_id.crtc_w, self->mode.hdisplay) < 0;
-        ret |= drmModeAtomicAddProperty(req, self->plane_id, self->prop_id.crtc_h, self->mode.vdisplay) < 0;
-        if (ret == 0)
+        drmModeAtomicReq *req = self->req;
+        uint32_t          mode_blob_id = 0;
+        bool              ok = true;
+        drmModeAtomicSetCursor(req, 0);
+        if (G_UNLIKELY(!self->mode_set)) {
+            flags |= DRM_MODE_ATOMIC_ALLOW_MODESET;
+            ok = cog_drm_gles_renderer_add_modeset_properties(self, req, &mode_blob_id);
+        }
+        if (ok && cog_drm_gles_renderer_add_plane_properties(self, req, fb_id, frame) &&
+            cog_drm_gles_renderer_add_fence_properties(self, req)) {
+            self->fence.commit_time = g_get_monotonic_time();
             ret = drmModeAtomicCommit(drm_fd, req, flags, self);
-        drmModeAtomicFree(req);
+        }
 
-        if (ret) {
+        /* The kernel keeps its own reference, but ours is handy to tell when rendering was done. */
+        cog_drm_gles_renderer_close_fence(&self->fence.in_fd);
+        if (ret == 0) {
+            self->fence.in_fd = self->fence.render_fd;
+            self->fence.render_fd = -1;
+        } else {
+            cog_drm_gles_renderer_close_fence(&self->fence.render_fd);
+        }
+
+        /* The CRTC keeps its own reference to the mode blob. */
+        if (mode_blob_id)
+            drmModeDestroyPropertyBlob(drm_fd, mode_blob_id);
+
+        if (ret == 0) {
+            self->mode_set = true;
+            self->flip_pending = true;
+            self->atomic_commit_failures = 0;
+            cog_drm_present_stats_commit(&self->present_stats, false);
+            cog_drm_frame_scheduler_frame_committed(self->frame_scheduler);
+        } else if (++self->atomic_commit_failures < ATOMIC_COMMIT_MAX_FAILURES ||
+                   !cog_drm_gles_renderer_can_fall_back(self, frame)) {
+            /* Failures are often transient (e.g. output unplugged), drop the frame and try again with the next. */
+            g_warning("atomic commit error(%d): dropping frame", ret);
+            cog_drm_gles_renderer_release_frame(self, &self->next_frame);
+            cog_drm_frame_scheduler_resume(self->frame_scheduler);
+            return;
+        } else {
             g_warning("atomic commit error(%d): trying non-atomic", ret);
             self->atomic_modesetting = false;
         }
     }
 
     if (!self->atomic_modesetting) {
+        /* Without atomic commits the kernel synchronizes implicitly with rendering. */
+        cog_drm_gles_renderer_close_fence(&self->fence.render_fd);
+
         if (drmModePageFlip(drm_fd, self->crtc_id, fb_id, DRM_MODE_PAGE_FLIP_EVENT, self)) {
             g_warning("%s: Cannot schedule page flip (%s)", __func__, g_strerror(errno));
 
             /* page-flip depends on prior set-crtc so redo on error */
             if (drmModeSetCrtc(drm_fd, self->crtc_id, fb_id, 0, 0, &self->connector_id, 1, &self->mode)) {
                 g_warning("%s: Cannot set mode after page flip error (%s)", __func__, g_strerror(errno));
+                cog_drm_gles_renderer_release_frame(self, &self->next_frame);
                 return;
             }
 
             if (drmModePageFlip(drm_fd, self->crtc_id, fb_id, DRM_MODE_PAGE_FLIP_EVENT, self)) {
                 g_warning("%s: Cannot schedule page flip after error (%s)", __func__, g_strerror(errno));
+                cog_drm_gles_renderer_release_frame(self, &self->next_frame);
                 return;
             }
         }
+        self->flip_pending = true;
+        cog_drm_present_stats_commit(&self->present_stats, false);
+        cog_drm_frame_scheduler_frame_committed(self->frame_scheduler);
+    }
+}
+
+static inline bool
+cog_drm_gles_renderer_is_presented(const CogDrmGlesRenderer *self, const struct gbm_bo *bo)
+{
+    return bo == self->current_frame.bo || bo == self->next_frame.bo;
+}
+
+/*
+ * Returns the BO for an exported image, reusing the cached one (and its frame
+ * buffer) when the same buffer was seen before. Importing an EGLImage only
+ * duplicates the image of the driver, the costly part is adding the frame
+ * buffer. Entries of BOs which are presented are never replaced.
+ */
+static struct gbm_bo *
+cog_drm_gles_renderer_import_for_scanout(CogDrmGlesRenderer *self, struct wpe_fdo_egl_exported_image *image)
+{
+    struct gbm_bo *bo = gbm_bo_import(self->gbm_device, GBM_BO_IMPORT_EGL_IMAGE,
+                                      wpe_fdo_egl_exported_image_get_egl_image(image), GBM_BO_USE_SCANOUT);
+    if (!bo) {
+        static bool message_emitted = false;
+        if (!message_emitted) {
+            g_debug("%s: Cannot import exported images, direct scanout unavailable", __func__);
+            message_emitted = true;
+        }
+        return NULL;
+    }
+
+    const uint32_t           handle = gbm_bo_get_handle(bo).u32;
+    const uint32_t           width = wpe_fdo_egl_exported_image_get_width(image);
+    const uint32_t           height = wpe_fdo_egl_exported_image_get_height(image);
+    CogDrmGlesScanoutBuffer *slot = NULL;
+
+    for (unsigned i = 0; i < SCANOUT_CACHE_SIZE; i++) {
+        CogDrmGlesScanoutBuffer *entry = &self->scanout_cache[i];
+        if (entry->bo && handle && entry->handle == handle && gbm_bo_get_width(entry->bo) == width &&
+            gbm_bo_get_height(entry->bo) == height && gbm_bo_get_format(entry->bo) == gbm_bo_get_format(bo)) {
+            gbm_bo_destroy(bo);
+            entry->last_used = ++self->scanout_cache_clock;
+            return entry->bo;
+        }
+        if (cog_drm_gles_renderer_is_presented(self, entry->bo))
+            continue;
+        if (!slot || !entry->bo || (slot->bo && entry->last_used < slot->last_used))
+            slot = entry;
+    }
+    if (!slot) {
+        gbm_bo_destroy(bo);
+        return NULL;
     }
+
+    g_clear_pointer(&slot->bo, gbm_bo_destroy);
+    *slot = (CogDrmGlesScanoutBuffer){bo, handle, ++self->scanout_cache_clock};
+    self->stats.scanout_imported++;
+    return bo;
+}
+
+/*
+ * Drops the cached BOs and their frame buffers. Those which are presented
+ * cannot be destroyed yet, they are marked stale and replaced first instead.
+ */
+static void
+cog_drm_gles_renderer_clear_scanout_cache(CogDrmGlesRenderer *self)
+{
+    for (unsigned i = 0; i < SCANOUT_CACHE_SIZE; i++) {
+        CogDrmGlesScanoutBuffer *entry = &self->scanout_cache[i];
+        if (cog_drm_gles_renderer_is_presented(self, entry->bo)) {
+            entry->handle = 0;
+            entry->last_used = 0;
+        } else {
+            g_clear_pointer(&entry->bo, gbm_bo_destroy);
+            *entry = (CogDrmGlesScanoutBuffer){NULL, 0, 0};
+        }
+    }
+}
+
+static inline bool
+cog_drm_gles_scanout_config_equal(const CogDrmGlesScanoutConfig *a, const CogDrmGlesScanoutConfig *b)
+{
+    return a->format == b->format && a->modifier == b->modifier && a->rotation == b->rotation &&
+           a->width == b->width && a->height == b->height;
+}
+
+/*
+ * Test commits depend on the mode and rotation, check configurations again
+ * after they change, and import buffers anew for the new plane state.
+ */
+static void
+cog_drm_gles_renderer_reset_scanout_configs(CogDrmGlesRenderer *self)
+{
+    self->n_scanout_accepted = 0;
+    self->scanout_rejected_valid = false;
+    cog_drm_gles_renderer_clear_scanout_cache(self);
+}
+
+static bool
+cog_drm_gles_renderer_check_scanout(CogDrmGlesRenderer            *self,
+                                    const CogDrmGlesScanoutConfig *config,
+                                    uint32_t                       fb_id,
+                                    const CogDrmGlesFrame         *frame)
+{
+    for (unsigned i = 0; i < self->n_scanout_accepted; i++) {
+        if (cog_drm_gles_scanout_config_equal(&self->scanout_accepted[i], config))
+            return true;
+    }
+    if (self->scanout_rejected_valid && cog_drm_gles_scanout_config_equal(&self->scanout_rejected, config))
+        return false;
+
+    bool accepted = false;
+    drmModeAtomicSetCursor(self->req, 0);
+    if (cog_drm_gles_renderer_add_plane_properties(self, self->req, fb_id, frame)) {
+        accepted =
+            !drmModeAtomicCommit(gbm_device_get_fd(self->gbm_device), self->req, DRM_MODE_ATOMIC_TEST_ONLY, NULL);
+    }
+    self->stats.scanout_tested++;
+
+    const uint32_t format = config->format;
+    g_debug("%s: Format '%c%c%c%c' with modifier %#" PRIx64 " and rotation %#" PRIx64 " %s for direct scanout",
+            __func__, (format >> 0) & 0xFF, (format >> 8) & 0xFF, (format >> 16) & 0xFF, (format >> 24) & 0xFF,
+            config->modifier, config->rotation, accepted ? "accepted" : "rejected");
+
+    if (accepted) {
+        /* Few configurations are ever used, drop the oldest one when full. */
+        if (self->n_scanout_accepted == SCANOUT_CONFIGS_SIZE) {
+            memmove(&self->scanout_accepted[0], &self->scanout_accepted[1],
+                    (SCANOUT_CONFIGS_SIZE - 1) * sizeof(CogDrmGlesScanoutConfig));
+            self->n_scanout_accepted--;
+        }
+        self->scanout_accepted[self->n_scanout_accepted++] = *config;
+    } else {
+        self->scanout_rejected = *config;
+        self->scanout_rejected_valid = true;
+    }
+    return accepted;
+}
+
+/*
+ * Tries to present an image exported by WebKit as-is on the primary plane,
+ * which avoids painting it into the GBM surface. This is possible only with
+ * atomic mode setting, which allows checking beforehand whether the plane
+ * accepts the buffer, when the plane can apply the rotation (if any), and
+ * when the image covers the whole output.
+ */
+static bool
+cog_drm_gles_renderer_try_scanout(CogDrmGlesRenderer *self, struct wpe_fdo_egl_exported_image *image)
+{
+    if (!self->atomic_modesetting || !self->mode_set)
+        return false;
+
+    const uint64_t plane_rotation = cog_drm_renderer_rotation_to_plane(self->rotation);
+    if (self->rotation != COG_GL_RENDERER_ROTATION_0 && !(self->rotation_supported & plane_rotation))
+        return false;
+
+    const bool swap_size =
+        self->rotation == COG_GL_RENDERER_ROTATION_90 || self->rotation == COG_GL_RENDERER_ROTATION_270;
+    const uint32_t width = swap_size ? self->scanout_height : self->scanout_width;
+    const uint32_t height = swap_size ? self->scanout_width : self->scanout_height;
+    if (wpe_fdo_egl_exported_image_get_width(image) != width || wpe_fdo_egl_exported_image_get_height(image) != height)
+        return false;
+
+    struct gbm_bo *bo = cog_drm_gles_renderer_import_for_scanout(self, image);
+    if (!bo)
+        return false;
+
+    const CogDrmGlesScanoutConfig config = {
+        gbm_bo_get_format(bo), gbm_bo_get_modifier(bo), plane_rotation, width, height,
+    };
+    uint32_t        fb_id = cog_drm_gles_renderer_get_fb_for_bo(self, bo);
+    CogDrmGlesFrame frame = {bo, image, plane_rotation};
+    if (!fb_id || !cog_drm_gles_renderer_check_scanout(self, &config, fb_id, &frame))
+        return false;
+
+    /* The image is released once the next frame has replaced it on screen. */
+    cog_drm_gles_renderer_present(self, &frame, fb_id);
+    self->stats.frames_scanout++;
+    return true;
+}
+
+static void
+cog_drm_gles_renderer_handle_egl_image(void *data, struct wpe_fdo_egl_exported_image *image)
+{
+    CogDrmGlesRenderer *self = data;
+
+    if (cog_drm_gles_renderer_try_scanout(self, image))
+        return;
+
+    if (!eglMakeCurrent(self->egl_display, self->egl_surface, self->egl_surface, self->egl_context)) {
+        g_critical("%s: Cannot activate EGL context for rendering (%#04x)", __func__, eglGetError());
+        return;
+    }
+
+    glViewport(0, 0, self->scanout_width, self->scanout_height);
+    glClearColor(0, 0, 0, 0);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    cog_gl_renderer_paint(&self->gl_render, wpe_fdo_egl_exported_image_get_egl_image(image), self->rotation);
+
+    if (self->fence.in_fence_fd_prop_id) {
+        static const EGLint attrib[] = {
+            EGL_SYNC_NATIVE_FENCE_FD_ANDROID,
+            EGL_NO_NATIVE_FENCE_FD_ANDROID,
+            EGL_NONE,
+        };
+        EGLSyncKHR sync = eglCreateSyncKHR(self->egl_display, EGL_SYNC_NATIVE_FENCE_ANDROID, attrib);
+        if (sync != EGL_NO_SYNC_KHR) {
+            /* The fence gets a file descriptor once it has been flushed. */
+            glFlush();
+            cog_drm_gles_renderer_close_fence(&self->fence.render_fd);
+            self->fence.render_fd = eglDupNativeFenceFDANDROID(self->egl_display, sync);
+            eglDestroySyncKHR(self->egl_display, sync);
+        }
+    }
+
+    if (G_UNLIKELY(!eglSwapBuffers(self->egl_display, self->egl_surface))) {
+        g_critical("%s: eglSwapBuffers failed (%#04x)", __func__, eglGetError());
+        return;
+    }
+
+    wpe_view_backend_exportable_fdo_egl_dispatch_release_exported_image(self->exportable, image);
+
+    struct gbm_bo *bo = gbm_surface_lock_front_buffer(self->gbm_surface);
+
+    uint32_t fb_id = cog_drm_gles_renderer_get_fb_for_bo(self, bo);
+    if (!fb_id) {
+        gbm_surface_release_buffer(self->gbm_surface, bo);
+        return;
+    }
+
+    /* Painting has already applied the rotation. */
+    CogDrmGlesFrame frame = {bo, NULL, cog_drm_renderer_rotation_to_plane(COG_GL_RENDERER_ROTATION_0)};
+    cog_drm_gles_renderer_present(self, &frame, fb_id);
 }
 
 static void
@@ -190,13 +747,32 @@ cog_drm_gles_renderer_handle_page_flip(int fd, unsigned frame, unsigned sec, uns
 {
     CogDrmGlesRenderer *self = data;
 
-    if (self->current_bo) {
-        uint32_t fb_id = GPOINTER_TO_INT(gbm_bo_get_user_data(self->current_bo));
-        drmModeRmFB(gbm_device_get_fd(self->gbm_device), fb_id);
-        gbm_surface_release_buffer(self->gbm_surface, self->current_bo);
+    /* Both fences have signaled by now, their timestamps tell how long each step took. */
+    const int64_t rendered = cog_drm_gles_renderer_get_fence_time(self->fence.in_fd);
+    const int64_t displayed = cog_drm_gles_renderer_get_fence_time(self->fence.out_fd);
+    if (rendered >= 0 && displayed >= 0) {
+        const uint64_t render_wait = MAX(rendered - self->fence.commit_time, 0);
+        self->stats.fenced_frames++;
+        self->stats.render_wait_us += render_wait;
+        self->stats.render_wait_max_us = MAX(self->stats.render_wait_max_us, render_wait);
+        self->stats.display_latency_us += MAX(displayed - self->fence.commit_time, 0);
     }
-    self->current_bo = g_steal_pointer(&self->next_bo);
+    cog_drm_gles_renderer_close_fence(&self->fence.in_fd);
+    cog_drm_gles_renderer_close_fence(&self->fence.out_fd);
 
+    cog_drm_gles_renderer_release_frame(self, &self->current_frame);
+    self->current_frame = self->next_frame;
+    self->next_frame = (CogDrmGlesFrame){NULL, NULL, 0};
+    self->flip_pending = false;
+
+    cog_drm_present_stats_page_flip(&self->present_stats, frame);
+    cog_drm_frame_scheduler_page_flip(self->frame_scheduler, sec, usec);
+}
+
+static void
+cog_drm_gles_renderer_frame_complete(void *data)
+{
+    CogDrmGlesRenderer *self = data;
     wpe_view_backend_exportable_fdo_dispatch_frame_complete(self->exportable);
 }
 
@@ -313,7 +889,17 @@ cog_drm_gles_renderer_initialize(CogDrmRenderer *renderer, GError **error)
         return false;
     }
 
-    if (!(self->gbm_surface = gbm_surface_create(self->gbm_device, self->mode.hdisplay, self->mode.vdisplay,
+    if (self->atomic_modesetting && epoxy_has_egl_extension(self->egl_display, "EGL_ANDROID_native_fence_sync")) {
+        int drm_fd = gbm_device_get_fd(self->gbm_device);
+        self->fence.in_fence_fd_prop_id =
+            cog_drm_object_get_property_id(drm_fd, self->plane_id, DRM_MODE_OBJECT_PLANE, "IN_FENCE_FD");
+        self->fence.out_fence_ptr_prop_id =
+            cog_drm_object_get_property_id(drm_fd, self->crtc_id, DRM_MODE_OBJECT_CRTC, "OUT_FENCE_PTR");
+    }
+    g_debug("%s: Explicit synchronization %s", __func__,
+            self->fence.in_fence_fd_prop_id ? "enabled" : "unavailable, using implicit synchronization");
+
+    if (!(self->gbm_surface = gbm_surface_create(self->gbm_device, self->scanout_width, self->scanout_height,
                                                  self->gbm_format, GBM_BO_USE_SCANOUT | GBM_BO_USE_RENDERING))) {
         g_set_error(error, COG_PLATFORM_WPE_ERROR, COG_PLATFORM_WPE_ERROR_INIT,
                     "Cannot create GBM surface for output rendering (%s)", g_strerror(errno));
@@ -355,6 +941,34 @@ cog_drm_gles_renderer_destroy(CogDrmRenderer *renderer)
     CogDrmGlesRenderer *self = wl_container_of(renderer, self, base);
 
     g_clear_handle_id(&self->drm_fd_source, g_source_remove);
+    g_clear_pointer(&self->frame_scheduler, cog_drm_frame_scheduler_free);
+
+    g_debug("%s: %" PRIu64 " frames presented (%" PRIu64 " scanned out directly) using %" PRIu64 " framebuffers",
+            __func__, self->stats.frames, self->stats.frames_scanout, self->stats.fb_created);
+    if (self->stats.frames_scanout) {
+        g_debug("%s: Imported %" PRIu64 " exported images for direct scanout, %" PRIu64 " test commits", __func__,
+                self->stats.scanout_imported, self->stats.scanout_tested);
+    }
+    if (self->stats.fenced_frames) {
+        g_debug("%s: Waited for rendering %.3f ms on average (%.3f ms max), frames shown %.3f ms after commit",
+                __func__, self->stats.render_wait_us / 1000.0 / self->stats.fenced_frames,
+                self->stats.render_wait_max_us / 1000.0,
+                self->stats.display_latency_us / 1000.0 / self->stats.fenced_frames);
+    }
+    cog_drm_present_stats_log(&self->present_stats, self->base.name);
+
+    cog_drm_gles_renderer_close_fence(&self->fence.render_fd);
+    cog_drm_gles_renderer_close_fence(&self->fence.in_fd);
+    cog_drm_gles_renderer_close_fence(&self->fence.out_fd);
+    g_clear_pointer(&self->req, drmModeAtomicFree);
+
+    /* The exportable may be gone already, and with it the images it exported. */
+    CogDrmGlesFrame *frames[] = {&self->current_frame, &self->next_frame};
+    for (unsigned i = 0; i < G_N_ELEMENTS(frames); i++) {
+        if (frames[i]->image)
+            *frames[i] = (CogDrmGlesFrame){NULL, NULL, 0};
+    }
+    cog_drm_gles_renderer_clear_scanout_cache(self);
 
     if (self->egl_surface != EGL_NO_SURFACE) {
         eglDestroySurface(self->egl_display, self->egl_surface);
@@ -404,6 +1018,7 @@ cog_drm_gles_renderer_set_rotation(CogDrmRenderer *renderer, CogGLRendererRotati
         return true;
 
     self->rotation = rotation;
+    cog_drm_gles_renderer_reset_scanout_configs(self);
 
     if (self->exportable) {
         uint32_t width, height;
@@ -429,6 +1044,151 @@ cog_drm_gles_renderer_create_exportable(CogDrmRenderer *renderer, uint32_t width
     return (self->exportable = wpe_view_backend_exportable_fdo_egl_create(&client, renderer, width, height));
 }
 
+static bool
+cog_drm_gles_renderer_lookup_modeset_properties(CogDrmGlesRenderer *self)
+{
+    if (!self->atomic_modesetting)
+        return false;
+
+    if (self->modeset_prop_id.crtc_mode_id)
+        return true;
+
+    /* A partial lookup would make cog_drm_gles_renderer_restore_frame() try atomic commits. */
+    if (!cog_drm_get_modeset_property_ids(gbm_device_get_fd(self->gbm_device), self->connector_id, self->crtc_id,
+                                          &self->modeset_prop_id)) {
+        memset(&self->modeset_prop_id, 0, sizeof(self->modeset_prop_id));
+        return false;
+    }
+    return true;
+}
+
+static bool
+cog_drm_gles_renderer_set_scanout_size(CogDrmRenderer *renderer, uint32_t width, uint32_t height)
+{
+    CogDrmGlesRenderer *self = wl_container_of(renderer, self, base);
+    g_assert(!self->gbm_surface);
+
+    if (width == self->mode.hdisplay && height == self->mode.vdisplay) {
+        self->scanout_width = width;
+        self->scanout_height = height;
+        return true;
+    }
+
+    /* The plane needs to be programmed together with the mode. */
+    if (!cog_drm_gles_renderer_lookup_modeset_properties(self))
+        return false;
+
+    self->scanout_width = width;
+    self->scanout_height = height;
+    g_debug("%s: Scaling %" PRIu32 "x%" PRIu32 " buffers to %" PRIu16 "x%" PRIu16 " mode.", __func__, width, height,
+            self->mode.hdisplay, self->mode.vdisplay);
+    return true;
+}
+
+static bool
+cog_drm_gles_renderer_set_variable_refresh(CogDrmRenderer *renderer, bool enabled)
+{
+    CogDrmGlesRenderer *self = wl_container_of(renderer, self, base);
+    g_assert(!self->mode_set);
+
+    self->vrr_enabled_prop_id = enabled ? cog_drm_object_get_property_id(gbm_device_get_fd(self->gbm_device),
+                                                                          self->crtc_id, DRM_MODE_OBJECT_CRTC,
+                                                                          "VRR_ENABLED")
+                                        : 0;
+
+    /* The display waits for frames, there is no vertical blank to aim for. */
+    if (self->vrr_enabled_prop_id)
+        cog_drm_frame_scheduler_set_enabled(self->frame_scheduler, false);
+    return !enabled || self->vrr_enabled_prop_id;
+}
+
+static bool
+cog_drm_gles_renderer_set_async_page_flip(CogDrmRenderer *renderer, bool enabled)
+{
+    CogDrmGlesRenderer *self = wl_container_of(renderer, self, base);
+    g_assert(!self->mode_set);
+
+    self->async_page_flip = enabled && cog_drm_device_supports_async_page_flip(gbm_device_get_fd(self->gbm_device),
+                                                                               self->atomic_modesetting);
+
+    /* Frames are shown as soon as they are committed, there is no vertical blank to aim for. */
+    if (self->async_page_flip)
+        cog_drm_frame_scheduler_set_enabled(self->frame_scheduler, false);
+    return self->async_page_flip == enabled;
+}
+
+/*
+ * Sets the mode with the frame currently on screen, waiting for the commit
+ * to complete, which does not produce a page flip event.
+ */
+static bool
+cog_drm_gles_renderer_restore_frame(CogDrmGlesRenderer *self)
+{
+    const uint32_t fb_id = cog_drm_gles_renderer_get_fb_for_bo(self, self->current_frame.bo);
+    if (!fb_id)
+        return false;
+
+    int drm_fd = gbm_device_get_fd(self->gbm_device);
+    if (!self->modeset_prop_id.crtc_mode_id) {
+        if (drmModeSetCrtc(drm_fd, self->crtc_id, fb_id, 0, 0, &self->connector_id, 1, &self->mode))
+            return false;
+
+        if (self->vrr_enabled_prop_id &&
+            drmModeObjectSetProperty(drm_fd, self->crtc_id, DRM_MODE_OBJECT_CRTC, self->vrr_enabled_prop_id, 1)) {
+            g_warning("%s: Cannot enable variable refresh rate (%s)", __func__, g_strerror(errno));
+        }
+        return true;
+    }
+
+    drmModeAtomicReq *req = self->req;
+    uint32_t          mode_blob_id = 0;
+    int               ret = -1;
+    drmModeAtomicSetCursor(req, 0);
+    if (cog_drm_gles_renderer_add_modeset_properties(self, req, &mode_blob_id) &&
+        cog_drm_gles_renderer_add_plane_properties(self, req, fb_id, &self->current_frame))
+        ret = drmModeAtomicCommit(drm_fd, req, DRM_MODE_ATOMIC_ALLOW_MODESET, NULL);
+
+    if (mode_blob_id)
+        drmModeDestroyPropertyBlob(drm_fd, mode_blob_id);
+    return ret == 0;
+}
+
+static bool
+cog_drm_gles_renderer_set_mode(CogDrmRenderer *renderer, const drmModeModeInfo *mode)
+{
+    CogDrmGlesRenderer *self = wl_container_of(renderer, self, base);
+
+    /* The GBM surface keeps its size, a mode of another size needs the plane to scale it. */
+    const bool scaled = self->scanout_width != mode->hdisplay || self->scanout_height != mode->vdisplay;
+    if (!cog_drm_gles_renderer_lookup_modeset_properties(self) && scaled)
+        return false;
+
+    memcpy(&self->mode, mode, sizeof(drmModeModeInfo));
+    self->mode_set = false;
+    cog_drm_frame_scheduler_set_mode(self->frame_scheduler, mode);
+    cog_drm_gles_renderer_reset_scanout_configs(self);
+
+    /* A frame which failed to be committed will not be flipped, and cannot be shown anymore. */
+    if (!self->flip_pending)
+        cog_drm_gles_renderer_release_frame(self, &self->next_frame);
+
+    /* With a page flip pending, the mode gets set with the next frame instead. */
+    if (self->current_frame.bo && !self->flip_pending) {
+        if (cog_drm_gles_renderer_restore_frame(self))
+            self->mode_set = true;
+        else
+            g_warning("%s: Cannot set mode (%s)", __func__, g_strerror(errno));
+    }
+
+    g_debug("%s: Mode '%s' @ %" PRIu32 "Hz, %s.", __func__, self->mode.name, self->mode.vrefresh,
+            self->mode_set ? "set" : "pending");
+
+    /* Frame completion may have been missed if committing failed while the output was gone. */
+    if (self->exportable && !self->flip_pending)
+        cog_drm_frame_scheduler_resume(self->frame_scheduler);
+    return true;
+}
+
 CogDrmRenderer *
 cog_drm_gles_renderer_new(struct gbm_device     *gbm_device,
                           EGLDisplay             egl_display,
@@ -448,6 +1208,10 @@ cog_drm_gles_renderer_new(struct gbm_device     *gbm_device,
         .base.destroy = cog_drm_gles_renderer_destroy,
         .base.set_rotation = cog_drm_gles_renderer_set_rotation,
         .base.create_exportable = cog_drm_gles_renderer_create_exportable,
+        .base.set_scanout_size = cog_drm_gles_renderer_set_scanout_size,
+        .base.set_variable_refresh = cog_drm_gles_renderer_set_variable_refresh,
+        .base.set_async_page_flip = cog_drm_gles_renderer_set_async_page_flip,
+        .base.set_mode = cog_drm_gles_renderer_set_mode,
 
         .rotation = COG_GL_RENDERER_ROTATION_0,
 
@@ -456,6 +1220,10 @@ cog_drm_gles_renderer_new(struct gbm_device     *gbm_device,
         .egl_context = EGL_NO_CONTEXT,
         .egl_surface = EGL_NO_SURFACE,
 
+        .fence.render_fd = -1,
+        .fence.in_fd = -1,
+        .fence.out_fd = -1,
+
         .drm_context.version = DRM_EVENT_CONTEXT_VERSION,
         .drm_context.page_flip_handler = cog_drm_gles_renderer_handle_page_flip,
 
@@ -466,30 +1234,25 @@ cog_drm_gles_renderer_new(struct gbm_device     *gbm_device,
     };
 
     memcpy(&self->mode, mode, sizeof(drmModeModeInfo));
+    self->scanout_width = mode->hdisplay;
+    self->scanout_height = mode->vdisplay;
 
     int drm_fd = gbm_device_get_fd(gbm_device);
 
-    /* one-time lookup of property identifiers-- avoid per-render lookup */
-    drmModeObjectProperties *plane_props = drmModeObjectGetProperties(drm_fd, self->plane_id, DRM_MODE_OBJECT_PLANE);
-    for (int i = 0; i < plane_props->count_props; ++i) {
-        drmModePropertyPtr prop = drmModeGetProperty(drm_fd, plane_props->props[i]);
-        if (g_ascii_strcasecmp(prop->name, "type") == 0)    self->prop_id.type_id = prop->prop_id;
-        if (g_ascii_strcasecmp(prop->name, "fb_id") == 0)   self->prop_id.fb_id = prop->prop_id;
-        if (g_ascii_strcasecmp(prop->name, "crtc_id") == 0) self->prop_id.crtc_id = prop->prop_id;
-        if (g_ascii_strcasecmp(prop->name, "crtc_x") == 0)  self->prop_id.crtc_x = prop->prop_id;
-        if (g_ascii_strcasecmp(prop->name, "crtc_y") == 0)  self->prop_id.crtc_y = prop->prop_id;
-        if (g_ascii_strcasecmp(prop->name, "crtc_w") == 0)  self->prop_id.crtc_w = prop->prop_id;
-        if (g_ascii_strcasecmp(prop->name, "crtc_h") == 0)  self->prop_id.crtc_h = prop->prop_id;
-        if (g_ascii_strcasecmp(prop->name, "src_x") == 0)   self->prop_id.src_x = prop->prop_id;
-        if (g_ascii_strcasecmp(prop->name, "src_y") == 0)   self->prop_id.src_y = prop->prop_id;
-        if (g_ascii_strcasecmp(prop->name, "src_w") == 0)   self->prop_id.src_w = prop->prop_id;
-        if (g_ascii_strcasecmp(prop->name, "src_h") == 0)   self->prop_id.src_h = prop->prop_id;
-        drmModeFreeProperty(prop);
-    }
-    drmModeFreeObjectProperties(plane_props);
+    if (self->atomic_modesetting && !cog_drm_plane_get_property_ids(drm_fd, self->plane_id, &self->prop_id)) {
+        g_warning("%s: Missing plane properties for atomic commits, using legacy mode setting.", __func__);
+        self->atomic_modesetting = false;
+    }
+
+    if (self->atomic_modesetting) {
+        self->req = drmModeAtomicAlloc();
+        self->rotation_prop_id = cog_drm_plane_get_rotation_property(drm_fd, plane_id, &self->rotation_supported);
+    }
+
+    self->frame_scheduler = cog_drm_frame_scheduler_new(drm_fd, mode, cog_drm_gles_renderer_frame_complete, self);
 
     g_debug("%s: Using plane #%" PRIu32 ", crtc #%" PRIu32 ", connector #%" PRIu32 " (%s).", __func__, plane_id,
-            crtc_id, connector_id, atomic_modesetting ? "atomic" : "legacy");
+            crtc_id, connector_id, self->atomic_modesetting ? "atomic" : "legacy");
 
     return &self->base;
 }
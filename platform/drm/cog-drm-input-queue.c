@@ -0,0 +1,145 @@
+/*
+ * cog-drm-input-queue.c
+ * Copyright (C) 2024 Igalia S.L.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "cog-drm-input-queue.h"
+
+#include <errno.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+/*
+ * Ring buffer with a single producer, the input thread, and a single
+ * consumer, the main thread. Each side only writes its own index, and
+ * reads the other one atomically: the producer fills a slot before
+ * publishing the new tail, and the consumer copies a slot out before
+ * publishing the new head, so no locking is needed. One slot is always
+ * left empty to tell a full ring from an empty one.
+ *
+ * The consumer is woken up through an eventfd, which the producer signals
+ * once after pushing a batch of events instead of once per event.
+ */
+
+struct _CogDrmInputQueue {
+    CogDrmInputEvent *events;
+    unsigned          mask;
+    int               fd;
+
+    int head; /* Next slot to pop, written by the consumer. */
+    int tail; /* Next slot to push, written by the producer. */
+};
+
+/*
+ * Creates a queue with room for at least capacity - 1 events; the capacity
+ * is rounded up to a power of two.
+ */
+CogDrmInputQueue *
+cog_drm_input_queue_new(unsigned capacity)
+{
+    g_assert(capacity > 1);
+
+    int fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (fd == -1) {
+        g_warning("Cannot create input queue eventfd: %s", g_strerror(errno));
+        return NULL;
+    }
+
+    unsigned size = 2;
+    while (size < capacity)
+        size <<= 1;
+
+    CogDrmInputQueue *self = g_new0(CogDrmInputQueue, 1);
+    self->events = g_new0(CogDrmInputEvent, size);
+    self->mask = size - 1;
+    self->fd = fd;
+    return self;
+}
+
+void
+cog_drm_input_queue_free(CogDrmInputQueue *self)
+{
+    if (!self)
+        return;
+
+    close(self->fd);
+    g_free(self->events);
+    g_free(self);
+}
+
+/*
+ * Returns a file descriptor which becomes readable after the producer has
+ * called cog_drm_input_queue_notify(), until the consumer calls
+ * cog_drm_input_queue_clear_notify().
+ */
+int
+cog_drm_input_queue_get_fd(const CogDrmInputQueue *self)
+{
+    g_assert(self);
+    return self->fd;
+}
+
+/*
+ * Appends an event, to be called only from the producer thread. Returns
+ * false, without blocking, when the queue is full.
+ */
+bool
+cog_drm_input_queue_push(CogDrmInputQueue *self, const CogDrmInputEvent *event)
+{
+    g_assert(self);
+    g_assert(event);
+
+    const int tail = self->tail;
+    const int next = (tail + 1) & self->mask;
+    if (next == g_atomic_int_get(&self->head))
+        return false;
+
+    self->events[tail] = *event;
+    g_atomic_int_set(&self->tail, next);
+    return true;
+}
+
+void
+cog_drm_input_queue_notify(CogDrmInputQueue *self)
+{
+    g_assert(self);
+
+    const uint64_t value = 1;
+    while (write(self->fd, &value, sizeof value) == -1 && errno == EINTR)
+        ;
+}
+
+/*
+ * Removes the oldest event, to be called only from the consumer thread.
+ * Returns false when the queue is empty.
+ */
+bool
+cog_drm_input_queue_pop(CogDrmInputQueue *self, CogDrmInputEvent *event)
+{
+    g_assert(self);
+    g_assert(event);
+
+    const int head = self->head;
+    if (head == g_atomic_int_get(&self->tail))
+        return false;
+
+    *event = self->events[head];
+    g_atomic_int_set(&self->head, (head + 1) & self->mask);
+    return true;
+}
+
+/*
+ * Resets the notification. The consumer must call this before popping
+ * events, so that events pushed while draining the queue notify again.
+ */
+void
+cog_drm_input_queue_clear_notify(CogDrmInputQueue *self)
+{
+    g_assert(self);
+
+    uint64_t value;
+    while (read(self->fd, &value, sizeof value) == -1 && errno == EINTR)
+        ;
+}
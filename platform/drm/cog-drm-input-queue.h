@@ -0,0 +1,72 @@
+/*
+ * cog-drm-input-queue.h
+ * Copyright (C) 2024 Igalia S.L.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <libinput.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+G_BEGIN_DECLS
+
+typedef struct _CogDrmInputQueue CogDrmInputQueue;
+
+/*
+ * Input event translated from libinput, with everything needed to handle it
+ * later without keeping the libinput event around. Coordinates of absolute
+ * pointer motion and touch points are normalized to the [0, 1] range.
+ */
+typedef struct {
+    enum libinput_event_type type;
+    uint64_t                 time_usec;
+    union {
+        struct {
+            uint32_t key;
+            bool     pressed;
+        } key;
+        struct {
+            uint32_t button;
+            bool     pressed;
+        } button;
+        struct {
+            double dx;
+            double dy;
+        } motion;
+        struct {
+            double x;
+            double y;
+        } absolute;
+        struct {
+            int32_t slot;
+            double  x;
+            double  y;
+        } touch;
+        struct {
+            bool   discrete; /* Values in 1/120ths of a wheel detent. */
+            bool   has_vertical;
+            bool   has_horizontal;
+            double vertical;
+            double horizontal;
+        } scroll;
+    };
+} CogDrmInputEvent;
+
+CogDrmInputQueue *cog_drm_input_queue_new(unsigned capacity);
+void              cog_drm_input_queue_free(CogDrmInputQueue *self);
+
+int cog_drm_input_queue_get_fd(const CogDrmInputQueue *self);
+
+bool cog_drm_input_queue_push(CogDrmInputQueue *self, const CogDrmInputEvent *event);
+void cog_drm_input_queue_notify(CogDrmInputQueue *self);
+
+bool cog_drm_input_queue_pop(CogDrmInputQueue *self, CogDrmInputEvent *event);
+void cog_drm_input_queue_clear_notify(CogDrmInputQueue *self);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(CogDrmInputQueue, cog_drm_input_queue_free)
+
+G_END_DECLS
@@ -6,14 +6,27 @@
  */
 
 #include "../../core/cog.h"
+#include "../common/cog-hash.h"
+#include "cog-drm-frame-scheduler.h"
 #include "cog-drm-renderer.h"
+#include "cog-drm-video-plane.h"
 #include <errno.h>
 #include <gbm.h>
+#include <inttypes.h>
 #include <wayland-server.h>
 #include <wpe/fdo.h>
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 
+/* Maximum number of rectangles passed in FB_DAMAGE_CLIPS. */
+#define DAMAGE_MAX_RECTS 16
+
+/*
+ * Default number of BOs which SHM frames get copied into: one on screen, one
+ * waiting for its page flip, and one being filled.
+ */
+#define SHM_POOL_SIZE 3
+
 typedef struct {
     GSource         base;
     GPollFD         pfd;
@@ -73,22 +86,38 @@ struct buffer_object {
 
     uint32_t            fb_id;
     struct gbm_bo      *bo;
-    struct wl_resource *buffer_resource;
+    struct wl_resource *buffer_resource; /* NULL for pooled SHM buffers. */
+
+    /* Hashes of the rows of SHM data last copied into the BO. */
+    uint64_t *row_hashes;
+    uint32_t  n_row_hashes;
+
+    /* Pooled SHM buffer which is committed, on screen, or deferred. */
+    bool busy;
 
     struct {
-        struct wl_resource                 *resource;
-        struct wpe_fdo_shm_exported_buffer *shm_buffer;
+        struct wl_resource *resource;
     } export;
 };
 
 typedef struct {
     CogDrmRenderer base;
 
-    GSource *drm_source;
+    GSource              *drm_source;
+    CogDrmFrameScheduler *frame_scheduler;
 
     struct buffer_object *committed_buffer;
     struct wl_list        buffer_list; /* buffer_object::link */
 
+    /*
+     * BOs which SHM frames are copied into, reused for any frame of the same
+     * size once the page flip of the next frame takes them off screen.
+     */
+    struct wl_list shm_pool; /* buffer_object::link */
+    unsigned       shm_pool_size;
+    unsigned       shm_pool_capacity;
+    bool           shm_pool_exhausted; /* Warned about growing the pool. */
+
     struct wpe_view_backend_exportable_fdo *exportable;
 
     struct gbm_device *gbm_dev;
@@ -98,13 +127,71 @@ typedef struct {
     uint32_t        plane_id;
     drmModeModeInfo mode;
     bool            mode_set;
+    bool            flip_pending;
     bool            atomic_modesetting;
     bool            addfb2_modifiers;
 
+    /*
+     * Frames are flipped without waiting for the vertical blank. Atomic
+     * asynchronous commits may only change the frame buffer, so the plane
+     * state of the last synchronous commit must still be the wanted one.
+     */
+    bool                  async_page_flip;
+    CogGLRendererRotation committed_rotation;
+
+    /*
+     * Video frames are committed along with frames of web content when both
+     * change, and on their own otherwise. Frames of web content which arrive
+     * while the video plane alone is being flipped wait for it to finish.
+     */
+    CogDrmVideoPlane     *video_plane;
+    bool                  video_flip_pending;
+    struct buffer_object *deferred_buffer;
+
+    /*
+     * Logical view size without rotation applied. Rotation is done by the
+     * display controller, which requires atomic mode setting and a plane
+     * with the "rotation" property.
+     */
+    uint32_t              width, height;
+    CogGLRendererRotation rotation;
+    uint32_t              rotation_prop_id;
+    uint64_t              rotation_supported;
+
+    /* Size of the buffers, scaled to the mode size by the plane. */
+    uint32_t scanout_width, scanout_height;
+
+    /* Set along with the mode, zero if variable refresh rate is not used. */
+    uint32_t vrr_enabled_prop_id;
+
+    /* Looked up once, and the request reused for every atomic commit. */
+    CogDrmPlanePropertyIds   plane_prop_id;
+    CogDrmModesetPropertyIds modeset_prop_id;
+    drmModeAtomicReq        *req;
+
+    GByteArray *dirty_rows; /* Scratch space for drm_copy_shm_buffer_into_bo() */
+
+    /*
+     * Hashes of the rows of the last SHM frame committed, which may not be
+     * the previous contents of the BO being committed, and the rectangles
+     * which changed since then. Damage is unknown (i.e. everything) when
+     * damage_valid is false.
+     */
+    uint64_t *frame_row_hashes;
+    uint32_t  n_frame_row_hashes;
+    GArray   *damage; /* struct drm_mode_rect */
+    bool      damage_valid;
+    uint32_t  damage_clips_prop_id;
+
     struct {
-        drmModeObjectProperties *props;
-        drmModePropertyRes     **props_info;
-    } connector_props, crtc_props, plane_props;
+        uint64_t rows_total;
+        uint64_t rows_copied;
+        uint64_t area_total;
+        uint64_t area_damaged;
+        uint64_t shm_frames;
+        uint64_t shm_bo_created;
+    } stats;
+    CogDrmPresentStats present_stats;
 } CogDrmModesetRenderer;
 
 static inline int
@@ -125,12 +212,7 @@ destroy_buffer(CogDrmModesetRenderer *renderer, struct buffer_object *buffer)
         buffer->export.resource = NULL;
     }
 
-    if (buffer->export.shm_buffer) {
-        wpe_view_backend_exportable_fdo_dispatch_release_shm_exported_buffer(renderer->exportable,
-                                                                             buffer->export.shm_buffer);
-        buffer->export.shm_buffer = NULL;
-    }
-
+    g_free(buffer->row_hashes);
     g_free(buffer);
 }
 
@@ -226,19 +308,8 @@ drm_create_buffer_for_bo(CogDrmModesetRenderer *self,
 }
 
 static struct buffer_object *
-drm_create_buffer_for_shm_buffer(CogDrmModesetRenderer *self,
-                                 struct wl_resource    *buffer_resource,
-                                 struct wl_shm_buffer  *shm_buffer)
+drm_create_buffer_for_shm(CogDrmModesetRenderer *self, uint32_t width, uint32_t height)
 {
-    uint32_t format = wl_shm_buffer_get_format(shm_buffer);
-    if (format != WL_SHM_FORMAT_ARGB8888 && format != WL_SHM_FORMAT_XRGB8888) {
-        g_warning("failed to handle non-32-bit ARGB/XRGB format");
-        return NULL;
-    }
-
-    int32_t width = wl_shm_buffer_get_width(shm_buffer);
-    int32_t height = wl_shm_buffer_get_height(shm_buffer);
-
     // TODO: don't ignore the alpha channel in case of ARGB8888 SHM data
     uint32_t       gbm_format = GBM_FORMAT_XRGB8888;
     struct gbm_bo *bo = gbm_bo_create(self->gbm_dev, width, height, gbm_format, GBM_BO_USE_SCANOUT | GBM_BO_USE_WRITE);
@@ -268,52 +339,211 @@ drm_create_buffer_for_shm_buffer(CogDrmModesetRenderer *self,
     }
 
     struct buffer_object *buffer = g_new0(struct buffer_object, 1);
-    wl_list_insert(&self->buffer_list, &buffer->link);
-    buffer->destroy_listener.notify = destroy_buffer_notify;
-    wl_resource_add_destroy_listener(buffer_resource, &buffer->destroy_listener);
-    wl_resource_set_user_data(buffer_resource, self);
-
     buffer->fb_id = fb_id;
     buffer->bo = bo;
-    buffer->buffer_resource = buffer_resource;
 
+    self->stats.shm_bo_created++;
     return buffer;
 }
 
 static void
-drm_copy_shm_buffer_into_bo(struct wl_shm_buffer *shm_buffer, struct gbm_bo *bo)
+drm_shm_pool_remove(CogDrmModesetRenderer *self, struct buffer_object *buffer)
+{
+    wl_list_remove(&buffer->link);
+    self->shm_pool_size--;
+    destroy_buffer(self, buffer);
+}
+
+/*
+ * Takes an idle BO of the given size from the pool. The pool only grows up
+ * to its capacity, idle BOs of other sizes get replaced when it is
+ * full, and BOs allocated while all of them are busy are freed again as
+ * soon as they go idle.
+ */
+static struct buffer_object *
+drm_shm_pool_acquire(CogDrmModesetRenderer *self, uint32_t width, uint32_t height)
 {
-    int32_t width = wl_shm_buffer_get_width(shm_buffer);
-    int32_t height = wl_shm_buffer_get_height(shm_buffer);
-    int32_t stride = wl_shm_buffer_get_stride(shm_buffer);
+    struct buffer_object *buffer, *spare = NULL;
+    wl_list_for_each(buffer, &self->shm_pool, link) {
+        if (buffer->busy)
+            continue;
+        if (gbm_bo_get_width(buffer->bo) == width && gbm_bo_get_height(buffer->bo) == height) {
+            buffer->busy = true;
+            return buffer;
+        }
+        spare = buffer;
+    }
 
-    uint32_t bo_stride = 0;
-    void    *map_data = NULL;
-    gbm_bo_map(bo, 0, 0, width, height, GBM_BO_TRANSFER_WRITE, &bo_stride, &map_data);
-    if (!map_data)
+    if (self->shm_pool_size >= self->shm_pool_capacity) {
+        if (spare) {
+            drm_shm_pool_remove(self, spare);
+        } else {
+            if (!self->shm_pool_exhausted) {
+                g_warning("%s: All %u SHM buffers are busy, allocating more", __func__, self->shm_pool_size);
+                self->shm_pool_exhausted = true;
+            }
+        }
+    }
+
+    if (!(buffer = drm_create_buffer_for_shm(self, width, height)))
+        return NULL;
+
+    wl_list_insert(&self->shm_pool, &buffer->link);
+    self->shm_pool_size++;
+    buffer->busy = true;
+    return buffer;
+}
+
+/*
+ * Returns a pooled BO which is not going to be scanned out anymore, does
+ * nothing for buffers tied to a wl_buffer resource.
+ */
+static void
+drm_shm_pool_release(CogDrmModesetRenderer *self, struct buffer_object *buffer)
+{
+    if (!buffer || buffer->buffer_resource)
         return;
 
+    buffer->busy = false;
+    if (self->shm_pool_size > self->shm_pool_capacity)
+        drm_shm_pool_remove(self, buffer);
+}
+
+/* Hands a buffer which is not going to be scanned out anymore back to its producer. */
+static void
+drm_release_buffer(CogDrmModesetRenderer *self, struct buffer_object *buffer)
+{
+    if (buffer->export.resource) {
+        wpe_view_backend_exportable_fdo_dispatch_release_buffer(self->exportable, buffer->export.resource);
+        buffer->export.resource = NULL;
+    }
+
+    drm_shm_pool_release(self, buffer);
+}
+
+/*
+ * Copies the rows of the SHM buffer which changed since its contents were
+ * last copied into the BO of the buffer object. Hashing the source rows is
+ * much cheaper than writing into the BO, which is usually write-combined
+ * or uncached memory, and only the band of changed rows gets mapped.
+ *
+ * Both ARGB8888 and XRGB8888 data have the same layout as the XRGB8888 BO,
+ * so rows can be copied as-is.
+ */
+static void
+drm_copy_shm_buffer_into_bo(CogDrmModesetRenderer *self,
+                            struct buffer_object  *buffer,
+                            struct wl_shm_buffer  *shm_buffer)
+{
+    const uint32_t width = MIN((uint32_t) wl_shm_buffer_get_width(shm_buffer), gbm_bo_get_width(buffer->bo));
+    const uint32_t height = MIN((uint32_t) wl_shm_buffer_get_height(shm_buffer), gbm_bo_get_height(buffer->bo));
+    const size_t   stride = wl_shm_buffer_get_stride(shm_buffer);
+    const size_t   row_size = (size_t) width * 4;
+
+    bool hashes_valid = true;
+    if (buffer->n_row_hashes != height) {
+        g_free(buffer->row_hashes);
+        buffer->row_hashes = g_new(uint64_t, height);
+        buffer->n_row_hashes = height;
+        hashes_valid = false;
+    }
+
+    bool frame_hashes_valid = true;
+    if (self->n_frame_row_hashes != height) {
+        g_free(self->frame_row_hashes);
+        self->frame_row_hashes = g_new(uint64_t, height);
+        self->n_frame_row_hashes = height;
+        frame_hashes_valid = false;
+    }
+
+    g_byte_array_set_size(self->dirty_rows, height);
+    uint8_t *dirty = self->dirty_rows->data;
+
+    g_array_set_size(self->damage, 0);
+    self->damage_valid = frame_hashes_valid;
+
     wl_shm_buffer_begin_access(shm_buffer);
 
-    uint8_t *src = wl_shm_buffer_get_data(shm_buffer);
+    const uint8_t *src = wl_shm_buffer_get_data(shm_buffer);
+    uint32_t       first = height, last = 0;
+    for (uint32_t y = 0; y < height; y++) {
+        const uint64_t hash = cog_hash64(src + y * stride, row_size);
+        dirty[y] = !hashes_valid || hash != buffer->row_hashes[y];
+        if (dirty[y]) {
+            buffer->row_hashes[y] = hash;
+            if (first == height)
+                first = y;
+            last = y;
+        }
+
+        /* Runs of rows which differ from the last frame become damage rectangles. */
+        if (!frame_hashes_valid || hash != self->frame_row_hashes[y]) {
+            self->frame_row_hashes[y] = hash;
+            struct drm_mode_rect *r =
+                self->damage->len ? &g_array_index(self->damage, struct drm_mode_rect, self->damage->len - 1) : NULL;
+            if (r && r->y2 == (int32_t) y) {
+                r->y2++;
+            } else {
+                const struct drm_mode_rect rect = {0, y, width, y + 1};
+                g_array_append_val(self->damage, rect);
+            }
+        }
+    }
+
+    /* Too many rectangles cost more to process than they save, use their bounds. */
+    if (self->damage->len > DAMAGE_MAX_RECTS) {
+        const int32_t y2 = g_array_index(self->damage, struct drm_mode_rect, self->damage->len - 1).y2;
+        g_array_set_size(self->damage, 1);
+        g_array_index(self->damage, struct drm_mode_rect, 0).y2 = y2;
+    }
+
+    self->stats.rows_total += height;
+    if (first == height) {
+        wl_shm_buffer_end_access(shm_buffer);
+        return;
+    }
+
+    const uint32_t n_rows = last - first + 1;
+    uint32_t       bo_stride = 0;
+    void          *map_data = NULL;
+    gbm_bo_map(buffer->bo, 0, first, width, n_rows, GBM_BO_TRANSFER_WRITE, &bo_stride, &map_data);
+    if (!map_data) {
+        /* Nothing was copied, make sure that everything is next time. */
+        buffer->n_row_hashes = 0;
+        self->n_frame_row_hashes = 0;
+        self->damage_valid = false;
+        wl_shm_buffer_end_access(shm_buffer);
+        return;
+    }
+
     uint8_t *dst = map_data;
+    src += first * stride;
 
-    uint32_t bo_width = gbm_bo_get_width(bo);
-    uint32_t bo_height = gbm_bo_get_height(bo);
-    if (!(width == bo_width && height == bo_height && stride == bo_stride)) {
-        for (uint32_t y = 0; y < height; ++y) {
-            for (uint32_t x = 0; x < width; ++x) {
-                dst[bo_stride * y + 4 * x + 0] = src[stride * y + 4 * x + 0];
-                dst[bo_stride * y + 4 * x + 1] = src[stride * y + 4 * x + 1];
-                dst[bo_stride * y + 4 * x + 2] = src[stride * y + 4 * x + 2];
-                dst[bo_stride * y + 4 * x + 3] = src[stride * y + 4 * x + 3];
+    if (stride == bo_stride && n_rows == height) {
+        memcpy(dst, src, (n_rows - 1) * stride + row_size);
+        self->stats.rows_copied += n_rows;
+    } else {
+        for (uint32_t y = 0; y < n_rows; y++, src += stride, dst += bo_stride) {
+            if (dirty[first + y]) {
+                memcpy(dst, src, row_size);
+                self->stats.rows_copied++;
             }
         }
-    } else
-        memcpy(dst, src, stride * height);
+    }
 
     wl_shm_buffer_end_access(shm_buffer);
-    gbm_bo_unmap(bo, map_data);
+    gbm_bo_unmap(buffer->bo, map_data);
+}
+
+/*
+ * Marks the damage of the next frame as unknown, for buffers which do not
+ * come from SHM data. The frame after it needs to be fully damaged, too.
+ */
+static inline void
+drm_invalidate_damage(CogDrmModesetRenderer *self)
+{
+    self->n_frame_row_hashes = 0;
+    self->damage_valid = false;
 }
 
 typedef struct {
@@ -322,135 +552,285 @@ typedef struct {
 } FlipHandlerData;
 
 static int
-drm_commit_buffer_nonatomic(CogDrmModesetRenderer *self, struct buffer_object *buffer)
+drm_set_crtc(CogDrmModesetRenderer *self, struct buffer_object *buffer)
 {
-    if (!self->mode_set) {
-        int ret =
-            drmModeSetCrtc(get_drm_fd(self), self->crtc_id, buffer->fb_id, 0, 0, &self->connector_id, 1, &self->mode);
-        if (ret)
-            return -1;
-
-        self->mode_set = true;
-    }
-
-    FlipHandlerData *data = g_slice_new(FlipHandlerData);
-    *data = (FlipHandlerData){self, buffer};
+    int ret = drmModeSetCrtc(get_drm_fd(self), self->crtc_id, buffer->fb_id, 0, 0, &self->connector_id, 1, &self->mode);
+    if (ret)
+        return -1;
 
-    return drmModePageFlip(get_drm_fd(self), self->crtc_id, buffer->fb_id, DRM_MODE_PAGE_FLIP_EVENT, data);
-}
+    self->mode_set = true;
 
-static int
-add_property(drmModeObjectProperties *props,
-             drmModePropertyRes     **props_info,
-             drmModeAtomicReq        *req,
-             uint32_t                 obj_id,
-             const char              *name,
-             uint64_t                 value)
-{
-    for (int i = 0; i < props->count_props; ++i) {
-        if (!g_strcmp0(props_info[i]->name, name)) {
-            int ret = drmModeAtomicAddProperty(req, obj_id, props_info[i]->prop_id, value);
-            return (ret > 0) ? 0 : -1;
-        }
+    if (self->vrr_enabled_prop_id &&
+        drmModeObjectSetProperty(get_drm_fd(self), self->crtc_id, DRM_MODE_OBJECT_CRTC, self->vrr_enabled_prop_id, 1)) {
+        g_warning("%s: Cannot enable variable refresh rate (%s)", __func__, g_strerror(errno));
     }
-
-    return -1;
+    return 0;
 }
 
 static int
-add_connector_property(CogDrmModesetRenderer *self,
-                       drmModeAtomicReq      *req,
-                       uint32_t               obj_id,
-                       const char            *name,
-                       uint64_t               value)
+drm_commit_buffer_nonatomic(CogDrmModesetRenderer *self, struct buffer_object *buffer, bool async)
 {
-    return add_property(self->connector_props.props, self->connector_props.props_info, req, obj_id, name, value);
-}
+    if (!self->mode_set && drm_set_crtc(self, buffer))
+        return -1;
 
-static int
-add_crtc_property(CogDrmModesetRenderer *self, drmModeAtomicReq *req, uint32_t obj_id, const char *name, uint64_t value)
-{
-    return add_property(self->crtc_props.props, self->crtc_props.props_info, req, obj_id, name, value);
-}
+    FlipHandlerData *data = g_slice_new(FlipHandlerData);
+    *data = (FlipHandlerData){self, buffer};
 
-static int
-add_plane_property(CogDrmModesetRenderer *self,
-                   drmModeAtomicReq      *req,
-                   uint32_t               obj_id,
-                   const char            *name,
-                   uint64_t               value)
-{
-    return add_property(self->plane_props.props, self->plane_props.props_info, req, obj_id, name, value);
+    const uint32_t flags = DRM_MODE_PAGE_FLIP_EVENT | (async ? DRM_MODE_PAGE_FLIP_ASYNC : 0);
+    if (drmModePageFlip(get_drm_fd(self), self->crtc_id, buffer->fb_id, flags, data)) {
+        g_slice_free(FlipHandlerData, data);
+        return -1;
+    }
+    return 0;
 }
 
+/*
+ * Blocking commits are used to set the mode again with a buffer which is
+ * already on screen, and do not produce a page flip event.
+ */
 static int
-drm_commit_buffer_atomic(CogDrmModesetRenderer *self, struct buffer_object *buffer)
+drm_commit_buffer_atomic(CogDrmModesetRenderer *self, struct buffer_object *buffer, bool blocking)
 {
     int      ret = 0;
-    uint32_t flags = DRM_MODE_PAGE_FLIP_EVENT | DRM_MODE_ATOMIC_NONBLOCK;
+    uint32_t flags = blocking ? 0 : DRM_MODE_PAGE_FLIP_EVENT | DRM_MODE_ATOMIC_NONBLOCK;
 
-    drmModeAtomicReq *req = drmModeAtomicAlloc();
+    drmModeAtomicReq *req = self->req;
+    drmModeAtomicSetCursor(req, 0);
 
+    uint32_t mode_blob_id = 0;
     if (!self->mode_set) {
         flags |= DRM_MODE_ATOMIC_ALLOW_MODESET;
 
-        uint32_t blob_id;
-        ret = drmModeCreatePropertyBlob(get_drm_fd(self), &self->mode, sizeof(drmModeModeInfo), &blob_id);
-        if (ret) {
-            drmModeAtomicFree(req);
+        ret = drmModeCreatePropertyBlob(get_drm_fd(self), &self->mode, sizeof(drmModeModeInfo), &mode_blob_id);
+        if (ret)
             return -1;
-        }
 
-        ret |= add_connector_property(self, req, self->connector_id, "CRTC_ID", self->crtc_id);
-        ret |= add_crtc_property(self, req, self->crtc_id, "MODE_ID", blob_id);
-        ret |= add_crtc_property(self, req, self->crtc_id, "ACTIVE", 1);
+        const CogDrmModesetPropertyIds *ids = &self->modeset_prop_id;
+        ret |= drmModeAtomicAddProperty(req, self->connector_id, ids->connector_crtc_id, self->crtc_id) < 0;
+        ret |= drmModeAtomicAddProperty(req, self->crtc_id, ids->crtc_mode_id, mode_blob_id) < 0;
+        ret |= drmModeAtomicAddProperty(req, self->crtc_id, ids->crtc_active, 1) < 0;
+        if (self->vrr_enabled_prop_id)
+            ret |= drmModeAtomicAddProperty(req, self->crtc_id, self->vrr_enabled_prop_id, 1) < 0;
         if (ret) {
-            drmModeAtomicFree(req);
+            drmModeDestroyPropertyBlob(get_drm_fd(self), mode_blob_id);
             return -1;
         }
+    }
 
-        self->mode_set = true;
+    /* The source rectangle is in frame buffer coordinates, before rotation. */
+    uint64_t src_w = self->scanout_width, src_h = self->scanout_height;
+    if (self->rotation == COG_GL_RENDERER_ROTATION_90 || self->rotation == COG_GL_RENDERER_ROTATION_270) {
+        src_w = self->scanout_height;
+        src_h = self->scanout_width;
     }
 
-    ret |= add_plane_property(self, req, self->plane_id, "FB_ID", buffer->fb_id);
-    ret |= add_plane_property(self, req, self->plane_id, "CRTC_ID", self->crtc_id);
-    ret |= add_plane_property(self, req, self->plane_id, "SRC_X", 0);
-    ret |= add_plane_property(self, req, self->plane_id, "SRC_Y", 0);
-    ret |= add_plane_property(self, req, self->plane_id, "SRC_W", ((uint64_t) self->mode.hdisplay) << 16);
-    ret |= add_plane_property(self, req, self->plane_id, "SRC_H", ((uint64_t) self->mode.vdisplay) << 16);
-    ret |= add_plane_property(self, req, self->plane_id, "CRTC_X", 0);
-    ret |= add_plane_property(self, req, self->plane_id, "CRTC_Y", 0);
-    ret |= add_plane_property(self, req, self->plane_id, "CRTC_W", self->mode.hdisplay);
-    ret |= add_plane_property(self, req, self->plane_id, "CRTC_H", self->mode.vdisplay);
+    const CogDrmPlanePropertyIds *ids = &self->plane_prop_id;
+    ret |= drmModeAtomicAddProperty(req, self->plane_id, ids->fb_id, buffer->fb_id) < 0;
+    ret |= drmModeAtomicAddProperty(req, self->plane_id, ids->crtc_id, self->crtc_id) < 0;
+    ret |= drmModeAtomicAddProperty(req, self->plane_id, ids->src_x, 0) < 0;
+    ret |= drmModeAtomicAddProperty(req, self->plane_id, ids->src_y, 0) < 0;
+    ret |= drmModeAtomicAddProperty(req, self->plane_id, ids->src_w, src_w << 16) < 0;
+    ret |= drmModeAtomicAddProperty(req, self->plane_id, ids->src_h, src_h << 16) < 0;
+    ret |= drmModeAtomicAddProperty(req, self->plane_id, ids->crtc_x, 0) < 0;
+    ret |= drmModeAtomicAddProperty(req, self->plane_id, ids->crtc_y, 0) < 0;
+    ret |= drmModeAtomicAddProperty(req, self->plane_id, ids->crtc_w, self->mode.hdisplay) < 0;
+    ret |= drmModeAtomicAddProperty(req, self->plane_id, ids->crtc_h, self->mode.vdisplay) < 0;
+    if (self->rotation_prop_id) {
+        ret |= drmModeAtomicAddProperty(req, self->plane_id, self->rotation_prop_id,
+                                        cog_drm_renderer_rotation_to_plane(self->rotation)) < 0;
+    }
+
+    /*
+     * Drivers which upload frame buffers to the display (SPI, USB, virtual
+     * devices) may then transfer only the damaged area. Without the property
+     * the whole frame buffer counts as damaged.
+     */
+    uint32_t damage_blob_id = 0;
+    if (self->damage_clips_prop_id && self->damage_valid && !blocking) {
+        /* A frame without changes still needs a page flip, pass an empty rectangle. */
+        static const struct drm_mode_rect empty = {0, 0, 0, 0};
+        const void  *rects = self->damage->len ? (const void *) self->damage->data : &empty;
+        const size_t size = MAX(self->damage->len, 1) * sizeof(struct drm_mode_rect);
+        if (drmModeCreatePropertyBlob(get_drm_fd(self), rects, size, &damage_blob_id) == 0)
+            ret |= drmModeAtomicAddProperty(req, self->plane_id, self->damage_clips_prop_id, damage_blob_id) < 0;
+        else
+            damage_blob_id = 0;
+    } else if (self->damage_clips_prop_id) {
+        ret |= drmModeAtomicAddProperty(req, self->plane_id, self->damage_clips_prop_id, 0) < 0;
+    }
+
+    /* Video frames are shown along with the web content they are embedded in. */
+    const int video_cursor = drmModeAtomicGetCursor(req);
+    bool      with_video = false;
+    if (!ret && !blocking && self->video_plane && cog_drm_video_plane_has_update(self->video_plane)) {
+        with_video = cog_drm_video_plane_add_properties(self->video_plane, req, &self->mode, self->scanout_width,
+                                                        self->scanout_height);
+        if (!with_video)
+            drmModeAtomicSetCursor(req, video_cursor);
+    }
+
+    FlipHandlerData *data = NULL;
+    if (!ret) {
+        if (!blocking) {
+            data = g_slice_new(FlipHandlerData);
+            *data = (FlipHandlerData){self, buffer};
+        }
+        ret = drmModeAtomicCommit(get_drm_fd(self), req, flags, data);
+
+        /*
+         * Keep showing web content when the plane does not accept the video
+         * frame. If the commit fails without it as well, the failure is not
+         * due to the video frame, which stays pending for the next commit.
+         */
+        if (ret && with_video) {
+            drmModeAtomicSetCursor(req, video_cursor);
+            with_video = false;
+            ret = drmModeAtomicCommit(get_drm_fd(self), req, flags, data);
+            if (!ret)
+                cog_drm_video_plane_rejected(self->video_plane);
+        }
+    }
+
+    /* The committed CRTC and plane states keep their own references to the blobs. */
+    if (mode_blob_id)
+        drmModeDestroyPropertyBlob(get_drm_fd(self), mode_blob_id);
+    if (damage_blob_id)
+        drmModeDestroyPropertyBlob(get_drm_fd(self), damage_blob_id);
+
     if (ret) {
-        drmModeAtomicFree(req);
+        if (data)
+            g_slice_free(FlipHandlerData, data);
         return -1;
     }
 
-    FlipHandlerData *data = g_slice_new(FlipHandlerData);
-    *data = (FlipHandlerData){self, buffer};
+    self->mode_set = true;
+    self->committed_rotation = self->rotation;
+    if (with_video)
+        cog_drm_video_plane_committed(self->video_plane);
+    return 0;
+}
+
+/*
+ * Commits a new state of the video plane on its own, when no frame of web
+ * content is on the way to carry it.
+ */
+static void
+drm_commit_video_plane(CogDrmModesetRenderer *self)
+{
+    if (!self->video_plane || !cog_drm_video_plane_has_update(self->video_plane) || !self->mode_set ||
+        self->flip_pending || self->video_flip_pending)
+        return;
+
+    drmModeAtomicReq *req = self->req;
+    drmModeAtomicSetCursor(req, 0);
+
+    int ret = !cog_drm_video_plane_add_properties(self->video_plane, req, &self->mode, self->scanout_width,
+                                                  self->scanout_height);
+
+    FlipHandlerData *data = NULL;
+    if (!ret) {
+        data = g_slice_new(FlipHandlerData);
+        *data = (FlipHandlerData){self, NULL};
+        ret = drmModeAtomicCommit(get_drm_fd(self), req, DRM_MODE_PAGE_FLIP_EVENT | DRM_MODE_ATOMIC_NONBLOCK, data);
+    }
 
-    ret = drmModeAtomicCommit(get_drm_fd(self), req, flags, data);
     if (ret) {
-        drmModeAtomicFree(req);
-        return -1;
+        const bool busy = data && errno == EBUSY;
+        g_debug("%s: Cannot show video frame (%s)", __func__, g_strerror(errno));
+        if (data)
+            g_slice_free(FlipHandlerData, data);
+        /* A busy CRTC is transient, the frame stays pending for the next commit. */
+        if (!busy)
+            cog_drm_video_plane_rejected(self->video_plane);
+        return;
+    }
+
+    cog_drm_video_plane_committed(self->video_plane);
+    self->video_flip_pending = true;
+}
+
+/*
+ * Kernels older than 6.8 reject atomic asynchronous commits with properties
+ * other than FB_ID, so damage is not passed and the whole frame is updated.
+ */
+static int
+drm_commit_buffer_atomic_async(CogDrmModesetRenderer *self, struct buffer_object *buffer)
+{
+    drmModeAtomicReq *req = self->req;
+    drmModeAtomicSetCursor(req, 0);
+
+    int ret = drmModeAtomicAddProperty(req, self->plane_id, self->plane_prop_id.fb_id, buffer->fb_id) < 0;
+
+    FlipHandlerData *data = NULL;
+    if (!ret) {
+        data = g_slice_new(FlipHandlerData);
+        *data = (FlipHandlerData){self, buffer};
+        ret = drmModeAtomicCommit(get_drm_fd(self), req,
+                                  DRM_MODE_PAGE_FLIP_EVENT | DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_ASYNC, data);
     }
 
-    drmModeAtomicFree(req);
+    if (ret) {
+        if (data)
+            g_slice_free(FlipHandlerData, data);
+        return -1;
+    }
     return 0;
 }
 
 static void
 drm_commit_buffer(CogDrmModesetRenderer *self, struct buffer_object *buffer)
 {
-    int ret;
-    if (self->atomic_modesetting)
-        ret = drm_commit_buffer_atomic(self, buffer);
-    else
-        ret = drm_commit_buffer_nonatomic(self, buffer);
+    if (self->video_flip_pending) {
+        /* Damage was computed against the replaced frame, which is never going to be shown. */
+        if (self->deferred_buffer && self->deferred_buffer != buffer) {
+            drm_release_buffer(self, self->deferred_buffer);
+            drm_invalidate_damage(self);
+        }
+        self->deferred_buffer = buffer;
+        return;
+    }
 
-    if (ret)
+    cog_drm_present_stats_begin(&self->present_stats);
+
+    /* Changing the mode or the rotation needs a synchronous commit. */
+    bool async = self->async_page_flip && self->mode_set && self->rotation == self->committed_rotation;
+    if (async) {
+        if (self->atomic_modesetting)
+            async = !drm_commit_buffer_atomic_async(self, buffer);
+        else
+            async = !drm_commit_buffer_nonatomic(self, buffer, true);
+        if (!async)
+            self->present_stats.async_rejected++;
+    }
+
+    int ret = 0;
+    if (!async) {
+        ret = self->atomic_modesetting ? drm_commit_buffer_atomic(self, buffer, false)
+                                       : drm_commit_buffer_nonatomic(self, buffer, false);
+    }
+
+    if (ret) {
         g_warning("failed to schedule a page flip: %s", g_strerror(errno));
+        /* The frame was not shown, so the next one cannot be compared with it. */
+        drm_invalidate_damage(self);
+        drm_shm_pool_release(self, buffer);
+        return;
+    }
+
+    self->flip_pending = true;
+    cog_drm_present_stats_commit(&self->present_stats, async);
+    cog_drm_frame_scheduler_frame_committed(self->frame_scheduler);
+
+    const uint64_t area = (uint64_t) gbm_bo_get_width(buffer->bo) * gbm_bo_get_height(buffer->bo);
+    self->stats.area_total += area;
+    if (self->damage_valid && !async) {
+        for (unsigned i = 0; i < self->damage->len; i++) {
+            const struct drm_mode_rect *r = &g_array_index(self->damage, struct drm_mode_rect, i);
+            self->stats.area_damaged += (uint64_t) (r->x2 - r->x1) * (r->y2 - r->y1);
+        }
+    } else {
+        self->stats.area_damaged += area;
+    }
 }
 
 static void
@@ -458,6 +838,7 @@ on_export_buffer_resource(void *data, struct wl_resource *buffer_resource)
 {
     CogDrmModesetRenderer *self = data;
     struct buffer_object  *buffer = drm_buffer_for_resource(self, buffer_resource);
+    drm_invalidate_damage(self);
     if (buffer) {
         buffer->export.resource = buffer_resource;
         drm_commit_buffer(self, buffer);
@@ -488,6 +869,7 @@ on_export_dmabuf_resource(void *data, struct wpe_view_backend_exportable_fdo_dma
     CogDrmModesetRenderer *self = data;
 
     struct buffer_object *buffer = drm_buffer_for_resource(self, dmabuf_resource->buffer_resource);
+    drm_invalidate_damage(self);
     if (buffer) {
         buffer->export.resource = dmabuf_resource->buffer_resource;
         drm_commit_buffer(self, buffer);
@@ -527,25 +909,26 @@ on_export_shm_buffer(void *data, struct wpe_fdo_shm_exported_buffer *exported_bu
 {
     CogDrmModesetRenderer *self = data;
 
-    struct wl_resource   *exported_resource = wpe_fdo_shm_exported_buffer_get_resource(exported_buffer);
     struct wl_shm_buffer *exported_shm_buffer = wpe_fdo_shm_exported_buffer_get_shm_buffer(exported_buffer);
 
-    struct buffer_object *buffer = drm_buffer_for_resource(self, exported_resource);
-    if (buffer) {
-        drm_copy_shm_buffer_into_bo(exported_shm_buffer, buffer->bo);
-
-        buffer->export.shm_buffer = exported_buffer;
-        drm_commit_buffer(self, buffer);
-        return;
+    struct buffer_object *buffer = NULL;
+    uint32_t              format = wl_shm_buffer_get_format(exported_shm_buffer);
+    if (format == WL_SHM_FORMAT_ARGB8888 || format == WL_SHM_FORMAT_XRGB8888) {
+        buffer = drm_shm_pool_acquire(self, wl_shm_buffer_get_width(exported_shm_buffer),
+                                      wl_shm_buffer_get_height(exported_shm_buffer));
+        if (buffer) {
+            drm_copy_shm_buffer_into_bo(self, buffer, exported_shm_buffer);
+            self->stats.shm_frames++;
+        }
+    } else {
+        g_warning("failed to handle non-32-bit ARGB/XRGB format");
     }
 
-    buffer = drm_create_buffer_for_shm_buffer(self, exported_resource, exported_shm_buffer);
-    if (buffer) {
-        drm_copy_shm_buffer_into_bo(exported_shm_buffer, buffer->bo);
+    /* The contents have been copied, WebKit may paint into the buffer again. */
+    wpe_view_backend_exportable_fdo_dispatch_release_shm_exported_buffer(self->exportable, exported_buffer);
 
-        buffer->export.shm_buffer = exported_buffer;
+    if (buffer)
         drm_commit_buffer(self, buffer);
-    }
 }
 
 static void
@@ -555,22 +938,39 @@ drm_page_flip_handler(int fd, unsigned int frame, unsigned int sec, unsigned int
     struct buffer_object  *buffer = ((FlipHandlerData *) data)->buffer;
     g_slice_free(FlipHandlerData, data);
 
-    if (self->committed_buffer) {
-        struct buffer_object *buffer = self->committed_buffer;
-
-        if (buffer->export.resource) {
-            wpe_view_backend_exportable_fdo_dispatch_release_buffer(self->exportable, buffer->export.resource);
-            buffer->export.resource = NULL;
-        }
-
-        if (buffer->export.shm_buffer) {
-            wpe_view_backend_exportable_fdo_dispatch_release_shm_exported_buffer(self->exportable,
-                                                                                 buffer->export.shm_buffer);
-            buffer->export.shm_buffer = NULL;
+    /* Page flip of a commit with the video plane alone. */
+    if (!buffer) {
+        self->video_flip_pending = false;
+        cog_drm_video_plane_page_flip(self->video_plane);
+
+        if (self->deferred_buffer) {
+            buffer = self->deferred_buffer;
+            self->deferred_buffer = NULL;
+            drm_commit_buffer(self, buffer);
+        } else {
+            drm_commit_video_plane(self);
         }
+        return;
     }
 
+    if (self->committed_buffer)
+        drm_release_buffer(self, self->committed_buffer);
+
     self->committed_buffer = buffer;
+    self->flip_pending = false;
+    cog_drm_present_stats_page_flip(&self->present_stats, frame);
+    cog_drm_frame_scheduler_page_flip(self->frame_scheduler, sec, usec);
+
+    if (self->video_plane) {
+        cog_drm_video_plane_page_flip(self->video_plane);
+        drm_commit_video_plane(self);
+    }
+}
+
+static void
+drm_frame_complete(void *data)
+{
+    CogDrmModesetRenderer *self = data;
     wpe_view_backend_exportable_fdo_dispatch_frame_complete(self->exportable);
 }
 
@@ -596,34 +996,92 @@ cog_drm_modeset_renderer_destroy(CogDrmRenderer *renderer)
         destroy_buffer(self, buffer);
     }
     wl_list_init(&self->buffer_list);
+    wl_list_for_each_safe(buffer, tmp, &self->shm_pool, link) {
+        wl_list_remove(&buffer->link);
+        destroy_buffer(self, buffer);
+    }
+    wl_list_init(&self->shm_pool);
     self->committed_buffer = NULL;
+    self->deferred_buffer = NULL;
 
-    if (self->connector_props.props_info) {
-        for (uint32_t i = 0; i < self->connector_props.props->count_props; i++)
-            drmModeFreeProperty(self->connector_props.props_info[i]);
-    }
-    g_clear_pointer(&self->connector_props.props, drmModeFreeObjectProperties);
-    g_clear_pointer(&self->connector_props.props_info, g_free);
+    g_clear_pointer(&self->frame_scheduler, cog_drm_frame_scheduler_free);
 
-    if (self->crtc_props.props_info) {
-        for (uint32_t i = 0; i < self->crtc_props.props->count_props; ++i)
-            drmModeFreeProperty(self->crtc_props.props_info[i]);
+    if (self->stats.rows_total) {
+        g_debug("%s: Copied %" PRIu64 " out of %" PRIu64 " SHM buffer rows (%.1f%%)", __func__,
+                self->stats.rows_copied, self->stats.rows_total,
+                100.0 * self->stats.rows_copied / self->stats.rows_total);
     }
-    g_clear_pointer(&self->crtc_props.props, drmModeFreeObjectProperties);
-    g_clear_pointer(&self->crtc_props.props_info, g_free);
-
-    if (self->plane_props.props_info) {
-        for (uint32_t i = 0; i < self->plane_props.props->count_props; ++i)
-            drmModeFreeProperty(self->plane_props.props_info[i]);
+    if (self->stats.shm_frames) {
+        g_debug("%s: Copied %" PRIu64 " SHM frames into %" PRIu64 " buffers", __func__, self->stats.shm_frames,
+                self->stats.shm_bo_created);
     }
-    g_clear_pointer(&self->plane_props.props, drmModeFreeObjectProperties);
-    g_clear_pointer(&self->plane_props.props_info, g_free);
+    if (self->stats.area_total) {
+        g_debug("%s: Damaged %" PRIu64 " out of %" PRIu64 " committed pixels (%.1f%%)%s", __func__,
+                self->stats.area_damaged, self->stats.area_total,
+                100.0 * self->stats.area_damaged / self->stats.area_total,
+                self->damage_clips_prop_id ? "" : ", plane without FB_DAMAGE_CLIPS");
+    }
+    cog_drm_present_stats_log(&self->present_stats, self->base.name);
+    g_clear_pointer(&self->dirty_rows, g_byte_array_unref);
+    g_clear_pointer(&self->damage, g_array_unref);
+    g_clear_pointer(&self->frame_row_hashes, g_free);
 
-    g_clear_pointer(&self->gbm_dev, gbm_device_destroy);
+    g_clear_pointer(&self->req, drmModeAtomicFree);
 
     g_slice_free(CogDrmModesetRenderer, self);
 }
 
+static void
+cog_drm_modeset_renderer_transformed_logical_size(const CogDrmModesetRenderer *self,
+                                                  uint32_t                    *width,
+                                                  uint32_t                    *height)
+{
+    switch (self->rotation) {
+    case COG_GL_RENDERER_ROTATION_0:
+    case COG_GL_RENDERER_ROTATION_180:
+        *width = self->width;
+        *height = self->height;
+        break;
+    case COG_GL_RENDERER_ROTATION_90:
+    case COG_GL_RENDERER_ROTATION_270:
+        *width = self->height;
+        *height = self->width;
+        break;
+    default:
+        g_assert_not_reached();
+    }
+}
+
+static bool
+cog_drm_modeset_renderer_set_rotation(CogDrmRenderer *renderer, CogGLRendererRotation rotation, bool apply)
+{
+    CogDrmModesetRenderer *self = wl_container_of(renderer, self, base);
+
+    const bool supported =
+        rotation == COG_GL_RENDERER_ROTATION_0 ||
+        (self->rotation_prop_id && (self->rotation_supported & cog_drm_renderer_rotation_to_plane(rotation)));
+
+    if (!apply || !supported)
+        return supported;
+
+    if (self->rotation == rotation)
+        return true;
+
+    self->rotation = rotation;
+
+    /* Video frames are not rotated, the plane gets disabled instead. */
+    if (self->video_plane)
+        cog_drm_video_plane_set_hidden(self->video_plane, rotation != COG_GL_RENDERER_ROTATION_0);
+
+    if (self->exportable) {
+        uint32_t width, height;
+        cog_drm_modeset_renderer_transformed_logical_size(self, &width, &height);
+        wpe_view_backend_dispatch_set_size(wpe_view_backend_exportable_fdo_get_view_backend(self->exportable), width,
+                                           height);
+    }
+    return true;
+}
+
 static struct wpe_view_backend_exportable_fdo *
 cog_drm_modeset_renderer_create_exportable(CogDrmRenderer *renderer, uint32_t width, uint32_t height)
 {
@@ -634,9 +1092,127 @@ cog_drm_modeset_renderer_create_exportable(CogDrmRenderer *renderer, uint32_t wi
     };
 
     CogDrmModesetRenderer *self = wl_container_of(renderer, self, base);
+
+    self->width = width;
+    self->height = height;
+    cog_drm_modeset_renderer_transformed_logical_size(self, &width, &height);
+
     return (self->exportable = wpe_view_backend_exportable_fdo_create(&client, renderer, width, height));
 }
 
+static bool
+cog_drm_modeset_renderer_set_scanout_size(CogDrmRenderer *renderer, uint32_t width, uint32_t height)
+{
+    CogDrmModesetRenderer *self = wl_container_of(renderer, self, base);
+
+    /* Scaling is done by the plane, which the legacy API cannot configure. */
+    if (!self->atomic_modesetting && (width != self->mode.hdisplay || height != self->mode.vdisplay))
+        return false;
+
+    self->scanout_width = width;
+    self->scanout_height = height;
+    return true;
+}
+
+static bool
+cog_drm_modeset_renderer_set_variable_refresh(CogDrmRenderer *renderer, bool enabled)
+{
+    CogDrmModesetRenderer *self = wl_container_of(renderer, self, base);
+    g_assert(!self->mode_set);
+
+    self->vrr_enabled_prop_id =
+        enabled ? cog_drm_object_get_property_id(get_drm_fd(self), self->crtc_id, DRM_MODE_OBJECT_CRTC, "VRR_ENABLED")
+                : 0;
+
+    /* The display waits for frames, there is no vertical blank to aim for. */
+    if (self->vrr_enabled_prop_id)
+        cog_drm_frame_scheduler_set_enabled(self->frame_scheduler, false);
+    return !enabled || self->vrr_enabled_prop_id;
+}
+
+static bool
+cog_drm_modeset_renderer_set_async_page_flip(CogDrmRenderer *renderer, bool enabled)
+{
+    CogDrmModesetRenderer *self = wl_container_of(renderer, self, base);
+    g_assert(!self->mode_set);
+
+    self->async_page_flip =
+        enabled && cog_drm_device_supports_async_page_flip(get_drm_fd(self), self->atomic_modesetting);
+
+    /* Frames are shown as soon as they are committed, there is no vertical blank to aim for. */
+    if (self->async_page_flip)
+        cog_drm_frame_scheduler_set_enabled(self->frame_scheduler, false);
+    return self->async_page_flip == enabled;
+}
+
+static bool
+cog_drm_modeset_renderer_set_shm_buffer_count(CogDrmRenderer *renderer, unsigned count)
+{
+    CogDrmModesetRenderer *self = wl_container_of(renderer, self, base);
+
+    /* With less than two buffers every frame would need a new one while the previous is on screen. */
+    if (count < 2)
+        return false;
+
+    self->shm_pool_capacity = count;
+    return true;
+}
+
+static bool
+cog_drm_modeset_renderer_set_mode(CogDrmRenderer *renderer, const drmModeModeInfo *mode)
+{
+    CogDrmModesetRenderer *self = wl_container_of(renderer, self, base);
+
+    /* Buffers keep their size, scaling them to a mode of another size needs the plane. */
+    if (!self->atomic_modesetting && (self->scanout_width != mode->hdisplay || self->scanout_height != mode->vdisplay))
+        return false;
+
+    memcpy(&self->mode, mode, sizeof(drmModeModeInfo));
+    self->mode_set = false;
+    cog_drm_frame_scheduler_set_mode(self->frame_scheduler, mode);
+    drm_invalidate_damage(self);
+
+    /* With a page flip pending, the mode gets set with the next frame instead. */
+    if (self->committed_buffer && !self->flip_pending && !self->video_flip_pending) {
+        const int ret = self->atomic_modesetting ? drm_commit_buffer_atomic(self, self->committed_buffer, true)
+                                                 : drm_set_crtc(self, self->committed_buffer);
+        if (ret)
+            g_warning("%s: Cannot set mode (%s)", __func__, g_strerror(errno));
+    }
+
+    g_debug("%s: Mode '%s' @ %" PRIu32 "Hz, %s.", __func__, self->mode.name, self->mode.vrefresh,
+            self->mode_set ? "set" : "pending");
+
+    /*
+     * Frame completion may have been missed if committing failed while the
+     * output was gone. Pending flips and deferred frames still trigger it.
+     */
+    if (self->exportable && !self->flip_pending && !self->video_flip_pending && !self->deferred_buffer)
+        cog_drm_frame_scheduler_resume(self->frame_scheduler);
+    return true;
+}
+
+static bool
+cog_drm_modeset_renderer_set_video_plane(CogDrmRenderer *renderer, CogDrmVideoPlane *video_plane)
+{
+    CogDrmModesetRenderer *self = wl_container_of(renderer, self, base);
+
+    /* Video frames are added to the commits of web content. */
+    if (!self->atomic_modesetting)
+        return false;
+
+    self->video_plane = video_plane;
+    cog_drm_video_plane_set_hidden(video_plane, self->rotation != COG_GL_RENDERER_ROTATION_0);
+    return true;
+}
+
+static void
+cog_drm_modeset_renderer_update_video_plane(CogDrmRenderer *renderer)
+{
+    CogDrmModesetRenderer *self = wl_container_of(renderer, self, base);
+    drm_commit_video_plane(self);
+}
+
 CogDrmRenderer *
 cog_drm_modeset_renderer_new(struct gbm_device     *gbm_dev,
                              uint32_t               plane_id,
@@ -651,7 +1227,15 @@ cog_drm_modeset_renderer_new(struct gbm_device     *gbm_dev,
         .base.name = "modeset",
         .base.initialize = cog_drm_modeset_renderer_initialize,
         .base.destroy = cog_drm_modeset_renderer_destroy,
+        .base.set_rotation = cog_drm_modeset_renderer_set_rotation,
         .base.create_exportable = cog_drm_modeset_renderer_create_exportable,
+        .base.set_scanout_size = cog_drm_modeset_renderer_set_scanout_size,
+        .base.set_variable_refresh = cog_drm_modeset_renderer_set_variable_refresh,
+        .base.set_async_page_flip = cog_drm_modeset_renderer_set_async_page_flip,
+        .base.set_shm_buffer_count = cog_drm_modeset_renderer_set_shm_buffer_count,
+        .base.set_mode = cog_drm_modeset_renderer_set_mode,
+        .base.set_video_plane = cog_drm_modeset_renderer_set_video_plane,
+        .base.update_video_plane = cog_drm_modeset_renderer_update_video_plane,
 
         .drm_source = drm_event_source_new(gbm_device_get_fd(gbm_dev)),
         .gbm_dev = gbm_dev,
@@ -660,6 +1244,9 @@ cog_drm_modeset_renderer_new(struct gbm_device     *gbm_dev,
         .connector_id = connector_id,
         .plane_id = plane_id,
         .atomic_modesetting = atomic_modesetting,
+        .shm_pool_capacity = SHM_POOL_SIZE,
+        .rotation = COG_GL_RENDERER_ROTATION_0,
+        .committed_rotation = COG_GL_RENDERER_ROTATION_0,
     };
 
     uint64_t value = 0;
@@ -671,33 +1258,32 @@ cog_drm_modeset_renderer_new(struct gbm_device     *gbm_dev,
     }
 
     wl_list_init(&self->buffer_list);
+    wl_list_init(&self->shm_pool);
     memcpy(&self->mode, mode, sizeof(drmModeModeInfo));
-
-    self->connector_props.props =
-        drmModeObjectGetProperties(get_drm_fd(self), self->connector_id, DRM_MODE_OBJECT_CONNECTOR);
-    if (self->connector_props.props) {
-        self->connector_props.props_info = g_new0(drmModePropertyRes *, self->connector_props.props->count_props);
-        for (uint32_t i = 0; i < self->connector_props.props->count_props; i++)
-            self->connector_props.props_info[i] =
-                drmModeGetProperty(get_drm_fd(self), self->connector_props.props->props[i]);
-    }
-
-    self->crtc_props.props = drmModeObjectGetProperties(get_drm_fd(self), self->crtc_id, DRM_MODE_OBJECT_CRTC);
-    if (self->crtc_props.props) {
-        self->crtc_props.props_info = g_new0(drmModePropertyRes *, self->crtc_props.props->count_props);
-        for (uint32_t i = 0; i < self->crtc_props.props->count_props; i++)
-            self->crtc_props.props_info[i] = drmModeGetProperty(get_drm_fd(self), self->crtc_props.props->props[i]);
+    self->scanout_width = mode->hdisplay;
+    self->scanout_height = mode->vdisplay;
+    self->dirty_rows = g_byte_array_new();
+    self->damage = g_array_new(FALSE, FALSE, sizeof(struct drm_mode_rect));
+    self->frame_scheduler = cog_drm_frame_scheduler_new(get_drm_fd(self), mode, drm_frame_complete, self);
+
+    if (self->atomic_modesetting &&
+        !(cog_drm_plane_get_property_ids(get_drm_fd(self), self->plane_id, &self->plane_prop_id) &&
+          cog_drm_get_modeset_property_ids(get_drm_fd(self), self->connector_id, self->crtc_id,
+                                           &self->modeset_prop_id))) {
+        g_warning("%s: Missing properties for atomic commits, using legacy mode setting.", __func__);
+        self->atomic_modesetting = false;
     }
 
-    self->plane_props.props = drmModeObjectGetProperties(get_drm_fd(self), self->plane_id, DRM_MODE_OBJECT_PLANE);
-    if (self->plane_props.props) {
-        self->plane_props.props_info = g_new0(drmModePropertyRes *, self->plane_props.props->count_props);
-        for (uint32_t i = 0; i < self->plane_props.props->count_props; i++)
-            self->plane_props.props_info[i] = drmModeGetProperty(get_drm_fd(self), self->plane_props.props->props[i]);
+    if (self->atomic_modesetting) {
+        self->req = drmModeAtomicAlloc();
+        self->rotation_prop_id =
+            cog_drm_plane_get_rotation_property(get_drm_fd(self), self->plane_id, &self->rotation_supported);
+        self->damage_clips_prop_id =
+            cog_drm_object_get_property_id(get_drm_fd(self), self->plane_id, DRM_MODE_OBJECT_PLANE, "FB_DAMAGE_CLIPS");
     }
 
     g_debug("%s: Using plane #%" PRIu32 ", crtc #%" PRIu32 ", connector #%" PRIu32 " (%s).", __func__, plane_id,
-            crtc_id, connector_id, atomic_modesetting ? "atomic" : "legacy");
+            crtc_id, connector_id, self->atomic_modesetting ? "atomic" : "legacy");
 
     return &self->base;
 }
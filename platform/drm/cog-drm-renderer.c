@@ -7,6 +7,15 @@
 
 #include "cog-drm-renderer.h"
 
+#include <stddef.h>
+#include <time.h>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#ifndef DRM_CAP_ATOMIC_ASYNC_PAGE_FLIP
+#    define DRM_CAP_ATOMIC_ASYNC_PAGE_FLIP 0x15
+#endif /* !DRM_CAP_ATOMIC_ASYNC_PAGE_FLIP */
+
 void
 cog_drm_renderer_destroy(CogDrmRenderer *self)
 {
@@ -15,3 +24,242 @@ cog_drm_renderer_destroy(CogDrmRenderer *self)
         self->destroy(self);
     }
 }
+
+static int64_t
+get_thread_cpu_time_ns(void)
+{
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts))
+        return 0;
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * Marks the start of the commit of a frame, to measure the CPU time taken
+ * until it is committed.
+ */
+void
+cog_drm_present_stats_begin(CogDrmPresentStats *stats)
+{
+    stats->commit_begin_ns = get_thread_cpu_time_ns();
+}
+
+/*
+ * Records that a frame has been committed, asynchronously or not, to
+ * measure the time until its page flip event.
+ */
+void
+cog_drm_present_stats_commit(CogDrmPresentStats *stats, bool async)
+{
+    if (stats->commit_begin_ns) {
+        const uint64_t cpu_time = MAX(get_thread_cpu_time_ns() - stats->commit_begin_ns, 0);
+        stats->commit_cpu_ns += cpu_time;
+        stats->commit_cpu_max_ns = MAX(stats->commit_cpu_max_ns, cpu_time);
+        stats->commit_begin_ns = 0;
+    }
+
+    stats->commit_time = g_get_monotonic_time();
+    stats->async = async;
+    if (async)
+        stats->frames_async++;
+}
+
+/*
+ * Records the page flip event of the last frame committed, with the vertical
+ * blank sequence number reported by the kernel.
+ */
+void
+cog_drm_present_stats_page_flip(CogDrmPresentStats *stats, unsigned sequence)
+{
+    const uint64_t latency = MAX(g_get_monotonic_time() - stats->commit_time, 0);
+    stats->latency_us += latency;
+    stats->latency_max_us = MAX(stats->latency_max_us, latency);
+
+    /* The previous frame was replaced while being scanned out. */
+    if (stats->async && stats->frames && sequence == stats->sequence)
+        stats->frames_replaced++;
+
+    stats->sequence = sequence;
+    stats->frames++;
+}
+
+void
+cog_drm_present_stats_log(const CogDrmPresentStats *stats, const char *renderer_name)
+{
+    if (!stats->frames)
+        return;
+
+    g_debug("%s: Renderer '%s', %" PRIu64 " frames shown %.3f ms after commit on average (%.3f ms max), %" PRIu64
+            " flipped asynchronously (%" PRIu64 " rejected), %" PRIu64 " replaced within the same refresh",
+            __func__, renderer_name, stats->frames, stats->latency_us / 1000.0 / stats->frames,
+            stats->latency_max_us / 1000.0, stats->frames_async, stats->async_rejected, stats->frames_replaced);
+    g_debug("%s: Renderer '%s', committing took %.1f us of CPU time on average (%.1f us max)", __func__,
+            renderer_name, stats->commit_cpu_ns / 1000.0 / stats->frames, stats->commit_cpu_max_ns / 1000.0);
+}
+
+typedef struct {
+    const char *name;
+    size_t      offset;
+} PropertyIdField;
+
+/*
+ * Looks up the identifiers of several properties of an object at once, each
+ * one stored at its offset in the ids struct. Returns false if any of them
+ * is missing.
+ */
+static bool
+cog_drm_object_get_property_ids(int                    fd,
+                                uint32_t               obj_id,
+                                uint32_t               obj_type,
+                                const PropertyIdField *fields,
+                                unsigned               n_fields,
+                                void                  *ids)
+{
+    drmModeObjectProperties *props = drmModeObjectGetProperties(fd, obj_id, obj_type);
+    if (!props)
+        return false;
+
+    unsigned found = 0;
+    for (uint32_t i = 0; i < props->count_props; i++) {
+        drmModePropertyRes *prop = drmModeGetProperty(fd, props->props[i]);
+        for (unsigned j = 0; prop && j < n_fields; j++) {
+            if (g_ascii_strcasecmp(prop->name, fields[j].name) == 0) {
+                *(uint32_t *) ((char *) ids + fields[j].offset) = prop->prop_id;
+                found++;
+                break;
+            }
+        }
+        g_clear_pointer(&prop, drmModeFreeProperty);
+    }
+    drmModeFreeObjectProperties(props);
+
+    return found == n_fields;
+}
+
+bool
+cog_drm_plane_get_property_ids(int fd, uint32_t plane_id, CogDrmPlanePropertyIds *ids)
+{
+    static const PropertyIdField fields[] = {
+        {"FB_ID", offsetof(CogDrmPlanePropertyIds, fb_id)},
+        {"CRTC_ID", offsetof(CogDrmPlanePropertyIds, crtc_id)},
+        {"SRC_X", offsetof(CogDrmPlanePropertyIds, src_x)},
+        {"SRC_Y", offsetof(CogDrmPlanePropertyIds, src_y)},
+        {"SRC_W", offsetof(CogDrmPlanePropertyIds, src_w)},
+        {"SRC_H", offsetof(CogDrmPlanePropertyIds, src_h)},
+        {"CRTC_X", offsetof(CogDrmPlanePropertyIds, crtc_x)},
+        {"CRTC_Y", offsetof(CogDrmPlanePropertyIds, crtc_y)},
+        {"CRTC_W", offsetof(CogDrmPlanePropertyIds, crtc_w)},
+        {"CRTC_H", offsetof(CogDrmPlanePropertyIds, crtc_h)},
+    };
+    return cog_drm_object_get_property_ids(fd, plane_id, DRM_MODE_OBJECT_PLANE, fields, G_N_ELEMENTS(fields), ids);
+}
+
+bool
+cog_drm_get_modeset_property_ids(int fd, uint32_t connector_id, uint32_t crtc_id, CogDrmModesetPropertyIds *ids)
+{
+    static const PropertyIdField connector_fields[] = {
+        {"CRTC_ID", offsetof(CogDrmModesetPropertyIds, connector_crtc_id)},
+    };
+    static const PropertyIdField crtc_fields[] = {
+        {"MODE_ID", offsetof(CogDrmModesetPropertyIds, crtc_mode_id)},
+        {"ACTIVE", offsetof(CogDrmModesetPropertyIds, crtc_active)},
+    };
+    return cog_drm_object_get_property_ids(fd, connector_id, DRM_MODE_OBJECT_CONNECTOR, connector_fields,
+                                           G_N_ELEMENTS(connector_fields), ids) &&
+           cog_drm_object_get_property_ids(fd, crtc_id, DRM_MODE_OBJECT_CRTC, crtc_fields,
+                                           G_N_ELEMENTS(crtc_fields), ids);
+}
+
+/*
+ * Checks whether page flips can be done without waiting for the vertical
+ * blank, with atomic commits or with the legacy API.
+ */
+bool
+cog_drm_device_supports_async_page_flip(int fd, bool atomic)
+{
+    uint64_t value = 0;
+    return !drmGetCap(fd, atomic ? DRM_CAP_ATOMIC_ASYNC_PAGE_FLIP : DRM_CAP_ASYNC_PAGE_FLIP, &value) && value;
+}
+
+/*
+ * Returns the identifier of the property of a KMS object with the given
+ * name, or zero if the object does not have such property.
+ */
+uint32_t
+cog_drm_object_get_property_id(int fd, uint32_t obj_id, uint32_t obj_type, const char *name)
+{
+    drmModeObjectProperties *props = drmModeObjectGetProperties(fd, obj_id, obj_type);
+    if (!props)
+        return 0;
+
+    uint32_t prop_id = 0;
+    for (uint32_t i = 0; !prop_id && i < props->count_props; i++) {
+        drmModePropertyRes *prop = drmModeGetProperty(fd, props->props[i]);
+        if (prop && g_ascii_strcasecmp(prop->name, name) == 0)
+            prop_id = prop->prop_id;
+        g_clear_pointer(&prop, drmModeFreeProperty);
+    }
+    drmModeFreeObjectProperties(props);
+
+    return prop_id;
+}
+
+/*
+ * Gets the current value of a property of a KMS object. Returns false if
+ * the object does not have such property.
+ */
+bool
+cog_drm_object_get_property_value(int fd, uint32_t obj_id, uint32_t obj_type, const char *name, uint64_t *value)
+{
+    drmModeObjectProperties *props = drmModeObjectGetProperties(fd, obj_id, obj_type);
+    if (!props)
+        return false;
+
+    bool found = false;
+    for (uint32_t i = 0; !found && i < props->count_props; i++) {
+        drmModePropertyRes *prop = drmModeGetProperty(fd, props->props[i]);
+        if (prop && g_ascii_strcasecmp(prop->name, name) == 0) {
+            *value = props->prop_values[i];
+            found = true;
+        }
+        g_clear_pointer(&prop, drmModeFreeProperty);
+    }
+    drmModeFreeObjectProperties(props);
+
+    return found;
+}
+
+/*
+ * Looks up the "rotation" property of a plane. Returns the property
+ * identifier, or zero if the plane does not have it, and stores in
+ * supported the mask of DRM_MODE_ROTATE_* and DRM_MODE_REFLECT_* flags
+ * accepted by the plane.
+ */
+uint32_t
+cog_drm_plane_get_rotation_property(int fd, uint32_t plane_id, uint64_t *supported)
+{
+    *supported = 0;
+
+    drmModeObjectProperties *props = drmModeObjectGetProperties(fd, plane_id, DRM_MODE_OBJECT_PLANE);
+    if (!props)
+        return 0;
+
+    uint32_t prop_id = 0;
+    for (uint32_t i = 0; !prop_id && i < props->count_props; i++) {
+        drmModePropertyRes *prop = drmModeGetProperty(fd, props->props[i]);
+        if (!prop)
+            continue;
+
+        if (g_ascii_strcasecmp(prop->name, "rotation") == 0 && (prop->flags & DRM_MODE_PROP_BITMASK)) {
+            prop_id = prop->prop_id;
+            for (int j = 0; j < prop->count_enums; j++)
+                *supported |= UINT64_C(1) << prop->enums[j].value;
+        }
+        drmModeFreeProperty(prop);
+    }
+    drmModeFreeObjectProperties(props);
+
+    g_debug("%s: Plane #%" PRIu32 " rotation property #%" PRIu32 ", supported flags %#" PRIx64, __func__, plane_id,
+            prop_id, *supported);
+    return prop_id;
+}
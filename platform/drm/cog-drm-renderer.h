@@ -15,6 +15,7 @@ struct gbm_device;
 struct wpe_view_backend_exportable_fdo;
 typedef struct _drmModeModeInfo drmModeModeInfo;
 typedef struct _CogDrmRenderer  CogDrmRenderer;
+typedef struct _CogDrmVideoPlane CogDrmVideoPlane;
 
 struct _CogDrmRenderer {
     const char *name;
@@ -25,6 +26,19 @@ struct _CogDrmRenderer {
     bool (*set_rotation)(CogDrmRenderer *, CogGLRendererRotation, bool apply);
 
     struct wpe_view_backend_exportable_fdo *(*create_exportable)(CogDrmRenderer *, uint32_t width, uint32_t height);
+
+    bool (*set_scanout_size)(CogDrmRenderer *, uint32_t width, uint32_t height);
+
+    bool (*set_variable_refresh)(CogDrmRenderer *, bool enabled);
+
+    bool (*set_async_page_flip)(CogDrmRenderer *, bool enabled);
+
+    bool (*set_shm_buffer_count)(CogDrmRenderer *, unsigned count);
+
+    bool (*set_mode)(CogDrmRenderer *, const drmModeModeInfo *mode);
+
+    bool (*set_video_plane)(CogDrmRenderer *, CogDrmVideoPlane *video_plane);
+    void (*update_video_plane)(CogDrmRenderer *);
 };
 
 void cog_drm_renderer_destroy(CogDrmRenderer *self);
@@ -52,6 +66,149 @@ cog_drm_renderer_set_rotation(CogDrmRenderer *self, CogGLRendererRotation rotati
     return self->set_rotation && self->set_rotation(self, rotation, apply);
 }
 
+/*
+ * Makes the renderer present buffers of the given size, which the display
+ * controller scales to the size of the mode. Must be called before the
+ * renderer is initialized and the exportable created.
+ */
+static inline bool
+cog_drm_renderer_set_scanout_size(CogDrmRenderer *self, uint32_t width, uint32_t height)
+{
+    return self->set_scanout_size && self->set_scanout_size(self, width, height);
+}
+
+/*
+ * Enables variable refresh rate on the CRTC when setting the mode, which
+ * lets the display refresh whenever a new frame is committed instead of at
+ * a fixed rate. Must be called before the renderer is initialized.
+ */
+static inline bool
+cog_drm_renderer_set_variable_refresh(CogDrmRenderer *self, bool enabled)
+{
+    return self->set_variable_refresh && self->set_variable_refresh(self, enabled);
+}
+
+/*
+ * Makes the renderer present frames as soon as they are committed, instead
+ * of at the next vertical blank, at the cost of tearing. Returns false when
+ * the driver does not support asynchronous page flips. Must be called
+ * before the renderer is initialized.
+ */
+static inline bool
+cog_drm_renderer_set_async_page_flip(CogDrmRenderer *self, bool enabled)
+{
+    return self->set_async_page_flip && self->set_async_page_flip(self, enabled);
+}
+
+/*
+ * Sets how many scanout buffers frames rendered in shared memory get copied
+ * into. Returns false if the renderer does not copy such frames, or cannot
+ * use that many buffers.
+ */
+static inline bool
+cog_drm_renderer_set_shm_buffer_count(CogDrmRenderer *self, unsigned count)
+{
+    return self->set_shm_buffer_count && self->set_shm_buffer_count(self, count);
+}
+
+/*
+ * Changes the mode of the CRTC after the renderer has been initialized, e.g.
+ * when the connector has been plugged again. The frame on screen, if any, is
+ * shown again with the new mode right away, and WebKit gets told to continue
+ * producing frames. Buffers keep their size, a mode of a different size is
+ * only supported if the display controller can scale them.
+ */
+static inline bool
+cog_drm_renderer_set_mode(CogDrmRenderer *self, const drmModeModeInfo *mode)
+{
+    return self->set_mode && self->set_mode(self, mode);
+}
+
+/*
+ * Makes the renderer include the state of an overlay plane showing video
+ * frames in its atomic commits. The plane is owned by the caller and must
+ * outlive the renderer. Returns false if the renderer cannot drive it.
+ */
+static inline bool
+cog_drm_renderer_set_video_plane(CogDrmRenderer *self, CogDrmVideoPlane *video_plane)
+{
+    return self->set_video_plane && self->set_video_plane(self, video_plane);
+}
+
+/*
+ * Tells the renderer that the video plane has a new state, which gets
+ * committed with the next frame or on its own if no frame is on the way.
+ */
+static inline void
+cog_drm_renderer_update_video_plane(CogDrmRenderer *self)
+{
+    if (self->update_video_plane)
+        self->update_video_plane(self);
+}
+
+/*
+ * Both DRM_MODE_ROTATE_* flags of the plane "rotation" property and
+ * CogGLRendererRotation count counter-clockwise turns, and the flags
+ * start at DRM_MODE_ROTATE_0 as the lowest bit.
+ */
+static inline uint64_t
+cog_drm_renderer_rotation_to_plane(CogGLRendererRotation rotation)
+{
+    return UINT64_C(1) << rotation;
+}
+
+/*
+ * Counters about how frames get presented, shared by the renderers. Frames
+ * replaced within the same refresh as the previous one are a lower bound of
+ * the tearing caused by asynchronous page flips.
+ */
+typedef struct {
+    int64_t  commit_time;
+    unsigned sequence;
+    bool     async;
+
+    uint64_t frames;
+    uint64_t frames_async;
+    uint64_t async_rejected;
+    uint64_t frames_replaced;
+    uint64_t latency_us;
+    uint64_t latency_max_us;
+
+    /* Thread CPU time spent preparing and submitting commits. */
+    int64_t  commit_begin_ns;
+    uint64_t commit_cpu_ns;
+    uint64_t commit_cpu_max_ns;
+} CogDrmPresentStats;
+
+void cog_drm_present_stats_begin(CogDrmPresentStats *stats);
+void cog_drm_present_stats_commit(CogDrmPresentStats *stats, bool async);
+void cog_drm_present_stats_page_flip(CogDrmPresentStats *stats, unsigned sequence);
+void cog_drm_present_stats_log(const CogDrmPresentStats *stats, const char *renderer_name);
+
+/*
+ * Identifiers of the KMS properties set by atomic commits, looked up once
+ * instead of by name for each frame.
+ */
+typedef struct {
+    uint32_t fb_id, crtc_id;
+    uint32_t src_x, src_y, src_w, src_h;
+    uint32_t crtc_x, crtc_y, crtc_w, crtc_h;
+} CogDrmPlanePropertyIds;
+
+typedef struct {
+    uint32_t connector_crtc_id;
+    uint32_t crtc_mode_id;
+    uint32_t crtc_active;
+} CogDrmModesetPropertyIds;
+
+bool cog_drm_plane_get_property_ids(int fd, uint32_t plane_id, CogDrmPlanePropertyIds *ids);
+bool cog_drm_get_modeset_property_ids(int fd, uint32_t connector_id, uint32_t crtc_id, CogDrmModesetPropertyIds *ids);
+
+bool     cog_drm_device_supports_async_page_flip(int fd, bool atomic);
+uint32_t cog_drm_object_get_property_id(int fd, uint32_t obj_id, uint32_t obj_type, const char *name);
+bool     cog_drm_object_get_property_value(int fd, uint32_t obj_id, uint32_t obj_type, const char *name, uint64_t *value);
+uint32_t cog_drm_plane_get_rotation_property(int fd, uint32_t plane_id, uint64_t *supported);
+
 static inline struct wpe_view_backend_exportable_fdo *
 cog_drm_renderer_create_exportable(CogDrmRenderer *self, uint32_t width, uint32_t height)
 {
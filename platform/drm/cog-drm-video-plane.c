@@ -0,0 +1,376 @@
+/*
+ * cog-drm-video-plane.c
+ * Copyright (C) 2024 Igalia S.L.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "cog-drm-video-plane.h"
+
+#include "cog-drm-renderer.h"
+#include <errno.h>
+#include <unistd.h>
+#include <wpe/extensions/video-plane-display-dmabuf.h>
+#include <xf86drm.h>
+
+/*
+ * Video frames decoded by the media player, which WebKit does not paint:
+ * the web content gets a hole where the video is, and frames are shown on
+ * an overlay plane above it instead. A single stream at a time gets the
+ * plane, frames of other streams are released right away.
+ *
+ * Frames go through three stages: the latest one received is pending until
+ * the renderer adds it to an atomic commit, then committed until the page
+ * flip, and then shown until the next frame replaces it. Pending frames
+ * replaced by a newer one before being committed are dropped.
+ */
+
+typedef struct {
+    struct wpe_video_plane_display_dmabuf_export *dmabuf_export;
+    int                                           fd;
+    uint32_t                                      fb_id;
+    int32_t                                       x, y;
+    uint32_t                                      width, height;
+} CogDrmVideoFrame;
+
+struct _CogDrmVideoPlane {
+    int      drm_fd;
+    uint32_t plane_id;
+    uint32_t crtc_id;
+
+    CogDrmPlanePropertyIds prop_id;
+
+    bool     streaming;
+    uint32_t stream_id;
+    bool     hidden;
+    bool     update; /* Plane state changed since the last commit. */
+    bool     release_shown;
+
+    CogDrmVideoFrame *pending;
+    CogDrmVideoFrame *committed;
+    CogDrmVideoFrame *shown;
+
+    struct {
+        uint64_t frames;
+        uint64_t frames_dropped;
+        uint64_t import_failed;
+        uint64_t rejected;
+    } stats;
+};
+
+static CogDrmVideoFrame *
+cog_drm_video_frame_new(CogDrmVideoPlane                             *self,
+                        struct wpe_video_plane_display_dmabuf_export *dmabuf_export,
+                        int                                           fd,
+                        int32_t                                       x,
+                        int32_t                                       y,
+                        uint32_t                                      width,
+                        uint32_t                                      height,
+                        uint32_t                                      stride)
+{
+    uint32_t handle = 0;
+    if (drmPrimeFDToHandle(self->drm_fd, fd, &handle)) {
+        g_warning("%s: Cannot import video frame (%s)", __func__, g_strerror(errno));
+        return NULL;
+    }
+
+    uint32_t       fb_id = 0;
+    const uint32_t handles[4] = {handle, 0, 0, 0};
+    const uint32_t pitches[4] = {stride, 0, 0, 0};
+    const uint32_t offsets[4] = {0, 0, 0, 0};
+    const int      ret =
+        drmModeAddFB2(self->drm_fd, width, height, COG_DRM_VIDEO_PLANE_FORMAT, handles, pitches, offsets, &fb_id, 0);
+
+    /* The frame buffer keeps its own reference to the buffer. */
+    struct drm_gem_close gem_close = {.handle = handle};
+    drmIoctl(self->drm_fd, DRM_IOCTL_GEM_CLOSE, &gem_close);
+
+    if (ret) {
+        g_warning("%s: Cannot create frame buffer for %" PRIu32 "x%" PRIu32 " video frame (%s)", __func__, width,
+                  height, g_strerror(errno));
+        return NULL;
+    }
+
+    CogDrmVideoFrame *frame = g_slice_new(CogDrmVideoFrame);
+    *frame = (CogDrmVideoFrame){
+        .dmabuf_export = dmabuf_export,
+        .fd = fd,
+        .fb_id = fb_id,
+        .x = x,
+        .y = y,
+        .width = width,
+        .height = height,
+    };
+    return frame;
+}
+
+static void
+cog_drm_video_frame_release(CogDrmVideoPlane *self, CogDrmVideoFrame *frame)
+{
+    if (!frame)
+        return;
+
+    drmModeRmFB(self->drm_fd, frame->fb_id);
+    close(frame->fd);
+    wpe_video_plane_display_dmabuf_export_release(frame->dmabuf_export);
+    g_slice_free(CogDrmVideoFrame, frame);
+}
+
+/*
+ * Returns the frame to show after the next commit, or NULL if the plane is
+ * to be disabled.
+ */
+static CogDrmVideoFrame *
+cog_drm_video_plane_get_target(const CogDrmVideoPlane *self)
+{
+    if (self->hidden || !self->streaming)
+        return NULL;
+    return self->pending ? self->pending : self->shown;
+}
+
+CogDrmVideoPlane *
+cog_drm_video_plane_new(int drm_fd, uint32_t plane_id, uint32_t crtc_id)
+{
+    CogDrmVideoPlane *self = g_slice_new0(CogDrmVideoPlane);
+    self->drm_fd = drm_fd;
+    self->plane_id = plane_id;
+    self->crtc_id = crtc_id;
+
+    if (!cog_drm_plane_get_property_ids(drm_fd, plane_id, &self->prop_id)) {
+        g_debug("%s: Plane #%" PRIu32 " lacks properties needed for atomic commits.", __func__, plane_id);
+        g_slice_free(CogDrmVideoPlane, self);
+        return NULL;
+    }
+
+    return self;
+}
+
+void
+cog_drm_video_plane_free(CogDrmVideoPlane *self)
+{
+    if (!self)
+        return;
+
+    cog_drm_video_frame_release(self, self->pending);
+    cog_drm_video_frame_release(self, self->committed);
+    cog_drm_video_frame_release(self, self->shown);
+
+    if (self->stats.frames) {
+        g_debug("%s: %" PRIu64 " video frames received, %" PRIu64 " dropped before being shown, %" PRIu64
+                " could not be imported, %" PRIu64 " rejected by the plane",
+                __func__, self->stats.frames, self->stats.frames_dropped, self->stats.import_failed,
+                self->stats.rejected);
+    }
+
+    g_slice_free(CogDrmVideoPlane, self);
+}
+
+uint32_t
+cog_drm_video_plane_get_id(const CogDrmVideoPlane *self)
+{
+    g_assert(self);
+    return self->plane_id;
+}
+
+/*
+ * Takes ownership of a frame received from WebKit, which replaces the
+ * pending one, if any. Returns whether the plane needs to be updated.
+ */
+bool
+cog_drm_video_plane_push_frame(CogDrmVideoPlane                             *self,
+                               struct wpe_video_plane_display_dmabuf_export *dmabuf_export,
+                               uint32_t                                      stream_id,
+                               int                                           fd,
+                               int32_t                                       x,
+                               int32_t                                       y,
+                               int32_t                                       width,
+                               int32_t                                       height,
+                               uint32_t                                      stride)
+{
+    g_assert(self);
+
+    self->stats.frames++;
+
+    CogDrmVideoFrame *frame = NULL;
+    if (self->streaming && self->stream_id != stream_id) {
+        static bool message_emitted = false;
+        if (!message_emitted) {
+            g_warning("Only one video at a time can be shown, frames of other videos are discarded.");
+            message_emitted = true;
+        }
+    } else if (width > 0 && height > 0) {
+        frame = cog_drm_video_frame_new(self, dmabuf_export, fd, x, y, width, height, stride);
+        if (!frame)
+            self->stats.import_failed++;
+    }
+
+    if (!frame) {
+        close(fd);
+        wpe_video_plane_display_dmabuf_export_release(dmabuf_export);
+        self->stats.frames_dropped++;
+        return false;
+    }
+
+    if (self->pending) {
+        cog_drm_video_frame_release(self, self->pending);
+        self->stats.frames_dropped++;
+    }
+
+    self->pending = frame;
+    self->streaming = true;
+    self->stream_id = stream_id;
+    self->update = true;
+    return true;
+}
+
+void
+cog_drm_video_plane_end_of_stream(CogDrmVideoPlane *self, uint32_t stream_id)
+{
+    g_assert(self);
+
+    if (self->streaming && self->stream_id == stream_id) {
+        self->streaming = false;
+        self->update = true;
+    }
+}
+
+/*
+ * Disables the plane while hidden, for example when the output is rotated,
+ * which the plane does not do for video frames.
+ */
+void
+cog_drm_video_plane_set_hidden(CogDrmVideoPlane *self, bool hidden)
+{
+    g_assert(self);
+
+    if (self->hidden != hidden) {
+        self->hidden = hidden;
+        self->update = true;
+    }
+}
+
+bool
+cog_drm_video_plane_has_update(const CogDrmVideoPlane *self)
+{
+    g_assert(self);
+    return self->update;
+}
+
+/*
+ * Adds the state of the plane to an atomic commit. Frame positions are in
+ * the coordinates of the frame buffers presented by the renderer, of the
+ * given size, which get scaled to the size of the mode.
+ */
+bool
+cog_drm_video_plane_add_properties(CogDrmVideoPlane      *self,
+                                   drmModeAtomicReq      *req,
+                                   const drmModeModeInfo *mode,
+                                   uint32_t               width,
+                                   uint32_t               height)
+{
+    g_assert(self);
+    g_assert(!self->committed);
+
+    const CogDrmVideoFrame *frame = cog_drm_video_plane_get_target(self);
+
+    /* Display controllers may not accept planes partially outside of the CRTC. */
+    int64_t x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+    if (frame) {
+        x0 = MAX(frame->x, 0);
+        y0 = MAX(frame->y, 0);
+        x1 = MIN((int64_t) frame->x + frame->width, (int64_t) width);
+        y1 = MIN((int64_t) frame->y + frame->height, (int64_t) height);
+    }
+
+    int32_t ret = 0;
+    if (x1 <= x0 || y1 <= y0) {
+        ret |= drmModeAtomicAddProperty(req, self->plane_id, self->prop_id.fb_id, 0) < 0;
+        ret |= drmModeAtomicAddProperty(req, self->plane_id, self->prop_id.crtc_id, 0) < 0;
+        return ret == 0;
+    }
+
+    const int64_t crtc_x = x0 * mode->hdisplay / width;
+    const int64_t crtc_y = y0 * mode->vdisplay / height;
+    const int64_t crtc_w = x1 * mode->hdisplay / width - crtc_x;
+    const int64_t crtc_h = y1 * mode->vdisplay / height - crtc_y;
+
+    /* The source rectangle is in 16.16 fixed point. */
+    ret |= drmModeAtomicAddProperty(req, self->plane_id, self->prop_id.fb_id, frame->fb_id) < 0;
+    ret |= drmModeAtomicAddProperty(req, self->plane_id, self->prop_id.crtc_id, self->crtc_id) < 0;
+    ret |= drmModeAtomicAddProperty(req, self->plane_id, self->prop_id.src_x, (x0 - frame->x) << 16) < 0;
+    ret |= drmModeAtomicAddProperty(req, self->plane_id, self->prop_id.src_y, (y0 - frame->y) << 16) < 0;
+    ret |= drmModeAtomicAddProperty(req, self->plane_id, self->prop_id.src_w, (x1 - x0) << 16) < 0;
+    ret |= drmModeAtomicAddProperty(req, self->plane_id, self->prop_id.src_h, (y1 - y0) << 16) < 0;
+    ret |= drmModeAtomicAddProperty(req, self->plane_id, self->prop_id.crtc_x, crtc_x) < 0;
+    ret |= drmModeAtomicAddProperty(req, self->plane_id, self->prop_id.crtc_y, crtc_y) < 0;
+    ret |= drmModeAtomicAddProperty(req, self->plane_id, self->prop_id.crtc_w, crtc_w) < 0;
+    ret |= drmModeAtomicAddProperty(req, self->plane_id, self->prop_id.crtc_h, crtc_h) < 0;
+    return ret == 0;
+}
+
+/*
+ * To be called after a commit which included the plane state succeeded.
+ */
+void
+cog_drm_video_plane_committed(CogDrmVideoPlane *self)
+{
+    g_assert(self);
+
+    CogDrmVideoFrame *frame = cog_drm_video_plane_get_target(self);
+    if (!frame) {
+        /* Frames received while hidden are never shown. */
+        if (self->pending) {
+            cog_drm_video_frame_release(self, self->pending);
+            self->pending = NULL;
+            self->stats.frames_dropped++;
+        }
+        self->release_shown = true;
+    } else if (frame == self->pending) {
+        self->committed = frame;
+        self->pending = NULL;
+    }
+
+    self->update = false;
+}
+
+/*
+ * To be called after a commit which included the plane state failed. The
+ * pending frame is dropped, so that the next commit does not fail again.
+ */
+void
+cog_drm_video_plane_rejected(CogDrmVideoPlane *self)
+{
+    g_assert(self);
+
+    if (self->pending) {
+        cog_drm_video_frame_release(self, self->pending);
+        self->pending = NULL;
+        self->stats.rejected++;
+    }
+
+    static bool message_emitted = false;
+    if (!message_emitted) {
+        g_warning("Video plane #%" PRIu32 " does not accept video frames, some will not be shown.", self->plane_id);
+        message_emitted = true;
+    }
+
+    self->update = false;
+}
+
+/*
+ * To be called on the page flip of a commit which included the plane state.
+ * The frame previously shown is released once it is not scanned out anymore.
+ */
+void
+cog_drm_video_plane_page_flip(CogDrmVideoPlane *self)
+{
+    g_assert(self);
+
+    if (!self->committed && !self->release_shown)
+        return;
+
+    cog_drm_video_frame_release(self, self->shown);
+    self->shown = self->committed;
+    self->committed = NULL;
+    self->release_shown = false;
+}
@@ -0,0 +1,53 @@
+/*
+ * cog-drm-video-plane.h
+ * Copyright (C) 2024 Igalia S.L.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <drm_fourcc.h>
+#include <glib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <xf86drmMode.h>
+
+G_BEGIN_DECLS
+
+/* WebKit passes only a stride, frames are packed YUV as in the Wayland platform. */
+#define COG_DRM_VIDEO_PLANE_FORMAT DRM_FORMAT_YUYV
+
+struct wpe_video_plane_display_dmabuf_export;
+typedef struct _CogDrmVideoPlane CogDrmVideoPlane;
+
+CogDrmVideoPlane *cog_drm_video_plane_new(int drm_fd, uint32_t plane_id, uint32_t crtc_id);
+void              cog_drm_video_plane_free(CogDrmVideoPlane *self);
+
+uint32_t cog_drm_video_plane_get_id(const CogDrmVideoPlane *self);
+
+bool cog_drm_video_plane_push_frame(CogDrmVideoPlane                             *self,
+                                    struct wpe_video_plane_display_dmabuf_export *dmabuf_export,
+                                    uint32_t                                      stream_id,
+                                    int                                           fd,
+                                    int32_t                                       x,
+                                    int32_t                                       y,
+                                    int32_t                                       width,
+                                    int32_t                                       height,
+                                    uint32_t                                      stride);
+void cog_drm_video_plane_end_of_stream(CogDrmVideoPlane *self, uint32_t stream_id);
+void cog_drm_video_plane_set_hidden(CogDrmVideoPlane *self, bool hidden);
+
+bool cog_drm_video_plane_has_update(const CogDrmVideoPlane *self);
+bool cog_drm_video_plane_add_properties(CogDrmVideoPlane      *self,
+                                        drmModeAtomicReq      *req,
+                                        const drmModeModeInfo *mode,
+                                        uint32_t               width,
+                                        uint32_t               height);
+void cog_drm_video_plane_committed(CogDrmVideoPlane *self);
+void cog_drm_video_plane_rejected(CogDrmVideoPlane *self);
+void cog_drm_video_plane_page_flip(CogDrmVideoPlane *self);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(CogDrmVideoPlane, cog_drm_video_plane_free)
+
+G_END_DECLS
@@ -8,19 +8,27 @@
 
 #include "../../core/cog.h"
 
+#include "cog-drm-input-queue.h"
 #include "cog-drm-renderer.h"
+#include "cog-drm-video-plane.h"
 #include "cursor-drm.h"
 #include "../common/cog-cursors.h"
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <gbm.h>
+#include <glib-unix.h>
 #include <libinput.h>
 #include <linux/input.h>
 #include <libudev.h>
+#include <poll.h>
 #include <string.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
 #include <wayland-server.h>
 #include <wpe/fdo-egl.h>
+#include <wpe/extensions/video-plane-display-dmabuf.h>
 #include <wpe/fdo.h>
 #include <xf86drm.h>
 #include <xf86drmMode.h>
@@ -47,6 +55,9 @@ typedef EGLDisplay (EGLAPIENTRYP PFNEGLGETPLATFORMDISPLAYEXTPROC) (EGLenum platf
 #define KEY_STARTUP_DELAY 500000
 #define KEY_REPEAT_DELAY  100000
 
+#define INPUT_QUEUE_CAPACITY 1024
+#define INPUT_QUEUE_RETRY_US 1000
+
 #ifndef g_debug_once
 #    define g_debug_once(...)                                                                     \
         G_STMT_START                                                                              \
@@ -62,13 +73,37 @@ struct _CogDrmPlatformClass {
     CogPlatformClass parent_class;
 };
 
+/*
+ * Connected outputs other than the primary one, which is described by
+ * drm_data and receives input. Each has its own renderer, which drives its
+ * CRTC and page flips, and a view created by the platform to be shown on it.
+ */
+typedef struct {
+    uint32_t        connector_id;
+    uint32_t        crtc_id;
+    uint32_t        plane_id;
+    drmModeModeInfo mode;
+    bool            connected;
+    unsigned        refresh_rate_idle; /* Source for set_output_target_refresh_rate(). */
+
+    CogDrmRenderer                         *renderer;
+    struct wpe_view_backend_exportable_fdo *exportable;
+    struct wpe_view_backend                *backend;
+    CogViewport                            *viewport;
+    CogView                                *view;
+} CogDrmOutput;
+
 struct _CogDrmPlatform {
     CogPlatform            parent;
     CogView               *web_view;
     CogDrmRenderer        *renderer;
     CogGLRendererRotation  rotation;
-    GList                 *rotatable_input_devices;
     bool                   use_gles;
+    bool                   all_outputs;
+    GPtrArray             *outputs; /* CogDrmOutput */
+    CogDrmOutput          *binding_output;
+    GStrv                  output_uris;
+    CogDrmVideoPlane      *video_plane;
 };
 
 enum {
@@ -118,9 +153,18 @@ static struct {
     uint32_t refresh;
     double   device_scale;
 
+    /* Size of the buffers presented, differs from the mode when the plane scales them. */
+    uint32_t scanout_width;
+    uint32_t scanout_height;
+
     bool atomic_modesetting;
     bool addfb2_modifiers;
     bool mode_set;
+    bool variable_refresh;
+    bool async_page_flip;
+    bool connected;
+
+    unsigned shm_buffer_count; /* Zero for the renderer default. */
 } drm_data = {
     .fd = -1,
     .base_resources = NULL,
@@ -149,6 +193,8 @@ static struct {
     .device_scale = 1.0,
     .atomic_modesetting = true,
     .mode_set = false,
+    .variable_refresh = true,
+    .async_page_flip = false,
 };
 
 static struct {
@@ -195,9 +241,33 @@ static struct {
     struct wpe_input_touch_event_raw touch_points[10];
     enum wpe_input_touch_event_type last_touch_type;
     int last_touch_id;
+
+    /* Owned by the input thread once started. */
+    GThread              *thread;
+    int                   wake_fd;
+    int                   quit;     /* (atomic) */
+    int                   rotation; /* (atomic) Requested by the main thread. */
+    CogGLRendererRotation configured_rotation;
+    GList                *rotatable_devices;
+    uint64_t              queue_stalls;
+
+    /* Events pending to be dispatched on the main thread. */
+    CogDrmInputQueue *queue;
+    CogDrmInputEvent  pending_motion;
+    bool              touch_frame_pending;
+    bool              touch_frame_motion_only;
+    uint32_t          touch_frame_time;
+
+    struct {
+        uint64_t events;
+        uint64_t coalesced;
+        uint64_t dropped;
+    } stats;
 } input_data = {
     .udev = NULL,
     .libinput = NULL,
+    .wake_fd = -1,
+    .touch_frame_motion_only = true,
     .input_width = 0,
     .input_height = 0,
     .key_repeat_event = { 0 },
@@ -216,6 +286,16 @@ static struct {
     .key_repeat_source = NULL,
 };
 
+static struct {
+    struct udev         *udev;
+    struct udev_monitor *monitor;
+    dev_t                devnum;
+    unsigned             source_id;
+} hotplug_data = {
+    .monitor = NULL,
+    .source_id = 0,
+};
+
 static struct {
     struct wpe_view_backend_exportable_fdo *exportable;
 } wpe_host_data;
@@ -245,6 +325,40 @@ init_config(CogDrmPlatform *self, CogShell *shell, const char *params_string)
             }
         }
 
+        {
+            g_autoptr(GError) lookup_error = NULL;
+
+            gboolean value = g_key_file_get_boolean(key_file, "drm", "disable-variable-refresh", &lookup_error);
+            if (!lookup_error) {
+                drm_data.variable_refresh = !value;
+                g_debug("init_config: variable refresh rate reconfigured to value '%s'",
+                        drm_data.variable_refresh ? "true" : "false");
+            }
+        }
+
+        {
+            g_autoptr(GError) lookup_error = NULL;
+
+            gboolean value = g_key_file_get_boolean(key_file, "drm", "async-page-flip", &lookup_error);
+            if (!lookup_error) {
+                drm_data.async_page_flip = value;
+                g_debug("init_config: asynchronous page flips reconfigured to value '%s'",
+                        drm_data.async_page_flip ? "true" : "false");
+            }
+        }
+
+        {
+            g_autoptr(GError) lookup_error = NULL;
+
+            gint value = g_key_file_get_integer(key_file, "drm", "shm-buffers", &lookup_error);
+            if (!lookup_error && value > 0) {
+                drm_data.shm_buffer_count = value;
+                g_debug("init_config: SHM buffer count reconfigured to value '%u'", drm_data.shm_buffer_count);
+            } else if (!lookup_error) {
+                g_warning("Invalid value '%d' for option 'shm-buffers', ignored.", value);
+            }
+        }
+
         {
             g_autoptr(GError) lookup_error = NULL;
 
@@ -264,6 +378,8 @@ init_config(CogDrmPlatform *self, CogShell *shell, const char *params_string)
             else if (value)
                 g_warning("Invalid renderer '%s', using default.", value);
         }
+
+        self->output_uris = g_key_file_get_string_list(key_file, "drm", "output-uris", NULL, NULL);
     }
 
     if (params_string) {
@@ -293,6 +409,13 @@ init_config(CogDrmPlatform *self, CogShell *shell, const char *params_string)
                     g_warning("Invalid value '%s' for parameter '%s'.", v, k);
                 else
                     self->rotation = val;
+            } else if (g_strcmp0(k, "outputs") == 0) {
+                if (g_strcmp0(v, "primary") == 0)
+                    self->all_outputs = false;
+                else if (g_strcmp0(v, "all") == 0)
+                    self->all_outputs = true;
+                else
+                    g_warning("Invalid value '%s' for parameter '%s'.", v, k);
             } else {
                 g_warning("Invalid parameter '%s'.", k);
             }
@@ -356,6 +479,60 @@ find_crtc_for_encoder(const drmModeRes *resources, const drmModeEncoder *encoder
     return -1;
 }
 
+/*
+ * Picks the mode of the primary output, honoring the choice of the user, if
+ * any. Otherwise the preferred mode is used, or the one with most pixels.
+ */
+static drmModeModeInfo *
+select_mode(drmModeConnector *connector)
+{
+    const char *user_selected_mode = g_getenv("COG_PLATFORM_DRM_VIDEO_MODE");
+
+    int user_max_width = 0;
+    int user_max_height = 0;
+    int user_max_refresh = 0;
+
+    const char *user_mode_max = g_getenv("COG_PLATFORM_DRM_MODE_MAX");
+    if (user_mode_max) {
+        if (sscanf(user_mode_max, "%dx%d@%d", &user_max_width, &user_max_height, &user_max_refresh) < 2 ||
+            user_max_width < 0 || user_max_height < 0 || user_max_refresh < 0) {
+            fprintf(stderr, "invalid value for COG_PLATFORM_DRM_MODE_MAX\n");
+            user_max_width = 0;
+            user_max_height = 0;
+            user_max_refresh = 0;
+        }
+    }
+
+    drmModeModeInfo *mode = NULL;
+    for (int i = 0, area = 0; i < connector->count_modes; ++i) {
+        drmModeModeInfo *current_mode = &connector->modes[i];
+        if (user_selected_mode && strcmp(user_selected_mode, current_mode->name) != 0) {
+            continue;
+        }
+
+        if (user_max_width && current_mode->hdisplay > user_max_width) {
+            continue;
+        }
+        if (user_max_height && current_mode->vdisplay > user_max_height) {
+            continue;
+        }
+        if (user_max_refresh && current_mode->vrefresh > user_max_refresh) {
+            continue;
+        }
+
+        if (current_mode->type & DRM_MODE_TYPE_PREFERRED)
+            return current_mode;
+
+        int current_area = current_mode->hdisplay * current_mode->vdisplay;
+        if (current_area > area) {
+            mode = current_mode;
+            area = current_area;
+        }
+    }
+
+    return mode;
+}
+
 static gboolean
 init_drm(void)
 {
@@ -447,50 +624,7 @@ init_drm(void)
     g_debug("init_drm: using connector id %d, type %d", drm_data.connector.obj->connector_id,
             drm_data.connector.obj->connector_type);
 
-    const char *user_selected_mode = g_getenv("COG_PLATFORM_DRM_VIDEO_MODE");
-
-    int user_max_width = 0;
-    int user_max_height = 0;
-    int user_max_refresh = 0;
-
-    const char *user_mode_max = g_getenv("COG_PLATFORM_DRM_MODE_MAX");
-    if (user_mode_max) {
-        if (sscanf(user_mode_max, "%dx%d@%d", &user_max_width, &user_max_height, &user_max_refresh) < 2 ||
-            user_max_width < 0 || user_max_height < 0 || user_max_refresh < 0) {
-            fprintf(stderr, "invalid value for COG_PLATFORM_DRM_MODE_MAX\n");
-            user_max_width = 0;
-            user_max_height = 0;
-            user_max_refresh = 0;
-        }
-    }
-
-    for (int i = 0, area = 0; i < drm_data.connector.obj->count_modes; ++i) {
-        drmModeModeInfo *current_mode = &drm_data.connector.obj->modes[i];
-        if (user_selected_mode && strcmp(user_selected_mode, current_mode->name) != 0) {
-            continue;
-        }
-
-        if (user_max_width && current_mode->hdisplay > user_max_width) {
-            continue;
-        }
-        if (user_max_height && current_mode->vdisplay > user_max_height) {
-            continue;
-        }
-        if (user_max_refresh && current_mode->vrefresh > user_max_refresh) {
-            continue;
-        }
-
-        if (current_mode->type & DRM_MODE_TYPE_PREFERRED) {
-            drm_data.mode = current_mode;
-            break;
-        }
-
-        int current_area = current_mode->hdisplay * current_mode->vdisplay;
-        if (current_area > area) {
-            drm_data.mode = current_mode;
-            area = current_area;
-        }
-    }
+    drm_data.mode = select_mode(drm_data.connector.obj);
     if (!drm_data.mode)
         return FALSE;
 
@@ -573,18 +707,9 @@ init_drm(void)
     drm_data.width = drm_data.mode->hdisplay;
     drm_data.height = drm_data.mode->vdisplay;
     drm_data.refresh = drm_data.mode->vrefresh;
-
-    /* initial hack to specify virtual screen size */
-    int vx = 0, vy = 0;
-    const char *virtual = g_getenv("COG_PLATFORM_DRM_VIRTUAL");
-    if (virtual && (sscanf(virtual, "%dx%d", &vx, &vy) == 2) && (vx > 0) && (vy > 0)) {
-      double smin = MIN(drm_data.width/(double)vx, drm_data.height/(double)vy);
-      double smax = MAX(drm_data.width/(double)vx, drm_data.height/(double)vy);
-      drm_data.device_scale = (smax < 1.0) ? smax : smin;
-      drm_data.width /= drm_data.device_scale;
-      drm_data.height /= drm_data.device_scale;
-      g_print("cog: wid=%d hgt=%d scale=%f\n", drm_data.width, drm_data.height, drm_data.device_scale);
-    }
+    drm_data.scanout_width = drm_data.width;
+    drm_data.scanout_height = drm_data.height;
+    drm_data.connected = true;
 
     g_clear_pointer(&drm_data.base_resources, drmModeFreeResources);
     g_clear_pointer(&drm_data.plane_resources, drmModeFreePlaneResources);
@@ -688,7 +813,7 @@ input_dispatch_repeat_event(GSource *base, GSourceFunc callback, gpointer user_d
 }
 
 static void
-input_handle_key_event(CogView *view, struct libinput_event_keyboard *key_event)
+input_handle_key_event(CogView *view, const CogDrmInputEvent *input_event)
 {
     struct wpe_input_xkb_context *default_context = wpe_input_xkb_context_get_default ();
     g_print("input_handle_key_event\n");
@@ -713,9 +838,9 @@ input_handle_key_event(CogView *view, struct libinput_event_keyboard *key_event)
 
     // Explanation for the offset-by-8, copied from Weston:
     //   evdev XKB rules reflect X's  broken keycode system, which starts at 8
-    uint32_t key = libinput_event_keyboard_get_key (key_event) + 8;
-    enum libinput_key_state state = libinput_event_keyboard_get_key_state (key_event);
-    uint32_t time = libinput_event_keyboard_get_time (key_event);
+    uint32_t key = input_event->key.key + 8;
+    uint32_t state = input_event->key.pressed;
+    uint32_t time = input_event->time_usec / 1000;
     uint32_t keysym = wpe_input_xkb_context_get_key_code (default_context, key, !!state);
     xkb_state_update_key (context_state, key, !!state ? XKB_KEY_DOWN : XKB_KEY_UP);
     uint32_t modifiers = wpe_input_xkb_context_get_modifiers (default_context,
@@ -739,12 +864,45 @@ input_handle_key_event(CogView *view, struct libinput_event_keyboard *key_event)
 }
 
 static void
-input_handle_touch_event (enum libinput_event_type touch_type, struct libinput_event_touch *touch_event)
+input_dispatch_touch_frame(uint32_t time)
+{
+    struct wpe_input_touch_event event = {
+        .touchpoints = input_data.touch_points,
+        .touchpoints_length = G_N_ELEMENTS(input_data.touch_points),
+        .type = input_data.last_touch_type,
+        .id = input_data.last_touch_id,
+        .time = time,
+    };
+
+    wpe_view_backend_dispatch_touch_event(wpe_view_data.backend, &event);
+
+    for (int i = 0; i < G_N_ELEMENTS(input_data.touch_points); ++i) {
+        struct wpe_input_touch_event_raw *touch_point = &input_data.touch_points[i];
+        if (touch_point->type != wpe_input_touch_event_type_up)
+            continue;
+
+        memset(touch_point, 0, sizeof(struct wpe_input_touch_event_raw));
+        touch_point->type = wpe_input_touch_event_type_null;
+    }
+}
+
+static void
+input_flush_touch_frame(void)
+{
+    if (!input_data.touch_frame_pending)
+        return;
+
+    input_data.touch_frame_pending = false;
+    input_dispatch_touch_frame(input_data.touch_frame_time);
+}
+
+static void
+input_handle_touch_event(const CogDrmInputEvent *input_event)
 {
-    uint32_t time = libinput_event_touch_get_time (touch_event);
+    uint32_t time = input_event->time_usec / 1000;
 
     enum wpe_input_touch_event_type event_type = wpe_input_touch_event_type_null;
-    switch (touch_type) {
+    switch (input_event->type) {
         case LIBINPUT_EVENT_TOUCH_DOWN:
             event_type = wpe_input_touch_event_type_down;
             break;
@@ -754,37 +912,37 @@ input_handle_touch_event (enum libinput_event_type touch_type, struct libinput_e
         case LIBINPUT_EVENT_TOUCH_MOTION:
             event_type = wpe_input_touch_event_type_motion;
             break;
-        case LIBINPUT_EVENT_TOUCH_FRAME: {
-            struct wpe_input_touch_event event = {
-                .touchpoints = input_data.touch_points,
-                .touchpoints_length = G_N_ELEMENTS (input_data.touch_points),
-                .type = input_data.last_touch_type,
-                .id = input_data.last_touch_id,
-                .time = time,
-            };
-
-            wpe_view_backend_dispatch_touch_event (wpe_view_data.backend, &event);
-
-            for (int i = 0; i < G_N_ELEMENTS (input_data.touch_points); ++i) {
-                struct wpe_input_touch_event_raw *touch_point = &input_data.touch_points[i];
-                if (touch_point->type != wpe_input_touch_event_type_up)
-                    continue;
-
-                memset (touch_point, 0, sizeof (struct wpe_input_touch_event_raw));
-                touch_point->type = wpe_input_touch_event_type_null;
+        case LIBINPUT_EVENT_TOUCH_FRAME:
+            /*
+             * A frame which only moves touch points is held back, and
+             * replaced by the next one if it also only moves them: the
+             * touch points always have their latest positions.
+             */
+            if (input_data.touch_frame_motion_only) {
+                if (input_data.touch_frame_pending)
+                    input_data.stats.coalesced++;
+                input_data.touch_frame_pending = true;
+                input_data.touch_frame_time = time;
+            } else {
+                input_dispatch_touch_frame(time);
             }
-
+            input_data.touch_frame_motion_only = true;
             return;
-        }
         default:
             g_assert_not_reached ();
             return;
     }
 
-    int id = libinput_event_touch_get_seat_slot (touch_event);
+    int id = input_event->touch.slot;
     if (id < 0 || id >= G_N_ELEMENTS (input_data.touch_points))
         return;
 
+    /* Touch points going down or up are never coalesced. */
+    if (event_type != wpe_input_touch_event_type_motion) {
+        input_flush_touch_frame();
+        input_data.touch_frame_motion_only = false;
+    }
+
     input_data.last_touch_type = event_type;
     input_data.last_touch_id = id;
 
@@ -793,48 +951,37 @@ input_handle_touch_event (enum libinput_event_type touch_type, struct libinput_e
     touch_point->time = time;
     touch_point->id = id;
 
-    if (touch_type == LIBINPUT_EVENT_TOUCH_DOWN
-        || touch_type == LIBINPUT_EVENT_TOUCH_MOTION) {
-        touch_point->x = libinput_event_touch_get_x_transformed (touch_event,
-                                                                 input_data.input_width);
-        touch_point->y = libinput_event_touch_get_y_transformed (touch_event,
-                                                                 input_data.input_height);
+    if (input_event->type == LIBINPUT_EVENT_TOUCH_DOWN || input_event->type == LIBINPUT_EVENT_TOUCH_MOTION) {
+        touch_point->x = input_event->touch.x * input_data.input_width;
+        touch_point->y = input_event->touch.y * input_data.input_height;
     }
 }
 
 static void
-input_handle_pointer_motion_event(CogView *view, struct libinput_event_pointer *pointer_event, bool absolute)
+input_handle_pointer_motion_event(CogView *view, const CogDrmInputEvent *input_event)
 {
     if (!cursor.enabled)
         return;
     if (cursor.hidden)
         return;
 
-    if (absolute) {
-        cursor.x = libinput_event_pointer_get_absolute_x_transformed(pointer_event, cursor.screen_width);
-        cursor.y = libinput_event_pointer_get_absolute_y_transformed(pointer_event, cursor.screen_height);
+    double x, y;
+    if (input_event->type == LIBINPUT_EVENT_POINTER_MOTION_ABSOLUTE) {
+        x = input_event->absolute.x * cursor.screen_width;
+        y = input_event->absolute.y * cursor.screen_height;
     } else {
-        cursor.x += libinput_event_pointer_get_dx(pointer_event);
-        cursor.y += libinput_event_pointer_get_dy(pointer_event);
-    }
-
-    if (cursor.x < 0) {
-        cursor.x = 0;
-    } else if (cursor.x > cursor.screen_width - 1) {
-        cursor.x = cursor.screen_width - 1;
+        x = cursor.x + input_event->motion.dx;
+        y = cursor.y + input_event->motion.dy;
     }
 
-    if (cursor.y < 0) {
-        cursor.y = 0;
-    } else if (cursor.y > cursor.screen_height - 1) {
-        cursor.y = cursor.screen_height - 1;
-    }
+    cursor.x = CLAMP(x, 0.0, cursor.screen_width - 1.0);
+    cursor.y = CLAMP(y, 0.0, cursor.screen_height - 1.0);
 
     move_cursor(drm_data.fd, drm_data.crtc.obj_id, cursor.x, cursor.y);
 
     struct wpe_input_pointer_event event = {
         .type = wpe_input_pointer_event_type_motion,
-        .time = libinput_event_pointer_get_time(pointer_event),
+        .time = input_event->time_usec / 1000,
         .x = cursor.x,
         .y = cursor.y,
         .button = !!input_data.last_modifiers ? 1 : 0,
@@ -846,11 +993,54 @@ input_handle_pointer_motion_event(CogView *view, struct libinput_event_pointer *
 }
 
 static void
-input_handle_pointer_button_event (CogView *view, struct libinput_event_pointer *pointer_event)
+input_flush_pointer_motion(CogView *view)
+{
+    if (input_data.pending_motion.type == LIBINPUT_EVENT_NONE)
+        return;
+
+    input_handle_pointer_motion_event(view, &input_data.pending_motion);
+    input_data.pending_motion.type = LIBINPUT_EVENT_NONE;
+}
+
+/*
+ * Consecutive pointer motion events are merged into a single one, which is
+ * dispatched when a different kind of event arrives or the queue is empty.
+ * Relative motion is accumulated, and only the last absolute position kept.
+ */
+static void
+input_coalesce_pointer_motion(CogView *view, const CogDrmInputEvent *input_event)
+{
+    CogDrmInputEvent *pending = &input_data.pending_motion;
+
+    if (pending->type != input_event->type) {
+        input_flush_pointer_motion(view);
+        *pending = *input_event;
+        return;
+    }
+
+    input_data.stats.coalesced++;
+    pending->time_usec = input_event->time_usec;
+    if (input_event->type == LIBINPUT_EVENT_POINTER_MOTION) {
+        pending->motion.dx += input_event->motion.dx;
+        pending->motion.dy += input_event->motion.dy;
+    } else {
+        pending->absolute = input_event->absolute;
+    }
+}
+
+static void
+input_flush_motion(CogView *view)
 {
-    uint32_t button = libinput_event_pointer_get_button(pointer_event);
-    uint32_t state = libinput_event_pointer_get_button_state(pointer_event);
-    uint32_t time = libinput_event_pointer_get_time(pointer_event);
+    input_flush_pointer_motion(view);
+    input_flush_touch_frame();
+}
+
+static void
+input_handle_pointer_button_event(CogView *view, const CogDrmInputEvent *input_event)
+{
+    uint32_t button = input_event->button.button;
+    uint32_t state = input_event->button.pressed;
+    uint32_t time = input_event->time_usec / 1000;
     if (!cursor.enabled)
         return;
 
@@ -901,92 +1091,108 @@ input_handle_pointer_button_event (CogView *view, struct libinput_event_pointer
     input_data.last_modifiers = modifiers;
 }
 
-#if LIBINPUT_CHECK_VERSION(1, 19, 0)
 static void
-input_handle_pointer_discrete_scroll_event(struct libinput_event_pointer *pointer_event)
+input_handle_pointer_scroll_event(const CogDrmInputEvent *input_event)
 {
+    if (!input_event->scroll.discrete && cursor.hidden)
+        return;
+
     struct wpe_input_axis_2d_event event = {
-        .base.type = wpe_input_axis_event_type_mask_2d | wpe_input_axis_event_type_motion,
-        .base.time = libinput_event_pointer_get_time(pointer_event),
+        .base.type = wpe_input_axis_event_type_mask_2d,
+        .base.time = input_event->time_usec / 1000,
         .base.x = cursor.x,
         .base.y = cursor.y,
         .x_axis = 0.0,
         .y_axis = 0.0,
     };
 
-    if (libinput_event_pointer_has_axis(pointer_event, LIBINPUT_POINTER_AXIS_SCROLL_VERTICAL))
-        event.y_axis = -drm_data.device_scale * libinput_event_pointer_get_scroll_value_v120(
-                                                    pointer_event, LIBINPUT_POINTER_AXIS_SCROLL_VERTICAL);
-    if (libinput_event_pointer_has_axis(pointer_event, LIBINPUT_POINTER_AXIS_SCROLL_HORIZONTAL))
-        event.x_axis = drm_data.device_scale * libinput_event_pointer_get_scroll_value_v120(
-                                                   pointer_event, LIBINPUT_POINTER_AXIS_SCROLL_HORIZONTAL);
+    if (input_event->scroll.discrete) {
+        event.base.type |= wpe_input_axis_event_type_motion;
+        if (input_event->scroll.has_vertical)
+            event.y_axis = -drm_data.device_scale * input_event->scroll.vertical;
+    } else {
+        event.base.type |= wpe_input_axis_event_type_motion_smooth;
+        if (input_event->scroll.has_vertical)
+            event.y_axis = drm_data.device_scale * input_event->scroll.vertical;
+    }
+    if (input_event->scroll.has_horizontal)
+        event.x_axis = drm_data.device_scale * input_event->scroll.horizontal;
 
     wpe_view_backend_dispatch_axis_event(wpe_view_data.backend, &event.base);
 }
 
 static void
-input_handle_pointer_smooth_scroll_event(struct libinput_event_pointer *pointer_event)
+input_handle_event(CogView *view, const CogDrmInputEvent *input_event)
 {
-    if (cursor.hidden)
-        return;
+    switch (input_event->type) {
+    case LIBINPUT_EVENT_POINTER_MOTION:
+    case LIBINPUT_EVENT_POINTER_MOTION_ABSOLUTE:
+        input_coalesce_pointer_motion(view, input_event);
+        break;
 
-    struct wpe_input_axis_2d_event event = {
-        .base.type = wpe_input_axis_event_type_mask_2d | wpe_input_axis_event_type_motion_smooth,
-        .base.time = libinput_event_pointer_get_time(pointer_event),
-        .base.x = cursor.x,
-        .base.y = cursor.y,
-        .x_axis = 0.0,
-        .y_axis = 0.0,
-    };
+    case LIBINPUT_EVENT_TOUCH_DOWN:
+    case LIBINPUT_EVENT_TOUCH_UP:
+    case LIBINPUT_EVENT_TOUCH_MOTION:
+    case LIBINPUT_EVENT_TOUCH_FRAME:
+        input_flush_pointer_motion(view);
+        input_handle_touch_event(input_event);
+        break;
 
-    if (libinput_event_pointer_has_axis(pointer_event, LIBINPUT_POINTER_AXIS_SCROLL_VERTICAL))
-        event.y_axis = drm_data.device_scale *
-                       libinput_event_pointer_get_scroll_value(pointer_event, LIBINPUT_POINTER_AXIS_SCROLL_VERTICAL);
-    if (libinput_event_pointer_has_axis(pointer_event, LIBINPUT_POINTER_AXIS_SCROLL_HORIZONTAL))
-        event.x_axis = drm_data.device_scale *
-                       libinput_event_pointer_get_scroll_value(pointer_event, LIBINPUT_POINTER_AXIS_SCROLL_HORIZONTAL);
+    case LIBINPUT_EVENT_KEYBOARD_KEY:
+        input_flush_motion(view);
+        input_handle_key_event(view, input_event);
+        break;
 
-    wpe_view_backend_dispatch_axis_event(wpe_view_data.backend, &event.base);
-}
+    case LIBINPUT_EVENT_POINTER_BUTTON:
+        input_flush_motion(view);
+        input_handle_pointer_button_event(view, input_event);
+        break;
+
+#if LIBINPUT_CHECK_VERSION(1, 19, 0)
+    case LIBINPUT_EVENT_POINTER_SCROLL_WHEEL:
+    case LIBINPUT_EVENT_POINTER_SCROLL_FINGER:
+    case LIBINPUT_EVENT_POINTER_SCROLL_CONTINUOUS:
 #else
+    case LIBINPUT_EVENT_POINTER_AXIS:
+#endif /* LIBINPUT_CHECK_VERSION(1, 19, 0) */
+        input_flush_motion(view);
+        input_handle_pointer_scroll_event(input_event);
+        break;
+
+    default:
+        break;
+    }
+}
+
+/*
+ * Handles the events pushed by the input thread. Pointer motion and touch
+ * frames which only move touch points are coalesced while draining the
+ * queue, so that at most one of each gets dispatched per main loop
+ * iteration, keeping the timestamps of the latest events merged.
+ */
 static void
-input_handle_pointer_axis_event(struct libinput_event_pointer *pointer_event)
+input_process_queue(CogDrmPlatform *platform)
 {
-    if (cursor.hidden)
-        return;
+    cog_drm_input_queue_clear_notify(input_data.queue);
 
-    struct wpe_input_axis_2d_event event = {
-        .base.type = wpe_input_axis_event_type_mask_2d,
-        .base.time = libinput_event_pointer_get_time(pointer_event),
-        .base.x = cursor.x,
-        .base.y = cursor.y,
-        .x_axis = 0.0,
-        .y_axis = 0.0,
-    };
+    CogDrmInputEvent event;
+    while (cog_drm_input_queue_pop(input_data.queue, &event)) {
+        input_data.stats.events++;
 
-    if (libinput_event_pointer_get_axis_source(pointer_event) == LIBINPUT_POINTER_AXIS_SOURCE_WHEEL) {
-        event.base.type |= wpe_input_axis_event_type_motion;
-        if (libinput_event_pointer_has_axis(pointer_event, LIBINPUT_POINTER_AXIS_SCROLL_VERTICAL))
-            event.y_axis = -120.0 * libinput_event_pointer_get_axis_value_discrete(
-                                        pointer_event, LIBINPUT_POINTER_AXIS_SCROLL_VERTICAL);
-        if (libinput_event_pointer_has_axis(pointer_event, LIBINPUT_POINTER_AXIS_SCROLL_HORIZONTAL))
-            event.x_axis = 120.0 * libinput_event_pointer_get_axis_value_discrete(
-                                       pointer_event, LIBINPUT_POINTER_AXIS_SCROLL_HORIZONTAL);
-    } else {
-        event.base.type |= wpe_input_axis_event_type_motion_smooth;
-        if (libinput_event_pointer_has_axis(pointer_event, LIBINPUT_POINTER_AXIS_SCROLL_VERTICAL))
-            event.y_axis = libinput_event_pointer_get_axis_value(pointer_event, LIBINPUT_POINTER_AXIS_SCROLL_VERTICAL);
-        if (libinput_event_pointer_has_axis(pointer_event, LIBINPUT_POINTER_AXIS_SCROLL_HORIZONTAL))
-            event.x_axis =
-                libinput_event_pointer_get_axis_value(pointer_event, LIBINPUT_POINTER_AXIS_SCROLL_HORIZONTAL);
-    }
+        /* view must be visible and focused to receive input */
+        uint32_t state = wpe_view_backend_get_activity_state(wpe_view_data.backend);
+        state &= wpe_view_activity_state_visible+wpe_view_activity_state_focused;
+        if (state != wpe_view_activity_state_visible+wpe_view_activity_state_focused) {
+            input_data.key_repeat_event.time = 0;
+            input_data.stats.dropped++;
+            continue;
+        }
 
-    event.x_axis *= drm_data.device_scale;
-    event.y_axis *= drm_data.device_scale;
+        input_handle_event(platform->web_view, &event);
+    }
 
-    wpe_view_backend_dispatch_axis_event(wpe_view_data.backend, &event.base);
+    input_flush_motion(platform->web_view);
 }
-#endif /* !LIBINPUT_CHECK_VERSION(1, 19, 0) */
 
 static bool
 input_device_needs_config(struct libinput_device *device)
@@ -1004,9 +1210,9 @@ input_device_needs_config(struct libinput_device *device)
 }
 
 static void
-input_configure_device(struct libinput_device *device, CogDrmPlatform *platform)
+input_configure_device(struct libinput_device *device, CogGLRendererRotation rotation)
 {
-    enum libinput_config_status status = libinput_device_config_rotation_set_angle(device, platform->rotation * 90);
+    enum libinput_config_status status = libinput_device_config_rotation_set_angle(device, rotation * 90);
 
     const char *name = libinput_device_get_name(device);
     const int   id_vendor = libinput_device_get_id_vendor(device);
@@ -1020,12 +1226,24 @@ input_configure_device(struct libinput_device *device, CogDrmPlatform *platform)
         g_debug("%s: Rotation unsupported for %s (%04x:%04x)", __func__, name, id_vendor, id_product);
         break;
     case LIBINPUT_CONFIG_STATUS_INVALID:
-        g_debug("%s: Rotation %u invalid for %s (%04x:%04x)", __func__, platform->rotation * 90, name, id_vendor,
-                id_product);
+        g_debug("%s: Rotation %u invalid for %s (%04x:%04x)", __func__, rotation * 90, name, id_vendor, id_product);
         break;
     }
 }
 
+/* Applies the rotation last requested by the main thread, runs in the input thread. */
+static void
+input_configure_devices(void)
+{
+    const CogGLRendererRotation rotation = g_atomic_int_get(&input_data.rotation);
+    if (rotation == input_data.configured_rotation)
+        return;
+
+    input_data.configured_rotation = rotation;
+    for (GList *item = input_data.rotatable_devices; item; item = item->next)
+        input_configure_device(item->data, rotation);
+}
+
 static void
 input_handle_device_added(struct libinput_device *device)
 {
@@ -1036,10 +1254,8 @@ input_handle_device_added(struct libinput_device *device)
             libinput_device_get_id_product(device));
 
     if (input_device_needs_config(device)) {
-        CogDrmPlatform *platform = libinput_get_user_data(libinput_device_get_context(device));
-        platform->rotatable_input_devices =
-            g_list_append(platform->rotatable_input_devices, libinput_device_ref(device));
-        input_configure_device(device, platform);
+        input_data.rotatable_devices = g_list_append(input_data.rotatable_devices, libinput_device_ref(device));
+        input_configure_device(device, input_data.configured_rotation);
     }
 }
 
@@ -1052,150 +1268,287 @@ input_handle_device_removed(struct libinput_device *device)
             libinput_device_get_id_vendor(device),
             libinput_device_get_id_product(device));
 
-    CogDrmPlatform *platform = libinput_get_user_data(libinput_device_get_context(device));
-
-    GList *item = g_list_find(platform->rotatable_input_devices, device);
+    GList *item = g_list_find(input_data.rotatable_devices, device);
     if (item) {
-        platform->rotatable_input_devices = g_list_remove_link(platform->rotatable_input_devices, item);
+        input_data.rotatable_devices = g_list_remove_link(input_data.rotatable_devices, item);
         g_list_free_full(item, (GDestroyNotify) libinput_device_unref);
     }
 }
 
 static void
-input_process_events (void)
+input_translate_scroll_event(struct libinput_event_pointer *pointer_event, CogDrmInputEvent *input_event)
 {
-    g_assert(input_data.libinput);
-
-    CogDrmPlatform *platform = libinput_get_user_data(input_data.libinput);
+    static const enum libinput_pointer_axis axes[] = {
+        LIBINPUT_POINTER_AXIS_SCROLL_VERTICAL,
+        LIBINPUT_POINTER_AXIS_SCROLL_HORIZONTAL,
+    };
+    bool   *has_axis[] = {&input_event->scroll.has_vertical, &input_event->scroll.has_horizontal};
+    double *value[] = {&input_event->scroll.vertical, &input_event->scroll.horizontal};
 
-    libinput_dispatch(input_data.libinput);
-    while (true) {
-        struct libinput_event *event = libinput_get_event (input_data.libinput);
-        if (!event)
-            break;
+#if LIBINPUT_CHECK_VERSION(1, 19, 0)
+    input_event->scroll.discrete = input_event->type == LIBINPUT_EVENT_POINTER_SCROLL_WHEEL;
+#else
+    input_event->scroll.discrete =
+        libinput_event_pointer_get_axis_source(pointer_event) == LIBINPUT_POINTER_AXIS_SOURCE_WHEEL;
+#endif /* LIBINPUT_CHECK_VERSION(1, 19, 0) */
 
-        /* view must be visible and focused to receive input */
-        uint32_t state = wpe_view_backend_get_activity_state(wpe_view_data.backend);
-        state &= wpe_view_activity_state_visible+wpe_view_activity_state_focused;
-        if (state != wpe_view_activity_state_visible+wpe_view_activity_state_focused) {
-            input_data.key_repeat_event.time = 0;
-            break;
-        }
+    for (unsigned i = 0; i < G_N_ELEMENTS(axes); i++) {
+        *has_axis[i] = libinput_event_pointer_has_axis(pointer_event, axes[i]);
+        if (!*has_axis[i])
+            continue;
+#if LIBINPUT_CHECK_VERSION(1, 19, 0)
+        if (input_event->scroll.discrete)
+            *value[i] = libinput_event_pointer_get_scroll_value_v120(pointer_event, axes[i]);
+        else
+            *value[i] = libinput_event_pointer_get_scroll_value(pointer_event, axes[i]);
+#else
+        if (input_event->scroll.discrete)
+            *value[i] = 120.0 * libinput_event_pointer_get_axis_value_discrete(pointer_event, axes[i]);
+        else
+            *value[i] = libinput_event_pointer_get_axis_value(pointer_event, axes[i]);
+#endif /* LIBINPUT_CHECK_VERSION(1, 19, 0) */
+    }
+}
 
-        enum libinput_event_type event_type = libinput_event_get_type (event);
-        switch (event_type) {
-        case LIBINPUT_EVENT_NONE:
-            return;
-
-        case LIBINPUT_EVENT_DEVICE_ADDED:
-            input_handle_device_added(libinput_event_get_device(event));
-            break;
-        case LIBINPUT_EVENT_DEVICE_REMOVED:
-            input_handle_device_removed(libinput_event_get_device(event));
-            break;
-
-        case LIBINPUT_EVENT_KEYBOARD_KEY:
-            input_handle_key_event(platform->web_view, libinput_event_get_keyboard_event(event));
-            break;
+/*
+ * Copies what is needed from a libinput event, runs in the input thread.
+ * Returns false for events which are not handled.
+ */
+static bool
+input_translate_event(struct libinput_event *event, CogDrmInputEvent *input_event)
+{
+    memset(input_event, 0, sizeof(*input_event));
+    input_event->type = libinput_event_get_type(event);
+
+    switch (input_event->type) {
+    case LIBINPUT_EVENT_KEYBOARD_KEY: {
+        struct libinput_event_keyboard *key_event = libinput_event_get_keyboard_event(event);
+        input_event->time_usec = libinput_event_keyboard_get_time_usec(key_event);
+        input_event->key.key = libinput_event_keyboard_get_key(key_event);
+        input_event->key.pressed = libinput_event_keyboard_get_key_state(key_event) == LIBINPUT_KEY_STATE_PRESSED;
+        return true;
+    }
 
-        case LIBINPUT_EVENT_TOUCH_CANCEL:
-            break;
-        case LIBINPUT_EVENT_TOUCH_DOWN:
-        case LIBINPUT_EVENT_TOUCH_UP:
-        case LIBINPUT_EVENT_TOUCH_MOTION:
-        case LIBINPUT_EVENT_TOUCH_FRAME:
-            input_handle_touch_event(event_type, libinput_event_get_touch_event(event));
-            break;
+    case LIBINPUT_EVENT_TOUCH_CANCEL:
+        return false;
+    case LIBINPUT_EVENT_TOUCH_DOWN:
+    case LIBINPUT_EVENT_TOUCH_UP:
+    case LIBINPUT_EVENT_TOUCH_MOTION:
+    case LIBINPUT_EVENT_TOUCH_FRAME: {
+        struct libinput_event_touch *touch_event = libinput_event_get_touch_event(event);
+        input_event->time_usec = libinput_event_touch_get_time_usec(touch_event);
+        if (input_event->type == LIBINPUT_EVENT_TOUCH_FRAME)
+            return true;
+
+        input_event->touch.slot = libinput_event_touch_get_seat_slot(touch_event);
+        if (input_event->type != LIBINPUT_EVENT_TOUCH_UP) {
+            input_event->touch.x = libinput_event_touch_get_x_transformed(touch_event, 1);
+            input_event->touch.y = libinput_event_touch_get_y_transformed(touch_event, 1);
+        }
+        return true;
+    }
 
-        case LIBINPUT_EVENT_POINTER_MOTION:
-            input_handle_pointer_motion_event(platform->web_view, libinput_event_get_pointer_event(event), false);
-            break;
-        case LIBINPUT_EVENT_POINTER_MOTION_ABSOLUTE:
-            input_handle_pointer_motion_event(platform->web_view, libinput_event_get_pointer_event(event), true);
-            break;
+    case LIBINPUT_EVENT_POINTER_MOTION: {
+        struct libinput_event_pointer *pointer_event = libinput_event_get_pointer_event(event);
+        input_event->time_usec = libinput_event_pointer_get_time_usec(pointer_event);
+        input_event->motion.dx = libinput_event_pointer_get_dx(pointer_event);
+        input_event->motion.dy = libinput_event_pointer_get_dy(pointer_event);
+        return true;
+    }
+    case LIBINPUT_EVENT_POINTER_MOTION_ABSOLUTE: {
+        struct libinput_event_pointer *pointer_event = libinput_event_get_pointer_event(event);
+        input_event->time_usec = libinput_event_pointer_get_time_usec(pointer_event);
+        input_event->absolute.x = libinput_event_pointer_get_absolute_x_transformed(pointer_event, 1);
+        input_event->absolute.y = libinput_event_pointer_get_absolute_y_transformed(pointer_event, 1);
+        return true;
+    }
 
-        case LIBINPUT_EVENT_POINTER_BUTTON:
-            input_handle_pointer_button_event(platform->web_view, libinput_event_get_pointer_event(event));
-            break;
+    case LIBINPUT_EVENT_POINTER_BUTTON: {
+        struct libinput_event_pointer *pointer_event = libinput_event_get_pointer_event(event);
+        input_event->time_usec = libinput_event_pointer_get_time_usec(pointer_event);
+        input_event->button.button = libinput_event_pointer_get_button(pointer_event);
+        input_event->button.pressed =
+            libinput_event_pointer_get_button_state(pointer_event) == LIBINPUT_BUTTON_STATE_PRESSED;
+        return true;
+    }
 
-        case LIBINPUT_EVENT_GESTURE_SWIPE_BEGIN:
-        case LIBINPUT_EVENT_GESTURE_SWIPE_UPDATE:
-        case LIBINPUT_EVENT_GESTURE_SWIPE_END:
-            g_debug_once("%s: GESTURE_SWIPE_{BEGIN,UPDATE,END} unimplemented", __func__);
-            break;
+    case LIBINPUT_EVENT_GESTURE_SWIPE_BEGIN:
+    case LIBINPUT_EVENT_GESTURE_SWIPE_UPDATE:
+    case LIBINPUT_EVENT_GESTURE_SWIPE_END:
+        g_debug_once("%s: GESTURE_SWIPE_{BEGIN,UPDATE,END} unimplemented", __func__);
+        return false;
 
-        case LIBINPUT_EVENT_GESTURE_PINCH_BEGIN:
-        case LIBINPUT_EVENT_GESTURE_PINCH_UPDATE:
-        case LIBINPUT_EVENT_GESTURE_PINCH_END:
-            g_debug_once("%s: GESTURE_PINCH_{BEGIN,UPDATE,END} unimplemented", __func__);
-            break;
+    case LIBINPUT_EVENT_GESTURE_PINCH_BEGIN:
+    case LIBINPUT_EVENT_GESTURE_PINCH_UPDATE:
+    case LIBINPUT_EVENT_GESTURE_PINCH_END:
+        g_debug_once("%s: GESTURE_PINCH_{BEGIN,UPDATE,END} unimplemented", __func__);
+        return false;
 
 #if LIBINPUT_CHECK_VERSION(1, 2, 0)
-        case LIBINPUT_EVENT_TABLET_TOOL_AXIS:
-            g_debug_once("%s: TABLET_TOOL_AXIS unimplemented", __func__);
-            break;
-        case LIBINPUT_EVENT_TABLET_TOOL_PROXIMITY:
-            g_debug_once("%s: TABLET_TOOL_PROXIMITY unimplemented", __func__);
-            break;
-        case LIBINPUT_EVENT_TABLET_TOOL_TIP:
-            g_debug_once("%s: TABLET_TOOL_TIP unimplemented", __func__);
-            break;
-        case LIBINPUT_EVENT_TABLET_TOOL_BUTTON:
-            g_debug_once("%s: TABLET_TOOL_BUTTON unimplemented", __func__);
-            break;
+    case LIBINPUT_EVENT_TABLET_TOOL_AXIS:
+        g_debug_once("%s: TABLET_TOOL_AXIS unimplemented", __func__);
+        return false;
+    case LIBINPUT_EVENT_TABLET_TOOL_PROXIMITY:
+        g_debug_once("%s: TABLET_TOOL_PROXIMITY unimplemented", __func__);
+        return false;
+    case LIBINPUT_EVENT_TABLET_TOOL_TIP:
+        g_debug_once("%s: TABLET_TOOL_TIP unimplemented", __func__);
+        return false;
+    case LIBINPUT_EVENT_TABLET_TOOL_BUTTON:
+        g_debug_once("%s: TABLET_TOOL_BUTTON unimplemented", __func__);
+        return false;
 #endif /* LIBINPUT_CHECK_VERSION(1, 2, 0) */
 
 #if LIBINPUT_CHECK_VERSION(1, 3, 0)
-        case LIBINPUT_EVENT_TABLET_PAD_BUTTON:
-            g_debug_once("%s: TABLET_PAD_BUTTON unimplemented", __func__);
-            break;
-        case LIBINPUT_EVENT_TABLET_PAD_RING:
-            g_debug_once("%s: TABLET_PAD_RING unimplemented", __func__);
-            break;
-        case LIBINPUT_EVENT_TABLET_PAD_STRIP:
-            g_debug_once("%s: TABLET_PAD_STRIP unimplemented", __func__);
-            break;
+    case LIBINPUT_EVENT_TABLET_PAD_BUTTON:
+        g_debug_once("%s: TABLET_PAD_BUTTON unimplemented", __func__);
+        return false;
+    case LIBINPUT_EVENT_TABLET_PAD_RING:
+        g_debug_once("%s: TABLET_PAD_RING unimplemented", __func__);
+        return false;
+    case LIBINPUT_EVENT_TABLET_PAD_STRIP:
+        g_debug_once("%s: TABLET_PAD_STRIP unimplemented", __func__);
+        return false;
 #endif /* LIBINPUT_CHECK_VERSION(1, 3, 0) */
 
 #if LIBINPUT_CHECK_VERSION(1, 7, 0)
-        case LIBINPUT_EVENT_SWITCH_TOGGLE:
-            g_debug_once("%s: SWITCH_TOGGLE unimplemented", __func__);
-            break;
+    case LIBINPUT_EVENT_SWITCH_TOGGLE:
+        g_debug_once("%s: SWITCH_TOGGLE unimplemented", __func__);
+        return false;
 #endif /* LIBINPUT_CHECK_VERSION(1, 7, 0) */
 
 #if LIBINPUT_CHECK_VERSION(1, 15, 0)
-        case LIBINPUT_EVENT_TABLET_PAD_KEY:
-            g_debug_once("%s: TABLET_PAD_KEY unimplemented", __func__);
-            break;
+    case LIBINPUT_EVENT_TABLET_PAD_KEY:
+        g_debug_once("%s: TABLET_PAD_KEY unimplemented", __func__);
+        return false;
 #endif /* LIBINPUT_CHECK_VERSION(1, 15, 0) */
 
 #if LIBINPUT_CHECK_VERSION(1, 19, 0)
-        case LIBINPUT_EVENT_POINTER_AXIS:
-            /* Deprecated, use _SCROLL_{WHEEL,FINGER,CONTINUOUS} below. */
-            break;
-        case LIBINPUT_EVENT_POINTER_SCROLL_WHEEL:
-            input_handle_pointer_discrete_scroll_event(libinput_event_get_pointer_event(event));
-            break;
-        case LIBINPUT_EVENT_POINTER_SCROLL_FINGER:
-        case LIBINPUT_EVENT_POINTER_SCROLL_CONTINUOUS:
-            input_handle_pointer_smooth_scroll_event(libinput_event_get_pointer_event(event));
-            break;
+    case LIBINPUT_EVENT_POINTER_AXIS:
+        /* Deprecated, use _SCROLL_{WHEEL,FINGER,CONTINUOUS} below. */
+        return false;
+    case LIBINPUT_EVENT_POINTER_SCROLL_WHEEL:
+    case LIBINPUT_EVENT_POINTER_SCROLL_FINGER:
+    case LIBINPUT_EVENT_POINTER_SCROLL_CONTINUOUS:
+#else
+    case LIBINPUT_EVENT_POINTER_AXIS:
+#endif /* LIBINPUT_CHECK_VERSION(1, 19, 0) */
+    {
+        struct libinput_event_pointer *pointer_event = libinput_event_get_pointer_event(event);
+        input_event->time_usec = libinput_event_pointer_get_time_usec(pointer_event);
+        input_translate_scroll_event(pointer_event, input_event);
+        return true;
+    }
 
-        case LIBINPUT_EVENT_GESTURE_HOLD_BEGIN:
-        case LIBINPUT_EVENT_GESTURE_HOLD_END:
-            g_debug_once("%s: GESTURE_HOLD_{BEGIN,END} unimplemented", __func__);
+#if LIBINPUT_CHECK_VERSION(1, 19, 0)
+    case LIBINPUT_EVENT_GESTURE_HOLD_BEGIN:
+    case LIBINPUT_EVENT_GESTURE_HOLD_END:
+        g_debug_once("%s: GESTURE_HOLD_{BEGIN,END} unimplemented", __func__);
+        return false;
+#endif /* LIBINPUT_CHECK_VERSION(1, 19, 0) */
+
+    default:
+        return false;
+    }
+}
+
+/* Queues an event for the main thread, waiting for room if the queue is full. */
+static void
+input_push_event(const CogDrmInputEvent *input_event)
+{
+    if (cog_drm_input_queue_push(input_data.queue, input_event))
+        return;
+
+    input_data.queue_stalls++;
+    do {
+        cog_drm_input_queue_notify(input_data.queue);
+        g_usleep(INPUT_QUEUE_RETRY_US);
+    } while (!g_atomic_int_get(&input_data.quit) && !cog_drm_input_queue_push(input_data.queue, input_event));
+}
+
+static void
+input_process_events(void)
+{
+    g_assert(input_data.libinput);
+
+    libinput_dispatch(input_data.libinput);
+
+    bool                   pushed = false;
+    struct libinput_event *event;
+    while ((event = libinput_get_event(input_data.libinput))) {
+        CogDrmInputEvent input_event;
+
+        switch (libinput_event_get_type(event)) {
+        case LIBINPUT_EVENT_DEVICE_ADDED:
+            input_handle_device_added(libinput_event_get_device(event));
             break;
-#else
-        case LIBINPUT_EVENT_POINTER_AXIS:
-            input_handle_pointer_axis_event(libinput_event_get_pointer_event(event));
+        case LIBINPUT_EVENT_DEVICE_REMOVED:
+            input_handle_device_removed(libinput_event_get_device(event));
             break;
-#endif /* LIBINPUT_CHECK_VERSION(1, 19, 0) */
         default:
+            if (input_translate_event(event, &input_event)) {
+                input_push_event(&input_event);
+                pushed = true;
+            }
             break;
         }
 
-        libinput_event_destroy (event);
+        libinput_event_destroy(event);
     }
+
+    if (pushed)
+        cog_drm_input_queue_notify(input_data.queue);
+}
+
+static void
+input_wake_thread(void)
+{
+    const uint64_t value = 1;
+    while (write(input_data.wake_fd, &value, sizeof value) == -1 && errno == EINTR)
+        ;
+}
+
+/*
+ * Dispatches libinput and translates its events, so that reading input
+ * devices is not delayed while the main thread is busy, and events keep
+ * the timestamps of when they happened.
+ */
+static void *
+input_thread(void *data G_GNUC_UNUSED)
+{
+    struct pollfd fds[] = {
+        {.fd = libinput_get_fd(input_data.libinput), .events = POLLIN},
+        {.fd = input_data.wake_fd, .events = POLLIN},
+    };
+
+    while (!g_atomic_int_get(&input_data.quit)) {
+        input_configure_devices();
+        input_process_events();
+
+        if (poll(fds, G_N_ELEMENTS(fds), -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            g_warning("Cannot poll input devices: %s", g_strerror(errno));
+            break;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            uint64_t value;
+            while (read(input_data.wake_fd, &value, sizeof value) == -1 && errno == EINTR)
+                ;
+        }
+    }
+
+    return NULL;
+}
+
+/* Requests the input thread to configure input devices for a new rotation. */
+static void
+input_set_rotation(CogGLRendererRotation rotation)
+{
+    g_atomic_int_set(&input_data.rotation, rotation);
+    if (input_data.thread)
+        input_wake_thread();
 }
 
 static int
@@ -1211,11 +1564,29 @@ input_interface_close_restricted (int fd, void *user_data)
 }
 
 static void
-clear_input(CogDrmPlatform *platform)
+clear_input(void)
 {
-    if (platform->rotatable_input_devices) {
-        g_list_free_full(platform->rotatable_input_devices, (GDestroyNotify) libinput_device_unref);
-        platform->rotatable_input_devices = NULL;
+    if (input_data.thread) {
+        g_atomic_int_set(&input_data.quit, true);
+        input_wake_thread();
+        g_thread_join(g_steal_pointer(&input_data.thread));
+    }
+
+    if (input_data.stats.events) {
+        g_debug("%s: %" PRIu64 " events, %" PRIu64 " coalesced, %" PRIu64 " dropped while unfocused, queue full %" PRIu64
+                " times",
+                __func__, input_data.stats.events, input_data.stats.coalesced, input_data.stats.dropped,
+                input_data.queue_stalls);
+    }
+
+    if (input_data.rotatable_devices) {
+        g_list_free_full(input_data.rotatable_devices, (GDestroyNotify) libinput_device_unref);
+        input_data.rotatable_devices = NULL;
+    }
+    g_clear_pointer(&input_data.queue, cog_drm_input_queue_free);
+    if (input_data.wake_fd != -1) {
+        close(input_data.wake_fd);
+        input_data.wake_fd = -1;
     }
     g_clear_pointer (&input_data.libinput, libinput_unref);
     g_clear_pointer (&input_data.udev, udev_unref);
@@ -1227,13 +1598,13 @@ update_logical_input_size(CogGLRendererRotation rotation)
     switch (rotation) {
     case COG_GL_RENDERER_ROTATION_0:
     case COG_GL_RENDERER_ROTATION_180:
-        input_data.input_width = drm_data.mode->hdisplay;
-        input_data.input_height = drm_data.mode->vdisplay;
+        input_data.input_width = drm_data.scanout_width;
+        input_data.input_height = drm_data.scanout_height;
         break;
     case COG_GL_RENDERER_ROTATION_90:
     case COG_GL_RENDERER_ROTATION_270:
-        input_data.input_width = drm_data.mode->vdisplay;
-        input_data.input_height = drm_data.mode->hdisplay;
+        input_data.input_width = drm_data.scanout_height;
+        input_data.input_height = drm_data.scanout_width;
         break;
     }
 }
@@ -1252,7 +1623,7 @@ init_input(CogDrmPlatform *platform)
     if (!input_data.udev)
         return FALSE;
 
-    input_data.libinput = libinput_udev_create_context(&interface, platform, input_data.udev);
+    input_data.libinput = libinput_udev_create_context(&interface, NULL, input_data.udev);
     if (!input_data.libinput)
         return FALSE;
 
@@ -1267,6 +1638,19 @@ init_input(CogDrmPlatform *platform)
         touch_point->type = wpe_input_touch_event_type_null;
     }
 
+    input_data.queue = cog_drm_input_queue_new(INPUT_QUEUE_CAPACITY);
+    if (!input_data.queue)
+        return FALSE;
+
+    input_data.wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (input_data.wake_fd == -1) {
+        g_warning("Cannot create input thread eventfd: %s", g_strerror(errno));
+        return FALSE;
+    }
+
+    /* From now on libinput is only used from the input thread. */
+    input_data.rotation = input_data.configured_rotation = platform->rotation;
+    input_data.thread = g_thread_new("cog: input", input_thread, NULL);
     return TRUE;
 }
 
@@ -1278,8 +1662,9 @@ struct drm_source {
 };
 
 struct input_source {
-    GSource source;
-    GPollFD pfd;
+    GSource         source;
+    GPollFD         pfd;
+    CogDrmPlatform *platform;
 };
 
 static gboolean
@@ -1296,7 +1681,7 @@ input_source_dispatch (GSource *base, GSourceFunc callback, gpointer user_data)
     if (source->pfd.revents & (G_IO_ERR | G_IO_HUP))
         return FALSE;
 
-    input_process_events ();
+    input_process_queue(source->platform);
     source->pfd.revents = 0;
     return TRUE;
 }
@@ -1339,9 +1724,10 @@ init_glib(CogDrmPlatform *self)
                                            sizeof (struct input_source));
     {
         struct input_source *source = (struct input_source *) glib_data.input_source;
-        source->pfd.fd = libinput_get_fd (input_data.libinput);
+        source->pfd.fd = cog_drm_input_queue_get_fd(input_data.queue);
         source->pfd.events = G_IO_IN | G_IO_ERR | G_IO_HUP;
         source->pfd.revents = 0;
+        source->platform = self;
         g_source_add_poll (glib_data.input_source, &source->pfd);
 
         g_source_set_name (glib_data.input_source, "cog: input");
@@ -1382,6 +1768,543 @@ gamepad_provider_get_view_backend_for_gamepad(void *provider G_GNUC_UNUSED, void
     return wpe_view_data.backend;
 }
 
+/*
+ * Applies the virtual screen size requested with COG_PLATFORM_DRM_VIRTUAL.
+ * By default the view is rendered at the mode size with a device scale
+ * factor which makes the layout match the virtual size. Alternatively the
+ * renderer may present buffers of the virtual size, which the display
+ * controller scales up (or down) to the mode size: WebKit then paints and
+ * composites only the pixels of the virtual size, which for a small virtual
+ * size on a large mode saves most of the fill rate.
+ */
+static void
+init_virtual_size(CogDrmRenderer *renderer)
+{
+    int         vx = 0, vy = 0;
+    const char *virtual = g_getenv("COG_PLATFORM_DRM_VIRTUAL");
+    if (!virtual || (sscanf(virtual, "%dx%d", &vx, &vy) != 2) || (vx <= 0) || (vy <= 0))
+        return;
+
+    const char *scaling = g_getenv("COG_PLATFORM_DRM_VIRTUAL_SCALING");
+    bool        plane_scaling = false;
+    if (scaling && g_strcmp0(scaling, "plane") == 0) {
+        plane_scaling = true;
+    } else if (scaling && g_strcmp0(scaling, "device-scale") != 0) {
+        g_warning("Invalid value '%s' for COG_PLATFORM_DRM_VIRTUAL_SCALING, using 'device-scale'.", scaling);
+    }
+
+    double smin = MIN(drm_data.width / (double) vx, drm_data.height / (double) vy);
+    double smax = MAX(drm_data.width / (double) vx, drm_data.height / (double) vy);
+    double scale = (smax < 1.0) ? smax : smin;
+
+    if (plane_scaling) {
+        /* Keep the aspect ratio of the mode, so that the contents are not distorted. */
+        const uint32_t width = drm_data.width / scale + 0.5;
+        const uint32_t height = drm_data.height / scale + 0.5;
+        if (cog_drm_renderer_set_scanout_size(renderer, width, height)) {
+            drm_data.width = drm_data.scanout_width = width;
+            drm_data.height = drm_data.scanout_height = height;
+            g_debug("%s: Plane scaling %" PRIu32 "x%" PRIu32 " to %" PRIu16 "x%" PRIu16 ", %.1f%% of the pixels.",
+                    __func__, width, height, drm_data.mode->hdisplay, drm_data.mode->vdisplay,
+                    100.0 * width * height / ((double) drm_data.mode->hdisplay * drm_data.mode->vdisplay));
+            return;
+        }
+        g_warning("Renderer '%s' cannot scale %" PRIu32 "x%" PRIu32 " buffers with the plane, using device scale.",
+                  renderer->name, width, height);
+    }
+
+    /* initial hack to specify virtual screen size */
+    drm_data.device_scale = scale;
+    drm_data.width /= drm_data.device_scale;
+    drm_data.height /= drm_data.device_scale;
+    g_print("cog: wid=%d hgt=%d scale=%f\n", drm_data.width, drm_data.height, drm_data.device_scale);
+}
+
+/*
+ * Lets the display refresh when frames are committed, which WebKit only
+ * does when there are changes, instead of at the rate of the mode. Idle
+ * pages then make the display drop to its lowest refresh rate.
+ */
+static void
+init_variable_refresh(CogDrmRenderer *renderer)
+{
+    if (!drm_data.variable_refresh)
+        return;
+
+    uint64_t capable = 0;
+    if (!cog_drm_object_get_property_value(drm_data.fd, drm_data.connector.obj_id, DRM_MODE_OBJECT_CONNECTOR,
+                                           "vrr_capable", &capable) ||
+        !capable) {
+        g_debug("%s: Connector #%" PRIu32 " does not support variable refresh rate.", __func__,
+                drm_data.connector.obj_id);
+        drm_data.variable_refresh = false;
+        return;
+    }
+
+    if (!cog_drm_renderer_set_variable_refresh(renderer, true)) {
+        g_debug("%s: Renderer '%s' cannot enable variable refresh rate.", __func__, renderer->name);
+        drm_data.variable_refresh = false;
+        return;
+    }
+
+    g_debug("%s: Variable refresh rate enabled, up to %" PRIu32 " Hz.", __func__, drm_data.refresh);
+}
+
+/*
+ * Presents frames as soon as they are ready instead of at the next vertical
+ * blank, which lowers latency at the cost of tearing.
+ */
+static void
+init_async_page_flip(CogDrmRenderer *renderer)
+{
+    if (!drm_data.async_page_flip)
+        return;
+
+    if (!cog_drm_renderer_set_async_page_flip(renderer, true)) {
+        g_warning("Renderer '%s' cannot flip pages asynchronously, waiting for vertical blanks.", renderer->name);
+        drm_data.async_page_flip = false;
+        return;
+    }
+
+    g_debug("%s: Asynchronous page flips enabled.", __func__);
+}
+
+static CogDrmRenderer *
+create_renderer(CogDrmPlatform        *self,
+                uint32_t               plane_id,
+                uint32_t               crtc_id,
+                uint32_t               connector_id,
+                const drmModeModeInfo *mode)
+{
+    CogDrmRenderer *renderer;
+    if (self->use_gles) {
+        renderer = cog_drm_gles_renderer_new(gbm_data.device, egl_data.display, plane_id, crtc_id, connector_id, mode,
+                                             drm_data.atomic_modesetting);
+    } else {
+        renderer = cog_drm_modeset_renderer_new(gbm_data.device, plane_id, crtc_id, connector_id, mode,
+                                                drm_data.atomic_modesetting);
+    }
+
+    if (drm_data.shm_buffer_count && !cog_drm_renderer_set_shm_buffer_count(renderer, drm_data.shm_buffer_count)) {
+        static bool message_emitted = false;
+        if (!message_emitted) {
+            g_warning("Renderer '%s' cannot use %u SHM buffers, option ignored.", renderer->name,
+                      drm_data.shm_buffer_count);
+            message_emitted = true;
+        }
+    }
+    return renderer;
+}
+
+static void
+cog_drm_output_free(CogDrmOutput *output)
+{
+    g_clear_handle_id(&output->refresh_rate_idle, g_source_remove);
+
+    g_clear_object(&output->viewport);
+    g_clear_object(&output->view);
+    g_clear_pointer(&output->renderer, cog_drm_renderer_destroy);
+    g_free(output);
+}
+
+static bool
+is_plane_in_use(CogDrmPlatform *self, uint32_t plane_id)
+{
+    if (plane_id == drm_data.plane.obj_id || plane_id == get_cursor_plane())
+        return true;
+
+    if (self->video_plane && plane_id == cog_drm_video_plane_get_id(self->video_plane))
+        return true;
+
+    for (unsigned i = 0; i < self->outputs->len; i++) {
+        const CogDrmOutput *output = g_ptr_array_index(self->outputs, i);
+        if (output->plane_id == plane_id)
+            return true;
+    }
+    return false;
+}
+
+static bool
+plane_supports_format(const drmModePlane *plane, uint32_t format)
+{
+    for (uint32_t i = 0; i < plane->count_formats; i++) {
+        if (plane->formats[i] == format)
+            return true;
+    }
+    return false;
+}
+
+/*
+ * Finds a plane of the given type usable with a CRTC which is not in use
+ * yet, and which supports the given format unless it is zero.
+ */
+static uint32_t
+find_plane(CogDrmPlatform *self, uint32_t crtc_index, uint64_t plane_type, uint32_t format)
+{
+    drmModePlaneRes *plane_resources = drmModeGetPlaneResources(drm_data.fd);
+    if (!plane_resources)
+        return 0;
+
+    uint32_t plane_id = 0;
+    for (uint32_t i = 0; !plane_id && i < plane_resources->count_planes; i++) {
+        drmModePlane *plane = drmModeGetPlane(drm_data.fd, plane_resources->planes[i]);
+        if (!plane)
+            continue;
+
+        uint64_t type = 0;
+        if ((plane->possible_crtcs & (1 << crtc_index)) && !is_plane_in_use(self, plane->plane_id) &&
+            (!format || plane_supports_format(plane, format)) &&
+            cog_drm_object_get_property_value(drm_data.fd, plane->plane_id, DRM_MODE_OBJECT_PLANE, "type", &type) &&
+            type == plane_type)
+            plane_id = plane->plane_id;
+
+        drmModeFreePlane(plane);
+    }
+
+    drmModeFreePlaneResources(plane_resources);
+    return plane_id;
+}
+
+static const drmModeModeInfo *
+get_preferred_mode(const drmModeConnector *connector)
+{
+    for (int i = 0; i < connector->count_modes; i++) {
+        if (connector->modes[i].type & DRM_MODE_TYPE_PREFERRED)
+            return &connector->modes[i];
+    }
+    return connector->count_modes ? &connector->modes[0] : NULL;
+}
+
+static CogDrmOutput *
+find_output(CogDrmPlatform *self, uint32_t connector_id)
+{
+    for (unsigned i = 0; i < self->outputs->len; i++) {
+        CogDrmOutput *output = g_ptr_array_index(self->outputs, i);
+        if (output->connector_id == connector_id)
+            return output;
+    }
+    return NULL;
+}
+
+/*
+ * Sets up the connected outputs besides the primary one, each one with the
+ * preferred mode of its connector and a CRTC which is not in use yet. The
+ * outputs which cannot be set up are skipped. Outputs which have been set
+ * up already are kept, which allows calling this again after a hotplug.
+ */
+static void
+init_outputs(CogDrmPlatform *self)
+{
+    drmModeRes *resources = drmModeGetResources(drm_data.fd);
+    if (!resources)
+        return;
+
+    uint32_t used_crtcs = 1 << drm_data.crtc.index;
+    for (int i = 0; i < resources->count_crtcs; i++) {
+        for (unsigned j = 0; j < self->outputs->len; j++) {
+            const CogDrmOutput *output = g_ptr_array_index(self->outputs, j);
+            if (output->crtc_id == resources->crtcs[i])
+                used_crtcs |= 1 << i;
+        }
+    }
+
+    for (int i = 0; i < resources->count_connectors; i++) {
+        if (resources->connectors[i] == drm_data.connector.obj_id || find_output(self, resources->connectors[i]))
+            continue;
+
+        drmModeConnector *connector = drmModeGetConnector(drm_data.fd, resources->connectors[i]);
+        if (!connector)
+            continue;
+        if (connector->connection != DRM_MODE_CONNECTED || !connector->count_modes) {
+            drmModeFreeConnector(connector);
+            continue;
+        }
+
+        CogDrmOutput *output = g_new0(CogDrmOutput, 1);
+        output->connector_id = connector->connector_id;
+        output->mode = *get_preferred_mode(connector);
+        output->connected = true;
+
+        int crtc_index = -1;
+        for (int j = 0; crtc_index < 0 && j < connector->count_encoders; j++) {
+            drmModeEncoder *encoder = drmModeGetEncoder(drm_data.fd, connector->encoders[j]);
+            if (!encoder)
+                continue;
+
+            for (int k = 0; k < resources->count_crtcs; k++) {
+                if ((encoder->possible_crtcs & (1 << k)) && !(used_crtcs & (1 << k))) {
+                    crtc_index = k;
+                    break;
+                }
+            }
+            drmModeFreeEncoder(encoder);
+        }
+        drmModeFreeConnector(connector);
+
+        if (crtc_index < 0) {
+            g_warning("No CRTC available for connector #%" PRIu32 ", output skipped.", output->connector_id);
+            cog_drm_output_free(output);
+            continue;
+        }
+        output->crtc_id = resources->crtcs[crtc_index];
+
+        output->plane_id = find_plane(self, crtc_index, DRM_PLANE_TYPE_PRIMARY, 0);
+        if (!output->plane_id) {
+            g_warning("No primary plane available for CRTC #%" PRIu32 ", output skipped.", output->crtc_id);
+            cog_drm_output_free(output);
+            continue;
+        }
+
+        output->renderer =
+            create_renderer(self, output->plane_id, output->crtc_id, output->connector_id, &output->mode);
+
+        uint64_t vrr_capable = 0;
+        if (drm_data.variable_refresh &&
+            cog_drm_object_get_property_value(drm_data.fd, output->connector_id, DRM_MODE_OBJECT_CONNECTOR,
+                                              "vrr_capable", &vrr_capable) &&
+            vrr_capable)
+            cog_drm_renderer_set_variable_refresh(output->renderer, true);
+        if (drm_data.async_page_flip)
+            cog_drm_renderer_set_async_page_flip(output->renderer, true);
+
+        g_autoptr(GError) error = NULL;
+        if (output->renderer->initialize && !output->renderer->initialize(output->renderer, &error)) {
+            g_warning("Cannot initialize renderer for connector #%" PRIu32 ", output skipped: %s",
+                      output->connector_id, error->message);
+            cog_drm_output_free(output);
+            continue;
+        }
+
+        used_crtcs |= 1 << crtc_index;
+        g_ptr_array_add(self->outputs, output);
+
+        g_debug("%s: Output %u, connector #%" PRIu32 ", CRTC #%" PRIu32 ", plane #%" PRIu32 ", mode '%s' @ %" PRIu32
+                "Hz.",
+                __func__, self->outputs->len, output->connector_id, output->crtc_id, output->plane_id,
+                output->mode.name, output->mode.vrefresh);
+    }
+
+    drmModeFreeResources(resources);
+}
+
+static gboolean set_target_refresh_rate(gpointer user_data);
+static void     queue_output_target_refresh_rate(CogDrmOutput *output);
+static void     init_output_views(CogDrmPlatform *self, WebKitWebView *primary_view);
+
+/*
+ * Tells whether the mode needs to be set again on a connector which was,
+ * and still is connected: a different mode was picked, or the link to the
+ * display was lost in between, as it happens when it gets replugged.
+ */
+static bool
+needs_mode_set(uint32_t connector_id, const drmModeModeInfo *current_mode, const drmModeModeInfo *mode)
+{
+    uint64_t link_status = DRM_MODE_LINK_STATUS_GOOD;
+    cog_drm_object_get_property_value(drm_data.fd, connector_id, DRM_MODE_OBJECT_CONNECTOR, "link-status",
+                                      &link_status);
+    return link_status == DRM_MODE_LINK_STATUS_BAD || memcmp(current_mode, mode, sizeof(drmModeModeInfo)) != 0;
+}
+
+static void
+reprobe_primary_output(CogDrmPlatform *self)
+{
+    drmModeConnector *connector = drmModeGetConnector(drm_data.fd, drm_data.connector.obj_id);
+    drmModeModeInfo  *mode = NULL;
+    if (connector && connector->connection == DRM_MODE_CONNECTED)
+        mode = select_mode(connector);
+
+    if (!mode) {
+        if (drm_data.connected)
+            g_debug("%s: Connector #%" PRIu32 " disconnected.", __func__, drm_data.connector.obj_id);
+        drm_data.connected = false;
+        g_clear_pointer(&connector, drmModeFreeConnector);
+        return;
+    }
+
+    if (drm_data.connected && !needs_mode_set(drm_data.connector.obj_id, drm_data.mode, mode)) {
+        drmModeFreeConnector(connector);
+        return;
+    }
+
+    if (!cog_drm_renderer_set_mode(self->renderer, mode)) {
+        g_warning("Renderer '%s' cannot use mode '%s' for connector #%" PRIu32 ".", self->renderer->name, mode->name,
+                  drm_data.connector.obj_id);
+        drmModeFreeConnector(connector);
+        return;
+    }
+
+    /* The mode points into the connector, keep both. */
+    g_clear_pointer(&drm_data.connector.obj, drmModeFreeConnector);
+    drm_data.connector.obj = connector;
+    drm_data.mode = mode;
+    drm_data.refresh = mode->vrefresh;
+    drm_data.connected = true;
+    set_cursor_refresh(drm_data.refresh);
+
+    if (wpe_view_data.backend)
+        g_idle_add(G_SOURCE_FUNC(set_target_refresh_rate), &wpe_view_data);
+}
+
+static void
+reprobe_output(CogDrmOutput *output)
+{
+    drmModeConnector *connector = drmModeGetConnector(drm_data.fd, output->connector_id);
+    if (!connector || connector->connection != DRM_MODE_CONNECTED || !connector->count_modes) {
+        if (output->connected)
+            g_debug("%s: Connector #%" PRIu32 " disconnected.", __func__, output->connector_id);
+        output->connected = false;
+        g_clear_pointer(&connector, drmModeFreeConnector);
+        return;
+    }
+
+    const drmModeModeInfo *mode = get_preferred_mode(connector);
+    if ((!output->connected || needs_mode_set(output->connector_id, &output->mode, mode)) &&
+        cog_drm_renderer_set_mode(output->renderer, mode)) {
+        output->mode = *mode;
+        output->connected = true;
+        if (output->backend)
+            queue_output_target_refresh_rate(output);
+    }
+    drmModeFreeConnector(connector);
+}
+
+/*
+ * Reprobes the connectors after the kernel notified that some changed.
+ * Outputs which got connected again, or need a different mode, get their
+ * mode set again and show the last frame right away, and WebKit continues
+ * producing frames for them. The views keep their size and loaded pages.
+ */
+static gboolean
+on_drm_hotplug(int fd G_GNUC_UNUSED, GIOCondition condition G_GNUC_UNUSED, CogDrmPlatform *self)
+{
+    struct udev_device *device = udev_monitor_receive_device(hotplug_data.monitor);
+    if (!device)
+        return G_SOURCE_CONTINUE;
+
+    const bool hotplug = g_strcmp0(udev_device_get_property_value(device, "HOTPLUG"), "1") == 0;
+    const dev_t devnum = udev_device_get_devnum(device);
+    udev_device_unref(device);
+
+    if (!hotplug || devnum != hotplug_data.devnum)
+        return G_SOURCE_CONTINUE;
+
+    g_debug("%s: Reprobing connectors.", __func__);
+    reprobe_primary_output(self);
+    for (unsigned i = 0; i < self->outputs->len; i++)
+        reprobe_output(g_ptr_array_index(self->outputs, i));
+
+    /* Displays which were not connected yet may be used now. */
+    if (self->all_outputs) {
+        init_outputs(self);
+        if (self->web_view)
+            init_output_views(self, WEBKIT_WEB_VIEW(self->web_view));
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static void
+clear_hotplug(void)
+{
+    g_clear_handle_id(&hotplug_data.source_id, g_source_remove);
+    g_clear_pointer(&hotplug_data.monitor, udev_monitor_unref);
+    g_clear_pointer(&hotplug_data.udev, udev_unref);
+}
+
+static void
+on_video_plane_display_dmabuf_receiver_handle_dmabuf(void                                         *data,
+                                                     struct wpe_video_plane_display_dmabuf_export *dmabuf_export,
+                                                     uint32_t                                      id,
+                                                     int                                           fd,
+                                                     int32_t                                       x,
+                                                     int32_t                                       y,
+                                                     int32_t                                       width,
+                                                     int32_t                                       height,
+                                                     uint32_t                                      stride)
+{
+    CogDrmPlatform *self = data;
+
+    if (fd < 0)
+        return;
+
+    if (!self->video_plane) {
+        close(fd);
+        wpe_video_plane_display_dmabuf_export_release(dmabuf_export);
+        return;
+    }
+
+    if (cog_drm_video_plane_push_frame(self->video_plane, dmabuf_export, id, fd, x, y, width, height, stride))
+        cog_drm_renderer_update_video_plane(self->renderer);
+}
+
+static void
+on_video_plane_display_dmabuf_receiver_end_of_stream(void *data, uint32_t id)
+{
+    CogDrmPlatform *self = data;
+
+    if (self->video_plane) {
+        cog_drm_video_plane_end_of_stream(self->video_plane, id);
+        cog_drm_renderer_update_video_plane(self->renderer);
+    }
+}
+
+static const struct wpe_video_plane_display_dmabuf_receiver video_plane_display_dmabuf_receiver = {
+    .handle_dmabuf = on_video_plane_display_dmabuf_receiver_handle_dmabuf,
+    .end_of_stream = on_video_plane_display_dmabuf_receiver_end_of_stream,
+};
+
+/*
+ * Shows the video frames which WebKit hands over instead of painting them
+ * on an overlay plane of the primary output, committed by the renderer
+ * along with the web content.
+ */
+static void
+init_video_plane(CogDrmPlatform *self)
+{
+    uint32_t plane_id = find_plane(self, drm_data.crtc.index, DRM_PLANE_TYPE_OVERLAY, COG_DRM_VIDEO_PLANE_FORMAT);
+    if (!plane_id) {
+        g_debug("%s: No overlay plane available for video.", __func__);
+        return;
+    }
+
+    self->video_plane = cog_drm_video_plane_new(drm_data.fd, plane_id, drm_data.crtc.obj_id);
+    if (!self->video_plane)
+        return;
+
+    if (!cog_drm_renderer_set_video_plane(self->renderer, self->video_plane)) {
+        g_debug("%s: Renderer '%s' cannot show video on a plane.", __func__, self->renderer->name);
+        g_clear_pointer(&self->video_plane, cog_drm_video_plane_free);
+        return;
+    }
+
+    wpe_video_plane_display_dmabuf_register_receiver(&video_plane_display_dmabuf_receiver, self);
+    g_debug("%s: Showing video on plane #%" PRIu32 ".", __func__, plane_id);
+}
+
+static void
+init_hotplug(CogDrmPlatform *self)
+{
+    struct stat st;
+    if (fstat(drm_data.fd, &st) != 0) {
+        g_warning("Cannot identify the DRM device (%s), hotplug unsupported.", g_strerror(errno));
+        return;
+    }
+    hotplug_data.devnum = st.st_rdev;
+
+    /* The udev context used by libinput belongs to the input thread. */
+    hotplug_data.udev = udev_new();
+    if (hotplug_data.udev)
+        hotplug_data.monitor = udev_monitor_new_from_netlink(hotplug_data.udev, "udev");
+    if (!hotplug_data.monitor || udev_monitor_filter_add_match_subsystem_devtype(hotplug_data.monitor, "drm", NULL) ||
+        udev_monitor_enable_receiving(hotplug_data.monitor)) {
+        g_warning("Cannot monitor DRM devices, hotplug unsupported.");
+        clear_hotplug();
+        return;
+    }
+
+    hotplug_data.source_id = g_unix_fd_add(udev_monitor_get_fd(hotplug_data.monitor), G_IO_IN,
+                                           (GUnixFDSourceFunc) on_drm_hotplug, self);
+}
+
 static gboolean
 cog_drm_platform_setup(CogPlatform *platform, CogShell *shell, const char *params, GError **error)
 {
@@ -1409,18 +2332,6 @@ cog_drm_platform_setup(CogPlatform *platform, CogShell *shell, const char *param
         return FALSE;
     }
 
-    if (g_getenv ("COG_PLATFORM_DRM_CURSOR")) {
-        if (init_cursor(drm_data.fd, drm_data.crtc.index)) {
-            cursor.enabled = true;
-            cursor.x = drm_data.width/2;
-            cursor.y = drm_data.height/2;
-            set_cursor("default");
-            move_cursor(drm_data.fd, drm_data.crtc.obj_id, cursor.x, cursor.y);
-        } else {
-            g_warning ("Failed to initialize cursor");
-        }
-    }
-
     if (!init_gbm ()) {
         g_set_error_literal (error,
                              COG_PLATFORM_WPE_ERROR,
@@ -1437,22 +2348,26 @@ cog_drm_platform_setup(CogPlatform *platform, CogShell *shell, const char *param
         return FALSE;
     }
 
-    if (self->use_gles) {
-        self->renderer = cog_drm_gles_renderer_new(gbm_data.device,
-                                                   egl_data.display,
-                                                   drm_data.plane.obj_id,
-                                                   drm_data.crtc.obj_id,
-                                                   drm_data.connector.obj_id,
-                                                   drm_data.mode,
-                                                   drm_data.atomic_modesetting);
-    } else {
-        self->renderer = cog_drm_modeset_renderer_new(gbm_data.device,
-                                                      drm_data.plane.obj_id,
-                                                      drm_data.crtc.obj_id,
-                                                      drm_data.connector.obj_id,
-                                                      drm_data.mode,
-                                                      drm_data.atomic_modesetting);
+    self->renderer =
+        create_renderer(self, drm_data.plane.obj_id, drm_data.crtc.obj_id, drm_data.connector.obj_id, drm_data.mode);
+    init_virtual_size(self->renderer);
+    init_variable_refresh(self->renderer);
+    init_async_page_flip(self->renderer);
+
+    if (g_getenv ("COG_PLATFORM_DRM_CURSOR")) {
+        if (init_cursor(drm_data.fd, drm_data.crtc.index, drm_data.crtc.obj_id, drm_data.refresh)) {
+            cursor.enabled = true;
+            cursor.x = drm_data.width/2;
+            cursor.y = drm_data.height/2;
+            cursor.screen_width = drm_data.width;
+            cursor.screen_height = drm_data.height;
+            set_cursor("default");
+            move_cursor(drm_data.fd, drm_data.crtc.obj_id, cursor.x, cursor.y);
+        } else {
+            g_warning ("Failed to initialize cursor");
+        }
     }
+
     if (cog_drm_renderer_supports_rotation(self->renderer, self->rotation)) {
         cog_drm_renderer_set_rotation(self->renderer, self->rotation);
     } else {
@@ -1483,6 +2398,13 @@ cog_drm_platform_setup(CogPlatform *platform, CogShell *shell, const char *param
     }
     g_debug("%s: Renderer '%s' initialized.", __func__, self->renderer->name);
 
+    self->outputs = g_ptr_array_new_with_free_func((GDestroyNotify) cog_drm_output_free);
+    if (self->all_outputs)
+        init_outputs(self);
+
+    init_video_plane(self);
+    init_hotplug(self);
+
     wpe_fdo_initialize_for_egl_display (egl_data.display);
 
     cog_gamepad_setup(gamepad_provider_get_view_backend_for_gamepad);
@@ -1497,10 +2419,14 @@ cog_drm_platform_finalize(GObject *object)
 
     g_idle_remove_by_data(&wpe_view_data);
 
+    clear_hotplug();
+    g_clear_pointer(&self->outputs, g_ptr_array_unref);
+    g_clear_pointer(&self->output_uris, g_strfreev);
     g_clear_pointer(&self->renderer, cog_drm_renderer_destroy);
+    g_clear_pointer(&self->video_plane, cog_drm_video_plane_free);
 
     clear_glib();
-    clear_input(self);
+    clear_input();
     clear_egl();
     clear_gbm();
     clear_cursor(drm_data.fd, drm_data.crtc.obj_id);
@@ -1513,6 +2439,21 @@ static WebKitWebViewBackend *
 cog_drm_platform_get_view_backend(CogPlatform *platform, WebKitWebView *related_view, GError **error)
 {
     CogDrmPlatform *self = COG_DRM_PLATFORM(platform);
+
+    CogDrmOutput *output = self->binding_output;
+    if (output) {
+        output->exportable = output->renderer->create_exportable(output->renderer,
+                                                                 output->mode.hdisplay / drm_data.device_scale,
+                                                                 output->mode.vdisplay / drm_data.device_scale);
+        g_assert(output->exportable);
+
+        output->backend = wpe_view_backend_exportable_fdo_get_view_backend(output->exportable);
+        g_assert(output->backend);
+
+        return webkit_web_view_backend_new(output->backend, (GDestroyNotify) wpe_view_backend_exportable_fdo_destroy,
+                                           output->exportable);
+    }
+
     wpe_host_data.exportable = self->renderer->create_exportable(self->renderer,
                                                                  drm_data.width / drm_data.device_scale,
                                                                  drm_data.height / drm_data.device_scale);
@@ -1537,6 +2478,57 @@ set_target_refresh_rate(gpointer user_data)
     return G_SOURCE_REMOVE;
 }
 
+static gboolean
+set_output_target_refresh_rate(CogDrmOutput *output)
+{
+    output->refresh_rate_idle = 0;
+    wpe_view_backend_set_target_refresh_rate(output->backend, output->mode.vrefresh * 1000);
+    return G_SOURCE_REMOVE;
+}
+
+/* At most one source is queued per output, and it is removed when the output is freed. */
+static void
+queue_output_target_refresh_rate(CogDrmOutput *output)
+{
+    if (!output->refresh_rate_idle)
+        output->refresh_rate_idle = g_idle_add(G_SOURCE_FUNC(set_output_target_refresh_rate), output);
+}
+
+/*
+ * Creates the views shown on the outputs besides the primary one. They use
+ * the settings and web context of the primary view, and therefore share its
+ * network process and caches.
+ */
+static void
+init_output_views(CogDrmPlatform *self, WebKitWebView *primary_view)
+{
+    const unsigned n_uris = self->output_uris ? g_strv_length(self->output_uris) : 0;
+
+    for (unsigned i = 0; i < self->outputs->len; i++) {
+        CogDrmOutput *output = g_ptr_array_index(self->outputs, i);
+        if (output->view)
+            continue;
+
+        /* Tells get_view_backend() which output the view is created for. */
+        self->binding_output = output;
+        output->view = cog_view_new("settings", webkit_web_view_get_settings(primary_view), "web-context",
+                                    webkit_web_view_get_context(primary_view),
+#if COG_USE_WPE2
+                                    "network-session", webkit_web_view_get_network_session(primary_view),
+#endif
+                                    NULL);
+        self->binding_output = NULL;
+
+        wpe_view_backend_dispatch_set_device_scale_factor(output->backend, drm_data.device_scale);
+        queue_output_target_refresh_rate(output);
+
+        output->viewport = cog_viewport_new();
+        cog_viewport_add(output->viewport, output->view);
+
+        webkit_web_view_load_uri(WEBKIT_WEB_VIEW(output->view), i < n_uris ? self->output_uris[i] : "about:blank");
+    }
+}
+
 static void
 on_mouse_target_changed(WebKitWebView *view, WebKitHitTestResult *hitTestResult, guint mouseModifiers)
 {
@@ -1578,6 +2570,9 @@ cog_drm_platform_init_web_view(CogPlatform *platform, WebKitWebView *view)
 
     g_signal_connect(view, "mouse-target-changed", G_CALLBACK(on_mouse_target_changed), NULL);
     g_signal_connect(view, "load-changed", G_CALLBACK(on_load_changed), NULL);
+
+    if (COG_DRM_PLATFORM(platform)->outputs)
+        init_output_views(COG_DRM_PLATFORM(platform), view);
 }
 
 static void
@@ -1594,8 +2589,7 @@ cog_drm_platform_set_property(GObject *object, unsigned prop_id, const GValue *v
             update_logical_input_size(self->rotation = rotation);
         } else if (cog_drm_renderer_set_rotation(self->renderer, rotation)) {
             update_logical_input_size(self->rotation = rotation);
-            if (self->rotatable_input_devices)
-                g_list_foreach(self->rotatable_input_devices, (GFunc) input_configure_device, self);
+            input_set_rotation(rotation);
         } else {
             g_critical("%s: Could not set %u rotation (%u degrees), unsupported", __func__, rotation, rotation * 90);
         }
@@ -1668,10 +2662,13 @@ cog_drm_platform_class_init(CogDrmPlatformClass *klass)
      * Mechanism used to present the output. Possible values are:
      *
      * - `modeset`: Present content by attaching rendered buffers to a
-     *   KMS plane. Does not support rotation at the moment.
+     *   KMS plane. Supports the rotations which the display controller
+     *   can apply to the plane, when using atomic mode setting.
      * - `gles`: Use OpenGL ES to present content by drawing quads textured
      *   with the contents of rendered buffers. Supports all rotations by
-     *   modifying the texture UV-mapping.
+     *   modifying the texture UV-mapping, or by having the display
+     *   controller rotate the plane when rendered buffers are scanned
+     *   out directly.
      */
     s_properties[PROP_RENDERER] =
         g_param_spec_string("renderer",
@@ -3,6 +3,8 @@
  */
 
 #include <glib.h>
+#include <errno.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
@@ -75,23 +77,51 @@ const char *cursor_ibeam =
     "00 00 00 00 0f 0f 00 00 00 00 0f 0f 00 00 00 00 "
 ;
 
+/* prerendered cursor image, each one in its own framebuffer */
+typedef struct {
+    const char *pattern;
+    uint32_t fbuf_id;
+    uint32_t handle;
+    uint32_t pitch;
+    uint8_t *pixmap;
+    uint32_t pixlen;
+    int px;
+    int py;
+} cursor_image;
+
+enum {
+    CURSOR_IMAGE_ARROW,
+    CURSOR_IMAGE_HAND,
+    CURSOR_IMAGE_IBEAM,
+    CURSOR_IMAGE_CUSTOM,
+    CURSOR_IMAGE_COUNT,
+};
+
 /* cursor-specific state-- dont duplicate drm state */
 static struct {
-    uint32_t fbuf_id;
+    int drm_fd;
+    uint32_t crtc_id;
     uint32_t plane_id;
-    uint32_t handle;
+    uint32_t fourcc;
 
     uint32_t width;
     uint32_t height;
-    uint32_t pitch;
-    uint8_t *pixmap;
-    uint32_t pixlen;
     int depth;
     int shift;
 
-    int px;
-    int py;
+    cursor_image images[CURSOR_IMAGE_COUNT];
+    cursor_image *image; /* NULL while hidden */
     const char *pattern;
+
+    int x;
+    int y;
+
+    /* plane updates are limited to one per refresh period */
+    GSource *source;
+    int64_t period;
+    int64_t last_update;
+    uint64_t requests;
+    uint64_t updates;
 } cursor = { 0 };
 
 /* supported pixel-formats (alpha required) */
@@ -118,25 +148,15 @@ const static struct {
     { 0, 0, 0 }
 };
 
-/* allocate overlay plane and pixmap */
-gboolean init_cursor(int drm_fd, int crtc_idx)
+/* find a plane of the given type for the crtc, by best to worst pixel format */
+static int find_plane(int drm_fd, int crtc_idx, uint64_t type, int *format)
 {
-    if (drmSetClientCap(drm_fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1)) {
-        g_warning("cursor: no universal planes");
-        return FALSE;
-    }
-
-    /* find an unused overlay plane */
     int plane_id = -1;
-    int format = -1;
     drmModePlaneRes *planes = drmModeGetPlaneResources(drm_fd);
-    if (planes == NULL) {
-        g_warning("cursor: no planes");
-        return FALSE;
-    }
+    if (planes == NULL)
+        return -1;
 
-    /* search for planes by best to worst pixel format */
-    for (int f = 0; (format < 0) && !!layout[f].fourcc; ++f) {
+    for (int f = 0; (plane_id < 0) && !!layout[f].fourcc; ++f) {
         for (int i = 0; (i < planes->count_planes) && (plane_id < 0); ++i) {
             drmModePlane *plane = drmModeGetPlane(drm_fd, planes->planes[i]);
             if (plane == NULL)
@@ -144,15 +164,15 @@ gboolean init_cursor(int drm_fd, int crtc_idx)
 
             /* plane must be usable by the drm crtc */
             int match = (plane->possible_crtcs>>crtc_idx) & 1;
-            /* plane must be available for use */
-            if ((plane->crtc_id == 0) && (plane->fb_id == 0))
+            /* overlay planes must be available for use, the cursor plane is ours */
+            if ((type == DRM_PLANE_TYPE_CURSOR) || ((plane->crtc_id == 0) && (plane->fb_id == 0)))
                 match |= 2;
-            /* ensure it is an overlay plane */
+            /* ensure it is a plane of the requested type */
             drmModeObjectProperties *props =
-                drmModeObjectGetProperties(drm_fd, plane->plane_id, DRM_MODE_OBJECT_ANY);
-            for (int j = 0; j < props->count_props; ++j) {
+                drmModeObjectGetProperties(drm_fd, plane->plane_id, DRM_MODE_OBJECT_PLANE);
+            for (int j = 0; (props != NULL) && (j < props->count_props); ++j) {
                 drmModePropertyPtr prop = drmModeGetProperty(drm_fd, props->props[j]);
-                if (!strcmp(prop->name, "type") && (props->prop_values[j] == DRM_PLANE_TYPE_OVERLAY))
+                if ((prop != NULL) && !strcmp(prop->name, "type") && (props->prop_values[j] == type))
                     match |= 4;
                 drmModeFreeProperty(prop);
             }
@@ -164,80 +184,78 @@ gboolean init_cursor(int drm_fd, int crtc_idx)
 
             if (match == 15) {
                 plane_id = plane->plane_id;
-                format = f;
+                *format = f;
             }
             drmModeFreePlane(plane);
         }
     }
     drmModeFreePlaneResources(planes);
-    if (plane_id < 0) {
-        g_warning("cursor: no usable cursor plane");
-        return FALSE;
-    }
+    return plane_id;
+}
 
-    /* allocate pixel map for cursor rendering (always use 32-bit max-pixel size) */
+/* allocate a framebuffer and pixmap for one cursor image */
+static gboolean create_image(cursor_image *image)
+{
+    /* always use 32-bit max-pixel size */
     struct drm_mode_create_dumb dumb =
-        { .width = CURSOR_WIDTH, .height = CURSOR_HEIGHT, .bpp = 32 };
-    if (drmIoctl(drm_fd, DRM_IOCTL_MODE_CREATE_DUMB, &dumb))
+        { .width = cursor.width, .height = cursor.height, .bpp = 32 };
+    if (drmIoctl(cursor.drm_fd, DRM_IOCTL_MODE_CREATE_DUMB, &dumb)) {
         g_warning("cursor: DRM_IOCTL_MODE_CREATE_DUMB failed %s", strerror(errno));
+        return FALSE;
+    }
+    image->handle = dumb.handle;
+    image->pitch = dumb.pitch;
 
     uint32_t handles[4] = { dumb.handle, 0, 0, 0 };
     uint32_t pitches[4] = { dumb.pitch, 0, 0, 0 };
     uint32_t offsets[4] = { 0, 0, 0, 0 };
-    if (drmModeAddFB2(drm_fd, dumb.width, dumb.height, layout[format].fourcc,
-            handles, pitches, offsets, &cursor.fbuf_id, 0))
+    if (drmModeAddFB2(cursor.drm_fd, dumb.width, dumb.height, cursor.fourcc,
+            handles, pitches, offsets, &image->fbuf_id, 0)) {
         g_warning("cursor: drmModeAddFB2 failed %s", strerror(errno));
+        return FALSE;
+    }
 
     struct drm_mode_map_dumb dmap = { .handle = dumb.handle };
-    if (drmIoctl(drm_fd, DRM_IOCTL_MODE_MAP_DUMB, &dmap) == 0)
-        cursor.pixmap = mmap(NULL, dumb.size, PROT_READ|PROT_WRITE, MAP_SHARED, drm_fd, dmap.offset);
-    cursor.pixlen = dumb.size;
-    cursor.width = dumb.width;
-    cursor.pitch = dumb.pitch;
-    cursor.height = dumb.height;
-    cursor.handle = dumb.handle;
-    cursor.depth = layout[format].depth;
-    cursor.shift = layout[format].shift;
-    cursor.plane_id = plane_id;
-
-    format = layout[format].fourcc;
-    g_debug("init_cursor: width=%d height=%d pitch=%d shift=%d fourcc=%c%c%c%c",
-            cursor.width, cursor.height, cursor.pitch, cursor.shift,
-            (format>>0)&255, (format>>8)&255, (format>>16)&255, (format>>24)&255);
+    if (drmIoctl(cursor.drm_fd, DRM_IOCTL_MODE_MAP_DUMB, &dmap)) {
+        g_warning("cursor: DRM_IOCTL_MODE_MAP_DUMB failed %s", strerror(errno));
+        return FALSE;
+    }
+    void *pixmap = mmap(NULL, dumb.size, PROT_READ|PROT_WRITE, MAP_SHARED, cursor.drm_fd, dmap.offset);
+    if (pixmap == MAP_FAILED) {
+        g_warning("cursor: mmap failed %s", strerror(errno));
+        return FALSE;
+    }
+    image->pixmap = pixmap;
+    image->pixlen = dumb.size;
     return TRUE;
 }
 
-/* parse human readable cursor pattern into pixmap (NULL==blank pixmap) */
-int set_cursor(const char *pattern)
+static void destroy_image(cursor_image *image)
 {
-    if ((cursor.pixmap == NULL) || (pattern == NULL))
-        return(-1);
-
-    if (strlen(pattern) < cursor.width*cursor.height*3) {
-        const char *name = pattern;
-        pattern = NULL;
-        if (strcmp(name, "default") == 0)
-            pattern = cursor_arrow;
-        else if (strcmp(name, "pointer") == 0)
-            pattern = cursor_hand;
-        else if (strcmp(name, "text") == 0)
-            pattern = cursor_ibeam;
-        else if (strcmp(name, "hidden") == 0)
-            pattern = "";
-        if (pattern == NULL)
-            return(-2);
+    if (image->pixmap != NULL)
+        munmap(image->pixmap, image->pixlen);
+    if (image->fbuf_id != 0)
+        drmModeRmFB(cursor.drm_fd, image->fbuf_id);
+    if (image->handle != 0) {
+        struct drm_mode_destroy_dumb dumb = { .handle = image->handle };
+        drmIoctl(cursor.drm_fd, DRM_IOCTL_MODE_DESTROY_DUMB, &dumb);
     }
+    memset(image, 0, sizeof(*image));
+}
 
-    /* remember last pattern since can get spammed */
-    if (pattern == cursor.pattern)
-      return(0);
-    cursor.pattern = pattern;
+/* parse human readable cursor pattern into the image pixmap */
+static void render_image(cursor_image *image, const char *pattern)
+{
+    image->pattern = pattern;
+
+    /* parts of the buffer beyond the pattern stay transparent */
+    memset(image->pixmap, 0, image->pixlen);
 
     /* parse cursor pattern and save offset to focus pixel */
-    cursor.px = cursor.py = 0;
-    for (int y = 0; y < cursor.height; ++y) {
-        uint8_t *pix = cursor.pixmap + y*cursor.pitch;
-        for (int x = 0; x < cursor.width; ++x) {
+    image->px = image->py = 0;
+    for (int y = 0; y < CURSOR_HEIGHT; ++y) {
+        uint8_t *pix = image->pixmap + y*image->pitch;
+        for (int x = 0; x < CURSOR_WIDTH; ++x) {
             uint32_t c = 0;
             uint32_t a = 0;
             if ((pattern[0] != 0) && (pattern[1] != 0)) {
@@ -245,8 +263,8 @@ int set_cursor(const char *pattern)
                 a = (pattern[1]&15) + ((pattern[1] & 0x40) ? 9 : 0);
                 pattern += 2;
                 if (pattern[0] == '+') {
-                    cursor.px = x;
-                    cursor.py = y;
+                    image->px = x;
+                    image->py = y;
                 }
                 if (pattern[0] != 0)
                     ++pattern;
@@ -272,30 +290,201 @@ int set_cursor(const char *pattern)
             }
         }
     }
+}
+
+/* point the plane at the current image and position (or disable it while hidden) */
+static void update_plane(void)
+{
+    cursor.last_update = g_get_monotonic_time();
+    cursor.updates++;
+
+    /*
+     * on a cursor plane, atomic drivers apply this as an asynchronous
+     * cursor update, which does not wait for nor conflict with the page
+     * flips of the primary plane
+     */
+    if (cursor.image == NULL) {
+        drmModeSetPlane(cursor.drm_fd, cursor.plane_id, cursor.crtc_id, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0);
+        return;
+    }
+    drmModeSetPlane(cursor.drm_fd, cursor.plane_id, cursor.crtc_id, cursor.image->fbuf_id, 0,
+        cursor.x-cursor.image->px, cursor.y-cursor.image->py, cursor.width, cursor.height,
+        0, 0, cursor.width<<16, cursor.height<<16);
+}
+
+static gboolean dispatch_update(GSource *source, GSourceFunc callback, gpointer user_data)
+{
+    g_source_set_ready_time(source, -1);
+    update_plane();
+    return G_SOURCE_CONTINUE;
+}
+
+/* coalesce changes so that the plane is updated at most once per refresh period */
+static void schedule_update(void)
+{
+    cursor.requests++;
+    if (g_source_get_ready_time(cursor.source) != -1)
+        return;
+
+    int64_t next = cursor.last_update + cursor.period;
+    if (next <= g_get_monotonic_time())
+        update_plane();
+    else
+        g_source_set_ready_time(cursor.source, next);
+}
+
+/* allocate cursor plane and prerender cursor images */
+gboolean init_cursor(int drm_fd, int crtc_idx, uint32_t crtc_id, uint32_t refresh)
+{
+    if (drmSetClientCap(drm_fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1)) {
+        g_warning("cursor: no universal planes");
+        return FALSE;
+    }
+
+    /* prefer the dedicated cursor plane, else find an unused overlay plane */
+    int format = -1;
+    int plane_id = find_plane(drm_fd, crtc_idx, DRM_PLANE_TYPE_CURSOR, &format);
+    gboolean cursor_plane = (plane_id >= 0);
+    if (!cursor_plane)
+        plane_id = find_plane(drm_fd, crtc_idx, DRM_PLANE_TYPE_OVERLAY, &format);
+    if (plane_id < 0) {
+        g_warning("cursor: no usable cursor plane");
+        return FALSE;
+    }
+
+    cursor.drm_fd = drm_fd;
+    cursor.crtc_id = crtc_id;
+    cursor.plane_id = plane_id;
+    cursor.fourcc = layout[format].fourcc;
+    cursor.depth = layout[format].depth;
+    cursor.shift = layout[format].shift;
+
+    /* cursor planes usually only accept buffers of the size the driver reports */
+    cursor.width = CURSOR_WIDTH;
+    cursor.height = CURSOR_HEIGHT;
+    if (cursor_plane) {
+        uint64_t width = 0, height = 0;
+        if (!drmGetCap(drm_fd, DRM_CAP_CURSOR_WIDTH, &width) && (width >= CURSOR_WIDTH))
+            cursor.width = width;
+        if (!drmGetCap(drm_fd, DRM_CAP_CURSOR_HEIGHT, &height) && (height >= CURSOR_HEIGHT))
+            cursor.height = height;
+    }
+
+    /* render every built-in cursor once, changing cursors only switches framebuffers */
+    static const char **patterns[] = {
+        [CURSOR_IMAGE_ARROW] = &cursor_arrow,
+        [CURSOR_IMAGE_HAND] = &cursor_hand,
+        [CURSOR_IMAGE_IBEAM] = &cursor_ibeam,
+    };
+    for (int i = 0; i < G_N_ELEMENTS(patterns); ++i) {
+        if (!create_image(&cursor.images[i])) {
+            clear_cursor(drm_fd, 0);
+            return FALSE;
+        }
+        render_image(&cursor.images[i], *patterns[i]);
+    }
+
+    static GSourceFuncs funcs = {
+        .dispatch = dispatch_update,
+    };
+    cursor.source = g_source_new(&funcs, sizeof(GSource));
+    g_source_set_name(cursor.source, "cog: cursor");
+    g_source_set_priority(cursor.source, G_PRIORITY_HIGH);
+    g_source_attach(cursor.source, g_main_context_get_thread_default());
+    cursor.period = refresh ? G_USEC_PER_SEC / refresh : 0;
+
+    g_debug("init_cursor: %s plane %d width=%d height=%d shift=%d fourcc=%c%c%c%c",
+            cursor_plane ? "cursor" : "overlay", plane_id, cursor.width, cursor.height, cursor.shift,
+            (cursor.fourcc>>0)&255, (cursor.fourcc>>8)&255, (cursor.fourcc>>16)&255, (cursor.fourcc>>24)&255);
+    return TRUE;
+}
+
+/* select cursor image by name or human readable pattern ("hidden"==no cursor) */
+int set_cursor(const char *pattern)
+{
+    if ((cursor.source == NULL) || (pattern == NULL))
+        return(-1);
+
+    if (strlen(pattern) < CURSOR_WIDTH*CURSOR_HEIGHT*3) {
+        const char *name = pattern;
+        pattern = NULL;
+        if (strcmp(name, "default") == 0)
+            pattern = cursor_arrow;
+        else if (strcmp(name, "pointer") == 0)
+            pattern = cursor_hand;
+        else if (strcmp(name, "text") == 0)
+            pattern = cursor_ibeam;
+        else if (strcmp(name, "hidden") == 0)
+            pattern = "";
+        if (pattern == NULL)
+            return(-2);
+    }
+
+    /* remember last pattern since can get spammed */
+    if (pattern == cursor.pattern)
+      return(0);
+    cursor.pattern = pattern;
+
+    cursor_image *image = NULL;
+    for (int i = 0; (i < CURSOR_IMAGE_COUNT) && (image == NULL); ++i)
+        if (cursor.images[i].pattern == pattern)
+            image = &cursor.images[i];
+
+    /* patterns other than the built-in ones are rendered on demand */
+    if ((image == NULL) && (pattern[0] != 0)) {
+        image = &cursor.images[CURSOR_IMAGE_CUSTOM];
+        if ((image->pixmap == NULL) && !create_image(image)) {
+            destroy_image(image);
+            return(-1);
+        }
+        render_image(image, pattern);
+    }
+
+    cursor.image = image;
+    schedule_update();
     return(0);
 }
 
-/* reposition cursor overlay to desired coordinates */
+/* reposition cursor plane to desired coordinates */
 void move_cursor(int drm_fd, int crtc_id, int x, int y)
 {
-    drmModeSetPlane(drm_fd, cursor.plane_id, crtc_id, cursor.fbuf_id, 0,
-        x-cursor.px, y-cursor.py, cursor.width, cursor.height,
-        0, 0, cursor.width<<16, cursor.height<<16);
+    cursor.crtc_id = crtc_id;
+    cursor.x = x;
+    cursor.y = y;
+    if (cursor.source != NULL)
+        schedule_update();
+}
+
+/* follow refresh rate changes of the crtc, e.g. after a new mode was set */
+void set_cursor_refresh(uint32_t refresh)
+{
+    cursor.period = refresh ? G_USEC_PER_SEC / refresh : 0;
+}
+
+/* plane used for the cursor, zero when the cursor is not in use */
+uint32_t get_cursor_plane(void)
+{
+    return (cursor.source != NULL) ? cursor.plane_id : 0;
 }
 
 /* clean up any remaining state */
 void clear_cursor(int drm_fd, int crtc_id)
 {
-    if (cursor.pixmap != NULL) {
+    if (cursor.source != NULL) {
+        g_debug("clear_cursor: %" PRIu64 " cursor changes, %" PRIu64 " plane updates",
+                cursor.requests, cursor.updates);
+        g_source_destroy(cursor.source);
+        g_source_unref(cursor.source);
+
         /* older pi vc4 drm driver would not free plane w/o two calls */
-        cursor.fbuf_id = -1;
-        move_cursor(drm_fd, crtc_id, 0, 0);
-        move_cursor(drm_fd, crtc_id, 0, 0);
-        /* done with underlying pixel memory */
-        munmap(cursor.pixmap, cursor.pixlen);
-        struct drm_mode_destroy_dumb free = { .handle = cursor.handle };
-        drmIoctl(drm_fd, DRM_IOCTL_MODE_MAP_DUMB, &free);
+        cursor.crtc_id = crtc_id;
+        cursor.image = NULL;
+        update_plane();
+        update_plane();
     }
+    /* done with underlying pixel memory */
+    for (int i = 0; i < CURSOR_IMAGE_COUNT; ++i)
+        destroy_image(&cursor.images[i]);
     memset(&cursor, 0, sizeof(cursor));
 }
-
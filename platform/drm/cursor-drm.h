@@ -5,14 +5,19 @@
 #ifndef COG_CURSOR_DRM_H
 #define COG_CURSOR_DRM_H
 
+#include <stdint.h>
+
 /* cursor pixmap patterns */
-extern const char *cursor_pointer;
+extern const char *cursor_arrow;
 extern const char *cursor_hand;
+extern const char *cursor_ibeam;
 
 /* cursor functions */
-int init_cursor(int drm_fd, int crtc_id);
+int init_cursor(int drm_fd, int crtc_idx, uint32_t crtc_id, uint32_t refresh);
 int set_cursor(const char *pattern);
 void move_cursor(int drm_fd, int crtc_id, int x, int y);
 void clear_cursor(int drm_fd, int crtc_id);
+void set_cursor_refresh(uint32_t refresh);
+uint32_t get_cursor_plane(void);
 
 #endif //COG_CURSOR_DRM_H
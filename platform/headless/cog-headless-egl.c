@@ -0,0 +1,185 @@
+/*
+ * cog-headless-egl.c
+ * Copyright (C) 2024 Igalia S.L.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "cog-headless-egl.h"
+
+#include "../../core/cog.h"
+#include <epoxy/gl.h>
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#    define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif /* !EGL_PLATFORM_SURFACELESS_MESA */
+
+#ifndef EGL_NO_CONFIG_KHR
+#    define EGL_NO_CONFIG_KHR ((EGLConfig) 0)
+#endif /* !EGL_NO_CONFIG_KHR */
+
+struct _CogHeadlessEgl {
+    EGLDisplay display;
+    EGLContext context;
+
+    /* Created on the first read back. */
+    GLuint texture;
+    GLuint framebuffer;
+    bool   read_bgra;
+};
+
+CogHeadlessEgl *
+cog_headless_egl_new(GError **error)
+{
+    if (!epoxy_has_egl_extension(EGL_NO_DISPLAY, "EGL_MESA_platform_surfaceless")) {
+        g_set_error_literal(error, COG_PLATFORM_WPE_ERROR, COG_PLATFORM_WPE_ERROR_INIT,
+                            "EGL extension EGL_MESA_platform_surfaceless missing");
+        return NULL;
+    }
+
+    g_autoptr(CogHeadlessEgl) self = g_new0(CogHeadlessEgl, 1);
+    self->display = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    if (self->display == EGL_NO_DISPLAY) {
+        g_set_error_literal(error, COG_PLATFORM_EGL_ERROR, eglGetError(), "Cannot get surfaceless EGL display");
+        return NULL;
+    }
+
+    EGLint major, minor;
+    if (!eglInitialize(self->display, &major, &minor)) {
+        g_set_error_literal(error, COG_PLATFORM_EGL_ERROR, eglGetError(), "eglInitialize");
+        self->display = EGL_NO_DISPLAY;
+        return NULL;
+    }
+
+    static const char *required_egl_extensions[] = {
+        "EGL_KHR_image_base",
+        "EGL_KHR_surfaceless_context",
+    };
+    for (unsigned i = 0; i < G_N_ELEMENTS(required_egl_extensions); i++) {
+        if (!epoxy_has_egl_extension(self->display, required_egl_extensions[i])) {
+            g_set_error(error, COG_PLATFORM_WPE_ERROR, COG_PLATFORM_WPE_ERROR_INIT, "EGL extension %s missing",
+                        required_egl_extensions[i]);
+            return NULL;
+        }
+    }
+
+    if (!eglBindAPI(EGL_OPENGL_ES_API)) {
+        g_set_error_literal(error, COG_PLATFORM_EGL_ERROR, eglGetError(), "eglBindAPI");
+        return NULL;
+    }
+
+    EGLConfig config = EGL_NO_CONFIG_KHR;
+    if (!epoxy_has_egl_extension(self->display, "EGL_KHR_no_config_context")) {
+        static const EGLint config_attr[] = {
+            EGL_RENDERABLE_TYPE,
+            EGL_OPENGL_ES2_BIT,
+            EGL_NONE,
+        };
+        EGLint matched = 0;
+        if (!eglChooseConfig(self->display, config_attr, &config, 1, &matched) || matched < 1) {
+            g_set_error_literal(error, COG_PLATFORM_WPE_ERROR, COG_PLATFORM_WPE_ERROR_INIT,
+                                "No suitable EGLConfig found");
+            return NULL;
+        }
+    }
+
+    static const EGLint context_attr[] = {
+        EGL_CONTEXT_CLIENT_VERSION,
+        2,
+        EGL_NONE,
+    };
+    self->context = eglCreateContext(self->display, config, EGL_NO_CONTEXT, context_attr);
+    if (self->context == EGL_NO_CONTEXT) {
+        g_set_error_literal(error, COG_PLATFORM_EGL_ERROR, eglGetError(), "eglCreateContext");
+        return NULL;
+    }
+
+    g_debug("%s: EGL %d.%d, %s", G_STRFUNC, major, minor, eglQueryString(self->display, EGL_VENDOR));
+    return g_steal_pointer(&self);
+}
+
+void
+cog_headless_egl_free(CogHeadlessEgl *self)
+{
+    if (!self)
+        return;
+
+    if (self->context != EGL_NO_CONTEXT) {
+        if (self->texture && eglMakeCurrent(self->display, EGL_NO_SURFACE, EGL_NO_SURFACE, self->context)) {
+            glDeleteFramebuffers(1, &self->framebuffer);
+            glDeleteTextures(1, &self->texture);
+            eglMakeCurrent(self->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        }
+        eglDestroyContext(self->display, self->context);
+    }
+
+    if (self->display != EGL_NO_DISPLAY)
+        eglTerminate(self->display);
+    eglReleaseThread();
+
+    g_free(self);
+}
+
+EGLDisplay
+cog_headless_egl_get_display(const CogHeadlessEgl *self)
+{
+    g_assert(self);
+    return self->display;
+}
+
+/*
+ * Reads the contents of an image into pixels, which must have room for
+ * width * height pixels in BGRA order (i.e. little endian ARGB8888), with
+ * rows laid out from top to bottom.
+ */
+bool
+cog_headless_egl_read_pixels(CogHeadlessEgl *self,
+                             EGLImage        image,
+                             uint32_t        width,
+                             uint32_t        height,
+                             uint8_t        *pixels,
+                             GError        **error)
+{
+    g_assert(self);
+
+    if (!eglMakeCurrent(self->display, EGL_NO_SURFACE, EGL_NO_SURFACE, self->context)) {
+        g_set_error_literal(error, COG_PLATFORM_EGL_ERROR, eglGetError(), "eglMakeCurrent");
+        return false;
+    }
+
+    if (!self->texture) {
+        glGenTextures(1, &self->texture);
+        glGenFramebuffers(1, &self->framebuffer);
+        self->read_bgra = epoxy_has_gl_extension("GL_EXT_read_format_bgra");
+        g_debug("%s: GL %s, BGRA read back %s", G_STRFUNC, glGetString(GL_RENDERER),
+                self->read_bgra ? "supported" : "unsupported");
+    }
+
+    /* Sampling the image through a framebuffer keeps its rows in memory order. */
+    glBindTexture(GL_TEXTURE_2D, self->texture);
+    glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, image);
+    glBindFramebuffer(GL_FRAMEBUFFER, self->framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, self->texture, 0);
+
+    const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        g_set_error(error, COG_PLATFORM_WPE_ERROR, COG_PLATFORM_WPE_ERROR_INIT,
+                    "Cannot read back image, framebuffer incomplete (%#04x)", status);
+        return false;
+    }
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, width, height, self->read_bgra ? GL_BGRA_EXT : GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+
+    if (!self->read_bgra) {
+        const size_t size = (size_t) width * height * 4;
+        for (size_t i = 0; i < size; i += 4) {
+            const uint8_t r = pixels[i];
+            pixels[i] = pixels[i + 2];
+            pixels[i + 2] = r;
+        }
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    return true;
+}
@@ -0,0 +1,38 @@
+/*
+ * cog-headless-egl.h
+ * Copyright (C) 2024 Igalia S.L.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <epoxy/egl.h>
+#include <glib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Surfaceless EGL display, which does not need a windowing system nor a
+ * GPU (Mesa provides one with llvmpipe), plus a GLES context used to read
+ * back the pixels of images exported by WebKit when they are needed.
+ */
+typedef struct _CogHeadlessEgl CogHeadlessEgl;
+
+CogHeadlessEgl *cog_headless_egl_new(GError **error);
+void            cog_headless_egl_free(CogHeadlessEgl *self);
+
+EGLDisplay cog_headless_egl_get_display(const CogHeadlessEgl *self);
+
+bool cog_headless_egl_read_pixels(CogHeadlessEgl *self,
+                                  EGLImage        image,
+                                  uint32_t        width,
+                                  uint32_t        height,
+                                  uint8_t        *pixels,
+                                  GError        **error);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(CogHeadlessEgl, cog_headless_egl_free)
+
+G_END_DECLS
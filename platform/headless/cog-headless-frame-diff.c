@@ -0,0 +1,147 @@
+/*
+ * cog-headless-frame-diff.c
+ * Copyright (C) 2024 Igalia S.L.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "cog-headless-frame-diff.h"
+
+#include "../common/cog-hash.h"
+
+#include <inttypes.h>
+#include <string.h>
+
+#define TILE_SIZE COG_HEADLESS_FRAME_DIFF_TILE_SIZE
+
+struct _CogHeadlessFrameDiff {
+    uint32_t   width;
+    uint32_t   height;
+    unsigned   tiles_x;
+    unsigned   tiles_y;
+    uint64_t  *hashes;
+    CogHash64 *state; /* One row of tiles. */
+};
+
+CogHeadlessFrameDiff *
+cog_headless_frame_diff_new(void)
+{
+    return g_new0(CogHeadlessFrameDiff, 1);
+}
+
+void
+cog_headless_frame_diff_free(CogHeadlessFrameDiff *self)
+{
+    if (!self)
+        return;
+
+    g_free(self->hashes);
+    g_free(self->state);
+    g_free(self);
+}
+
+static void
+frame_diff_resize(CogHeadlessFrameDiff *self, uint32_t width, uint32_t height)
+{
+    self->width = width;
+    self->height = height;
+    self->tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+    self->tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+
+    g_free(self->hashes);
+    self->hashes = g_new0(uint64_t, (size_t) self->tiles_x * self->tiles_y);
+    g_free(self->state);
+    self->state = g_new(CogHash64, self->tiles_x);
+
+    g_debug("%s: diff %p, %" PRIu32 "x%" PRIu32 " pixels, %ux%u tiles", G_STRFUNC, self, width, height,
+            self->tiles_x, self->tiles_y);
+}
+
+/*
+ * Adds a dirty span of tiles in a row. Spans which cover the same columns
+ * as one which ends right above are merged into it, which usually turns
+ * a changed region into a single rectangle.
+ */
+static void
+frame_diff_add_span(GArray *rects, int32_t x, int32_t y, int32_t width, int32_t height)
+{
+    for (unsigned i = 0; i < rects->len; i++) {
+        CogHeadlessFrameRect *r = &g_array_index(rects, CogHeadlessFrameRect, i);
+        if (r->x == x && r->width == width && r->y + r->height == y) {
+            r->height += height;
+            return;
+        }
+    }
+
+    const CogHeadlessFrameRect rect = {x, y, width, height};
+    g_array_append_val(rects, rect);
+}
+
+/*
+ * Compares a frame with the previous one. Returns the number of pixels in
+ * the changed tiles, which is zero if the frame did not change, and fills
+ * the rects array (if not NULL) with the regions which changed. Frames of
+ * a different size than the previous one are considered changed entirely.
+ */
+uint64_t
+cog_headless_frame_diff_update(CogHeadlessFrameDiff *self,
+                               const uint8_t        *data,
+                               uint32_t              width,
+                               uint32_t              height,
+                               uint32_t              stride,
+                               GArray               *rects)
+{
+    g_assert(self);
+
+    if (rects)
+        g_array_set_size(rects, 0);
+
+    const bool resized = width != self->width || height != self->height;
+    if (resized)
+        frame_diff_resize(self, width, height);
+
+    uint64_t dirty = 0;
+
+    for (unsigned ty = 0; ty < self->tiles_y; ty++) {
+        const uint32_t y = ty * TILE_SIZE;
+        const uint32_t tile_height = MIN(TILE_SIZE, height - y);
+
+        for (unsigned tx = 0; tx < self->tiles_x; tx++)
+            cog_hash64_init(&self->state[tx]);
+
+        for (uint32_t row = y; row < y + tile_height; row++) {
+            const uint8_t *p = data + (size_t) row * stride;
+            for (unsigned tx = 0; tx < self->tiles_x; tx++) {
+                const uint32_t x = tx * TILE_SIZE;
+                cog_hash64_update(&self->state[tx], p + x * 4, MIN(TILE_SIZE, width - x) * 4);
+            }
+        }
+
+        unsigned span_start = 0;
+        bool     in_span = false;
+
+        for (unsigned tx = 0; tx <= self->tiles_x; tx++) {
+            bool changed = false;
+            if (tx < self->tiles_x) {
+                uint64_t *hash = &self->hashes[(size_t) ty * self->tiles_x + tx];
+                uint64_t  value = cog_hash64_final(&self->state[tx]);
+                changed = resized || value != *hash;
+                *hash = value;
+            }
+
+            if (changed && !in_span) {
+                span_start = tx;
+                in_span = true;
+            } else if (!changed && in_span) {
+                const uint32_t x = span_start * TILE_SIZE;
+                const uint32_t span_width = MIN(tx * TILE_SIZE, width) - x;
+                dirty += (uint64_t) span_width * tile_height;
+                if (rects)
+                    frame_diff_add_span(rects, x, y, span_width, tile_height);
+                in_span = false;
+            }
+        }
+    }
+
+    return dirty;
+}
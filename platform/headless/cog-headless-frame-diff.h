@@ -0,0 +1,35 @@
+/*
+ * cog-headless-frame-diff.h
+ * Copyright (C) 2024 Igalia S.L.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include "cog-headless-frame-ring.h"
+
+G_BEGIN_DECLS
+
+#define COG_HEADLESS_FRAME_DIFF_TILE_SIZE 64
+
+/*
+ * Finds which parts of a frame changed since the previous one by keeping
+ * a 64-bit hash of each COG_HEADLESS_FRAME_DIFF_TILE_SIZE square tile of
+ * pixels, so that only the hashes are kept instead of a copy of the frame.
+ */
+typedef struct _CogHeadlessFrameDiff CogHeadlessFrameDiff;
+
+CogHeadlessFrameDiff *cog_headless_frame_diff_new(void);
+void                  cog_headless_frame_diff_free(CogHeadlessFrameDiff *self);
+
+uint64_t cog_headless_frame_diff_update(CogHeadlessFrameDiff *self,
+                                        const uint8_t        *data,
+                                        uint32_t              width,
+                                        uint32_t              height,
+                                        uint32_t              stride,
+                                        GArray               *rects);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(CogHeadlessFrameDiff, cog_headless_frame_diff_free)
+
+G_END_DECLS
@@ -0,0 +1,227 @@
+/*
+ * cog-headless-frame-ring.c
+ * Copyright (C) 2024 Igalia S.L.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#define _GNU_SOURCE
+
+#include "cog-headless-frame-ring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+struct _CogHeadlessFrameRing {
+    int                         fd;
+    size_t                      size;
+    CogHeadlessFrameRingHeader *header;
+    uint64_t                    frame;
+};
+
+static inline size_t
+frame_ring_header_size(unsigned n_slots)
+{
+    const size_t page_size = sysconf(_SC_PAGESIZE);
+    const size_t size = sizeof(CogHeadlessFrameRingHeader) + n_slots * sizeof(CogHeadlessFrameSlot);
+    return (size + page_size - 1) & ~(page_size - 1);
+}
+
+static int
+frame_ring_create_fd(const char *name)
+{
+    int fd;
+
+#ifdef HAVE_MEMFD_CREATE
+    if ((fd = memfd_create(name, MFD_CLOEXEC)) >= 0)
+        return fd;
+#endif /* HAVE_MEMFD_CREATE */
+
+    g_autofree char *path = NULL;
+    if ((fd = g_file_open_tmp("cog-frame-ring-XXXXXX", &path, NULL)) >= 0) {
+        unlink(path);
+        fcntl(fd, F_SETFD, fcntl(fd, F_GETFD) | FD_CLOEXEC);
+    }
+    return fd;
+}
+
+static bool
+frame_ring_map(CogHeadlessFrameRing *self, size_t size, GError **error)
+{
+    if (ftruncate(self->fd, size) == -1) {
+        int errsv = errno;
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errsv), "Cannot resize frame ring: %s",
+                    g_strerror(errsv));
+        return false;
+    }
+
+    void *header = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, self->fd, 0);
+    if (header == MAP_FAILED) {
+        int errsv = errno;
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errsv), "Cannot map frame ring: %s",
+                    g_strerror(errsv));
+        return false;
+    }
+
+    if (self->header)
+        munmap(self->header, self->size);
+
+    self->header = header;
+    self->size = size;
+    return true;
+}
+
+static bool
+frame_ring_layout(CogHeadlessFrameRing *self, uint64_t slot_size, GError **error)
+{
+    CogHeadlessFrameRingHeader *header = self->header;
+    const unsigned              n_slots = header->n_slots;
+
+    /* Odd generation: consumers must not trust the layout until it becomes even again. */
+    atomic_fetch_add_explicit(&header->generation, 1, memory_order_acq_rel);
+    atomic_store_explicit(&header->latest, 0, memory_order_release);
+
+    const bool ok = frame_ring_map(self, header->header_size + n_slots * slot_size, error);
+
+    header = self->header;
+    if (ok) {
+        header->slot_size = slot_size;
+        for (unsigned i = 0; i < n_slots; i++) {
+            atomic_store_explicit(&header->slots[i].sequence, 0, memory_order_relaxed);
+            header->slots[i].offset = header->header_size + i * slot_size;
+        }
+        g_debug("%s: ring %p, %u slots of %" G_GUINT64_FORMAT " bytes", G_STRFUNC, self, n_slots, slot_size);
+    }
+
+    atomic_fetch_add_explicit(&header->generation, 1, memory_order_acq_rel);
+    return ok;
+}
+
+static void
+frame_ring_set_rects(CogHeadlessFrameSlot *slot, const GArray *rects)
+{
+    if (!rects || !rects->len) {
+        slot->n_rects = 0;
+        return;
+    }
+
+    if (rects->len <= COG_HEADLESS_FRAME_RING_MAX_RECTS) {
+        slot->n_rects = rects->len;
+        memcpy(slot->rects, rects->data, rects->len * sizeof(CogHeadlessFrameRect));
+        return;
+    }
+
+    /* Too many to fit, report their bounding box instead. */
+    CogHeadlessFrameRect box = g_array_index(rects, CogHeadlessFrameRect, 0);
+    for (unsigned i = 1; i < rects->len; i++) {
+        const CogHeadlessFrameRect *r = &g_array_index(rects, CogHeadlessFrameRect, i);
+        const int32_t               x2 = MAX(box.x + box.width, r->x + r->width);
+        const int32_t               y2 = MAX(box.y + box.height, r->y + r->height);
+        box.x = MIN(box.x, r->x);
+        box.y = MIN(box.y, r->y);
+        box.width = x2 - box.x;
+        box.height = y2 - box.y;
+    }
+    slot->n_rects = 1;
+    slot->rects[0] = box;
+}
+
+CogHeadlessFrameRing *
+cog_headless_frame_ring_new(const char *name, unsigned n_slots, GError **error)
+{
+    g_return_val_if_fail(n_slots > 1, NULL);
+
+    g_autoptr(CogHeadlessFrameRing) self = g_new0(CogHeadlessFrameRing, 1);
+    if ((self->fd = frame_ring_create_fd(name)) == -1) {
+        int errsv = errno;
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errsv), "Cannot create frame ring: %s",
+                    g_strerror(errsv));
+        return NULL;
+    }
+
+    const size_t header_size = frame_ring_header_size(n_slots);
+    if (!frame_ring_map(self, header_size, error))
+        return NULL;
+
+    *self->header = (CogHeadlessFrameRingHeader){
+        .magic = COG_HEADLESS_FRAME_RING_MAGIC,
+        .version = COG_HEADLESS_FRAME_RING_VERSION,
+        .n_slots = n_slots,
+        .header_size = header_size,
+    };
+
+    return g_steal_pointer(&self);
+}
+
+void
+cog_headless_frame_ring_free(CogHeadlessFrameRing *self)
+{
+    if (!self)
+        return;
+
+    if (self->header)
+        munmap(self->header, self->size);
+    if (self->fd != -1)
+        close(self->fd);
+
+    g_free(self);
+}
+
+int
+cog_headless_frame_ring_get_fd(const CogHeadlessFrameRing *self)
+{
+    g_assert(self);
+    return self->fd;
+}
+
+uint64_t
+cog_headless_frame_ring_get_latest(const CogHeadlessFrameRing *self)
+{
+    g_assert(self);
+    return self->frame;
+}
+
+bool
+cog_headless_frame_ring_push(CogHeadlessFrameRing *self,
+                             const uint8_t        *data,
+                             uint32_t              width,
+                             uint32_t              height,
+                             uint32_t              stride,
+                             uint32_t              format,
+                             int64_t               timestamp,
+                             const GArray         *rects)
+{
+    g_assert(self);
+
+    const uint64_t frame_size = (uint64_t) stride * height;
+    if (G_UNLIKELY(frame_size > self->header->slot_size)) {
+        g_autoptr(GError) error = NULL;
+        if (!frame_ring_layout(self, frame_size, &error)) {
+            g_warning("Cannot grow frame ring to %" G_GUINT64_FORMAT " bytes per slot: %s", frame_size,
+                      error->message);
+            return false;
+        }
+    }
+
+    CogHeadlessFrameRingHeader *header = self->header;
+    const uint64_t              frame = ++self->frame;
+    CogHeadlessFrameSlot       *slot = &header->slots[frame % header->n_slots];
+
+    atomic_store_explicit(&slot->sequence, 2 * frame - 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    slot->width = width;
+    slot->height = height;
+    slot->stride = stride;
+    slot->format = format;
+    slot->timestamp = timestamp;
+    frame_ring_set_rects(slot, rects);
+    memcpy(((uint8_t *) header) + slot->offset, data, frame_size);
+
+    atomic_store_explicit(&slot->sequence, 2 * frame, memory_order_release);
+    atomic_store_explicit(&header->latest, frame, memory_order_release);
+    return true;
+}
@@ -0,0 +1,92 @@
+/*
+ * cog-headless-frame-ring.h
+ * Copyright (C) 2024 Igalia S.L.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Shared memory layout of a frame ring. The memory is laid out as a
+ * CogHeadlessFrameRingHeader, followed by n_slots CogHeadlessFrameSlot
+ * entries, followed by the pixel data of each slot at slot->offset.
+ *
+ * Publishing a frame uses a sequence lock per slot: the slot sequence
+ * is odd while pixels are being written, and set to 2 * frame number
+ * once the frame is complete. Afterwards header->latest is set to the
+ * frame number. Readers pick the slot at (latest % n_slots), check that
+ * its sequence is 2 * latest, use the pixels in place, and check again
+ * that the sequence has not changed. The header generation is odd while
+ * the ring is being resized, and readers must remap the memory when the
+ * value changes.
+ *
+ * Each slot lists the regions which changed since the previous frame.
+ * No rectangles (n_rects == 0) means that the whole frame changed, and
+ * readers which skipped frames must also treat the whole frame as new.
+ */
+
+#define COG_HEADLESS_FRAME_RING_MAGIC   0x52676f43 /* "CogR" */
+#define COG_HEADLESS_FRAME_RING_VERSION 2
+
+#define COG_HEADLESS_FRAME_RING_MAX_RECTS 32
+
+typedef struct {
+    int32_t x;
+    int32_t y;
+    int32_t width;
+    int32_t height;
+} CogHeadlessFrameRect;
+
+typedef struct {
+    _Atomic uint64_t sequence;
+    uint32_t         width;
+    uint32_t         height;
+    uint32_t         stride;
+    uint32_t         format; /* wl_shm_format */
+    int64_t          timestamp; /* Monotonic or virtual clock, in microseconds. */
+    uint64_t         offset;
+
+    uint32_t             n_rects;
+    uint32_t             reserved;
+    CogHeadlessFrameRect rects[COG_HEADLESS_FRAME_RING_MAX_RECTS];
+} CogHeadlessFrameSlot;
+
+typedef struct {
+    uint32_t             magic;
+    uint32_t             version;
+    uint32_t             n_slots;
+    uint32_t             header_size;
+    uint64_t             slot_size;
+    _Atomic uint64_t     generation;
+    _Atomic uint64_t     latest;
+    CogHeadlessFrameSlot slots[];
+} CogHeadlessFrameRingHeader;
+
+typedef struct _CogHeadlessFrameRing CogHeadlessFrameRing;
+
+CogHeadlessFrameRing *cog_headless_frame_ring_new(const char *name, unsigned n_slots, GError **error);
+void                  cog_headless_frame_ring_free(CogHeadlessFrameRing *self);
+
+int      cog_headless_frame_ring_get_fd(const CogHeadlessFrameRing *self);
+uint64_t cog_headless_frame_ring_get_latest(const CogHeadlessFrameRing *self);
+
+bool cog_headless_frame_ring_push(CogHeadlessFrameRing *self,
+                                  const uint8_t        *data,
+                                  uint32_t              width,
+                                  uint32_t              height,
+                                  uint32_t              stride,
+                                  uint32_t              format,
+                                  int64_t               timestamp,
+                                  const GArray         *rects);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(CogHeadlessFrameRing, cog_headless_frame_ring_free)
+
+G_END_DECLS
@@ -0,0 +1,131 @@
+/*
+ * cog-headless-frame-stats.c
+ * Copyright (C) 2024 Igalia S.L.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "cog-headless-frame-stats.h"
+
+static unsigned
+frame_stats_bucket(int64_t render_time)
+{
+    unsigned bucket = 0;
+    for (int64_t ms = render_time / 1000; ms > 0 && bucket < COG_HEADLESS_FRAME_STATS_BUCKETS - 1; ms >>= 1)
+        bucket++;
+    return bucket;
+}
+
+void
+cog_headless_frame_stats_init(CogHeadlessFrameStats *self)
+{
+    *self = (CogHeadlessFrameStats){
+        .first_export_time = -1,
+        .last_export_time = -1,
+        .complete_time = -1,
+        .render_time_min = G_MAXINT64,
+    };
+}
+
+void
+cog_headless_frame_stats_frame_exported(CogHeadlessFrameStats *self, int64_t now)
+{
+    if (self->first_export_time == -1)
+        self->first_export_time = now;
+    self->last_export_time = now;
+    self->frames++;
+
+    /* Time taken by WebKit to produce a frame after the previous one was completed. */
+    if (self->complete_time != -1) {
+        const int64_t render_time = now - self->complete_time;
+        self->render_samples++;
+        self->render_time_total += render_time;
+        self->render_time_min = MIN(self->render_time_min, render_time);
+        self->render_time_max = MAX(self->render_time_max, render_time);
+        self->histogram[frame_stats_bucket(render_time)]++;
+        self->complete_time = -1;
+    }
+}
+
+void
+cog_headless_frame_stats_frame_completed(CogHeadlessFrameStats *self, int64_t now)
+{
+    self->complete_time = now;
+}
+
+void
+cog_headless_frame_stats_frame_diffed(CogHeadlessFrameStats *self, uint64_t dirty_pixels, uint64_t total_pixels)
+{
+    self->diffed++;
+    if (!dirty_pixels)
+        self->unchanged++;
+
+    self->dirty_area_last = total_pixels ? (double) dirty_pixels / total_pixels : 0.0;
+    self->dirty_area_total += self->dirty_area_last;
+}
+
+double
+cog_headless_frame_stats_get_fps(const CogHeadlessFrameStats *self)
+{
+    if (self->frames < 2 || self->last_export_time <= self->first_export_time)
+        return 0.0;
+
+    return (self->frames - 1) * (double) G_USEC_PER_SEC / (self->last_export_time - self->first_export_time);
+}
+
+GVariant *
+cog_headless_frame_stats_to_variant(const CogHeadlessFrameStats *self)
+{
+    GVariantDict dict;
+    g_variant_dict_init(&dict, NULL);
+
+    g_variant_dict_insert(&dict, "frames", "t", self->frames);
+    g_variant_dict_insert(&dict, "fps", "d", cog_headless_frame_stats_get_fps(self));
+
+    if (self->render_samples) {
+        g_variant_dict_insert(&dict, "render-time-min", "x", self->render_time_min);
+        g_variant_dict_insert(&dict, "render-time-max", "x", self->render_time_max);
+        g_variant_dict_insert(&dict, "render-time-avg", "x", self->render_time_total / (int64_t) self->render_samples);
+    }
+
+    if (self->diffed) {
+        g_variant_dict_insert(&dict, "frames-unchanged", "t", self->unchanged);
+        g_variant_dict_insert(&dict, "dirty-area-last", "d", self->dirty_area_last);
+        g_variant_dict_insert(&dict, "dirty-area-avg", "d", self->dirty_area_total / self->diffed);
+    }
+
+    g_variant_dict_insert_value(&dict, "histogram",
+                                g_variant_new_fixed_array(G_VARIANT_TYPE_UINT64, self->histogram,
+                                                          G_N_ELEMENTS(self->histogram), sizeof(uint64_t)));
+
+    return g_variant_dict_end(&dict);
+}
+
+void
+cog_headless_frame_stats_print(const CogHeadlessFrameStats *self, const char *label)
+{
+    g_print("%s: %" G_GUINT64_FORMAT " frames, %.2f FPS\n", label, self->frames,
+            cog_headless_frame_stats_get_fps(self));
+
+    if (self->diffed) {
+        g_print("%s: %" G_GUINT64_FORMAT " unchanged frames, %.1f%% average dirty area\n", label, self->unchanged,
+                100.0 * self->dirty_area_total / self->diffed);
+    }
+
+    if (!self->render_samples)
+        return;
+
+    g_print("%s: render time min %.3f ms, avg %.3f ms, max %.3f ms\n", label, self->render_time_min / 1000.0,
+            self->render_time_total / 1000.0 / self->render_samples, self->render_time_max / 1000.0);
+
+    for (unsigned i = 0; i < G_N_ELEMENTS(self->histogram); i++) {
+        if (!self->histogram[i])
+            continue;
+
+        const unsigned low = i ? 1u << (i - 1) : 0;
+        if (i == G_N_ELEMENTS(self->histogram) - 1)
+            g_print("%s:   >= %4u ms: %" G_GUINT64_FORMAT "\n", label, low, self->histogram[i]);
+        else
+            g_print("%s:   %4u-%4u ms: %" G_GUINT64_FORMAT "\n", label, low, 1u << i, self->histogram[i]);
+    }
+}
@@ -0,0 +1,49 @@
+/*
+ * cog-headless-frame-stats.h
+ * Copyright (C) 2024 Igalia S.L.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <stdint.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Bucket 0 counts render times below 1 ms, bucket N counts render times
+ * in the [2^(N-1), 2^N) ms range, and the last bucket everything above.
+ */
+#define COG_HEADLESS_FRAME_STATS_BUCKETS 12
+
+typedef struct {
+    uint64_t frames;
+    int64_t  first_export_time;
+    int64_t  last_export_time;
+    int64_t  complete_time; /* -1 when no frame completion is pending. */
+
+    uint64_t render_samples;
+    int64_t  render_time_total;
+    int64_t  render_time_min;
+    int64_t  render_time_max;
+    uint64_t histogram[COG_HEADLESS_FRAME_STATS_BUCKETS];
+
+    /* Only updated when frames are compared with the previous one. */
+    uint64_t diffed;
+    uint64_t unchanged;
+    double   dirty_area_total; /* Sum of the changed fraction of each frame. */
+    double   dirty_area_last;
+} CogHeadlessFrameStats;
+
+void cog_headless_frame_stats_init(CogHeadlessFrameStats *self);
+void cog_headless_frame_stats_frame_exported(CogHeadlessFrameStats *self, int64_t now);
+void cog_headless_frame_stats_frame_completed(CogHeadlessFrameStats *self, int64_t now);
+void cog_headless_frame_stats_frame_diffed(CogHeadlessFrameStats *self, uint64_t dirty_pixels, uint64_t total_pixels);
+
+double    cog_headless_frame_stats_get_fps(const CogHeadlessFrameStats *self);
+GVariant *cog_headless_frame_stats_to_variant(const CogHeadlessFrameStats *self);
+void      cog_headless_frame_stats_print(const CogHeadlessFrameStats *self, const char *label);
+
+G_END_DECLS
@@ -0,0 +1,504 @@
+/*
+ * cog-headless-y4m.c
+ * Copyright (C) 2024 Igalia S.L.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#define _GNU_SOURCE
+
+#include "cog-headless-y4m.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#    include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#    include <arm_neon.h>
+#endif
+
+/*
+ * BT.601 limited range, in 8.8 fixed point:
+ *
+ *   Y =  (66 R + 129 G +  25 B + 128) / 256 + 16
+ *   U = (-38 R -  74 G + 112 B + 128) / 256 + 128
+ *   V = (112 R -  94 G -  18 B + 128) / 256 + 128
+ *
+ * All the intermediate values fit in 16 bits, which the SIMD paths rely on.
+ */
+
+static inline uint8_t
+rgb_to_y(int r, int g, int b)
+{
+    return ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+}
+
+static inline uint8_t
+rgb_to_u(int r, int g, int b)
+{
+    return ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+}
+
+static inline uint8_t
+rgb_to_v(int r, int g, int b)
+{
+    return ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+}
+
+/*
+ * Converts columns [x, width) of one or two rows. The second row may be
+ * NULL when the height is odd, in which case the first row is used alone
+ * for the chroma samples.
+ */
+static void
+convert_rows_scalar(const uint8_t *row0,
+                    const uint8_t *row1,
+                    uint32_t       x,
+                    uint32_t       width,
+                    uint8_t       *y0,
+                    uint8_t       *y1,
+                    uint8_t       *u,
+                    uint8_t       *v)
+{
+    for (; x < width; x += 2) {
+        int r = 0, g = 0, b = 0, n = 0;
+
+        for (uint32_t i = x; i < x + 2 && i < width; i++) {
+            const uint8_t *p = row0 + i * 4;
+            y0[i] = rgb_to_y(p[2], p[1], p[0]);
+            b += p[0], g += p[1], r += p[2], n++;
+
+            if (row1) {
+                p = row1 + i * 4;
+                y1[i] = rgb_to_y(p[2], p[1], p[0]);
+                b += p[0], g += p[1], r += p[2], n++;
+            }
+        }
+
+        r = (r + n / 2) / n;
+        g = (g + n / 2) / n;
+        b = (b + n / 2) / n;
+        u[x / 2] = rgb_to_u(r, g, b);
+        v[x / 2] = rgb_to_v(r, g, b);
+    }
+}
+
+#if defined(__SSE2__)
+
+/* Loads 8 BGRA pixels and returns each channel in 16-bit lanes. */
+static inline void
+sse2_load_bgr(const uint8_t *src, __m128i *b, __m128i *g, __m128i *r)
+{
+    const __m128i mask = _mm_set1_epi32(0xff);
+    const __m128i p0 = _mm_loadu_si128((const __m128i *) src);
+    const __m128i p1 = _mm_loadu_si128((const __m128i *) (src + 16));
+
+    *b = _mm_packs_epi32(_mm_and_si128(p0, mask), _mm_and_si128(p1, mask));
+    *g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 8), mask), _mm_and_si128(_mm_srli_epi32(p1, 8), mask));
+    *r = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 16), mask), _mm_and_si128(_mm_srli_epi32(p1, 16), mask));
+}
+
+static inline __m128i
+sse2_luma(__m128i b, __m128i g, __m128i r)
+{
+    /* Coefficients are positive and the sum is below 65536: unsigned 16-bit math is exact. */
+    __m128i y = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(66)), _mm_mullo_epi16(g, _mm_set1_epi16(129)));
+    y = _mm_add_epi16(y, _mm_mullo_epi16(b, _mm_set1_epi16(25)));
+    y = _mm_srli_epi16(_mm_add_epi16(y, _mm_set1_epi16(128)), 8);
+    return _mm_add_epi16(y, _mm_set1_epi16(16));
+}
+
+static inline __m128i
+sse2_chroma(__m128i b, __m128i g, __m128i r, int16_t cr, int16_t cg, int16_t cb)
+{
+    __m128i c = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(cr)), _mm_mullo_epi16(g, _mm_set1_epi16(cg)));
+    c = _mm_add_epi16(c, _mm_mullo_epi16(b, _mm_set1_epi16(cb)));
+    c = _mm_srai_epi16(_mm_add_epi16(c, _mm_set1_epi16(128)), 8);
+    return _mm_add_epi16(c, _mm_set1_epi16(128));
+}
+
+/* Sums pairs of adjacent 16-bit lanes of two vectors, then averages the 2x2 blocks. */
+static inline __m128i
+sse2_average(__m128i lo, __m128i hi)
+{
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i sum = _mm_packs_epi32(_mm_madd_epi16(lo, ones), _mm_madd_epi16(hi, ones));
+    return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+}
+
+/* Converts 16 columns of two rows: 32 luma samples, 8 of each chroma. */
+static inline void
+convert_block_simd(const uint8_t *row0, const uint8_t *row1, uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v)
+{
+    __m128i b00, g00, r00, b01, g01, r01, b10, g10, r10, b11, g11, r11;
+    sse2_load_bgr(row0, &b00, &g00, &r00);
+    sse2_load_bgr(row0 + 32, &b01, &g01, &r01);
+    sse2_load_bgr(row1, &b10, &g10, &r10);
+    sse2_load_bgr(row1 + 32, &b11, &g11, &r11);
+
+    _mm_storeu_si128((__m128i *) y0, _mm_packus_epi16(sse2_luma(b00, g00, r00), sse2_luma(b01, g01, r01)));
+    _mm_storeu_si128((__m128i *) y1, _mm_packus_epi16(sse2_luma(b10, g10, r10), sse2_luma(b11, g11, r11)));
+
+    const __m128i b = sse2_average(_mm_add_epi16(b00, b10), _mm_add_epi16(b01, b11));
+    const __m128i g = sse2_average(_mm_add_epi16(g00, g10), _mm_add_epi16(g01, g11));
+    const __m128i r = sse2_average(_mm_add_epi16(r00, r10), _mm_add_epi16(r01, r11));
+
+    const __m128i cu = sse2_chroma(b, g, r, -38, -74, 112);
+    const __m128i cv = sse2_chroma(b, g, r, 112, -94, -18);
+    _mm_storel_epi64((__m128i *) u, _mm_packus_epi16(cu, cu));
+    _mm_storel_epi64((__m128i *) v, _mm_packus_epi16(cv, cv));
+}
+
+#    define HAVE_CONVERT_BLOCK_SIMD 1
+
+#elif defined(__ARM_NEON)
+
+static inline uint8x8_t
+neon_luma(uint8x8_t b, uint8x8_t g, uint8x8_t r)
+{
+    uint16x8_t y = vmull_u8(r, vdup_n_u8(66));
+    y = vmlal_u8(y, g, vdup_n_u8(129));
+    y = vmlal_u8(y, b, vdup_n_u8(25));
+    return vadd_u8(vrshrn_n_u16(y, 8), vdup_n_u8(16));
+}
+
+static inline uint8x8_t
+neon_chroma(int16x8_t b, int16x8_t g, int16x8_t r, int16_t cr, int16_t cg, int16_t cb)
+{
+    int16x8_t c = vmulq_n_s16(r, cr);
+    c = vmlaq_n_s16(c, g, cg);
+    c = vmlaq_n_s16(c, b, cb);
+    c = vshrq_n_s16(vaddq_s16(c, vdupq_n_s16(128)), 8);
+    return vqmovun_s16(vaddq_s16(c, vdupq_n_s16(128)));
+}
+
+/* Converts 16 columns of two rows: 32 luma samples, 8 of each chroma. */
+static inline void
+convert_block_simd(const uint8_t *row0, const uint8_t *row1, uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v)
+{
+    const uint8x16x4_t p0 = vld4q_u8(row0);
+    const uint8x16x4_t p1 = vld4q_u8(row1);
+
+    vst1q_u8(y0, vcombine_u8(neon_luma(vget_low_u8(p0.val[0]), vget_low_u8(p0.val[1]), vget_low_u8(p0.val[2])),
+                             neon_luma(vget_high_u8(p0.val[0]), vget_high_u8(p0.val[1]), vget_high_u8(p0.val[2]))));
+    vst1q_u8(y1, vcombine_u8(neon_luma(vget_low_u8(p1.val[0]), vget_low_u8(p1.val[1]), vget_low_u8(p1.val[2])),
+                             neon_luma(vget_high_u8(p1.val[0]), vget_high_u8(p1.val[1]), vget_high_u8(p1.val[2]))));
+
+    const int16x8_t b = vreinterpretq_s16_u16(vrshrq_n_u16(vpadalq_u8(vpaddlq_u8(p0.val[0]), p1.val[0]), 2));
+    const int16x8_t g = vreinterpretq_s16_u16(vrshrq_n_u16(vpadalq_u8(vpaddlq_u8(p0.val[1]), p1.val[1]), 2));
+    const int16x8_t r = vreinterpretq_s16_u16(vrshrq_n_u16(vpadalq_u8(vpaddlq_u8(p0.val[2]), p1.val[2]), 2));
+
+    vst1_u8(u, neon_chroma(b, g, r, -38, -74, 112));
+    vst1_u8(v, neon_chroma(b, g, r, 112, -94, -18));
+}
+
+#    define HAVE_CONVERT_BLOCK_SIMD 1
+
+#endif /* __SSE2__ || __ARM_NEON */
+
+void
+cog_headless_convert_bgra_to_i420(const uint8_t *src,
+                                  uint32_t       src_stride,
+                                  uint32_t       width,
+                                  uint32_t       height,
+                                  uint8_t       *dst_y,
+                                  uint32_t       y_stride,
+                                  uint8_t       *dst_u,
+                                  uint8_t       *dst_v,
+                                  uint32_t       uv_stride)
+{
+    for (uint32_t row = 0; row < height; row += 2) {
+        const uint8_t *row0 = src + (size_t) row * src_stride;
+        uint8_t       *y0 = dst_y + (size_t) row * y_stride;
+        uint8_t       *u = dst_u + (size_t) (row / 2) * uv_stride;
+        uint8_t       *v = dst_v + (size_t) (row / 2) * uv_stride;
+
+        if (row + 1 == height) {
+            convert_rows_scalar(row0, NULL, 0, width, y0, NULL, u, v);
+            break;
+        }
+
+        const uint8_t *row1 = row0 + src_stride;
+        uint8_t       *y1 = y0 + y_stride;
+        uint32_t       x = 0;
+
+#ifdef HAVE_CONVERT_BLOCK_SIMD
+        for (; x + 16 <= width; x += 16)
+            convert_block_simd(row0 + x * 4, row1 + x * 4, y0 + x, y1 + x, u + x / 2, v + x / 2);
+#endif /* HAVE_CONVERT_BLOCK_SIMD */
+
+        convert_rows_scalar(row0, row1, x, width, y0, y1, u, v);
+    }
+}
+
+typedef struct {
+    uint8_t *data;
+    uint64_t index;
+} Y4mFrame;
+
+struct _CogHeadlessY4mWriter {
+    int      fd;
+    char    *path;
+    uint32_t width;
+    uint32_t height;
+    unsigned fps;
+    size_t   frame_size;
+    int64_t  first_timestamp;
+    uint64_t next_index;
+
+    GThread  *thread;
+    GMutex    lock;
+    GCond     cond;
+    bool      quit;
+    Y4mFrame *queue;
+    unsigned  n_buffers;
+    unsigned  head;
+    unsigned  count;
+
+    /* Owned by the writer thread. */
+    uint8_t *previous;
+    uint64_t previous_index;
+    bool     failed;
+
+    _Atomic uint64_t written;
+    _Atomic uint64_t dropped;
+};
+
+static bool
+y4m_write_all(CogHeadlessY4mWriter *self, const void *data, size_t size)
+{
+    const uint8_t *p = data;
+
+    while (size > 0) {
+        ssize_t n = write(self->fd, p, size);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            g_warning("Cannot write video to %s: %s", self->path, g_strerror(errno));
+            return false;
+        }
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool
+y4m_write_frame(CogHeadlessY4mWriter *self, const uint8_t *data)
+{
+    static const char frame_header[] = "FRAME\n";
+
+    if (!y4m_write_all(self, frame_header, sizeof(frame_header) - 1) || !y4m_write_all(self, data, self->frame_size))
+        return false;
+
+    atomic_fetch_add_explicit(&self->written, 1, memory_order_relaxed);
+    return true;
+}
+
+static void *
+y4m_writer_thread(void *data)
+{
+    CogHeadlessY4mWriter *self = data;
+
+    /*
+     * Writing to a pipe without readers raises SIGPIPE for the writing
+     * thread: keep it blocked here so that write() fails with EPIPE
+     * instead of terminating the process.
+     */
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+    char      header[128];
+    const int header_size = snprintf(header, sizeof header,
+                                     "YUV4MPEG2 W%" PRIu32 " H%" PRIu32 " F%u:1 Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n",
+                                     self->width, self->height, self->fps);
+    self->failed = !y4m_write_all(self, header, header_size);
+
+    g_mutex_lock(&self->lock);
+    for (;;) {
+        while (!self->count && !self->quit)
+            g_cond_wait(&self->cond, &self->lock);
+        if (!self->count)
+            break;
+
+        Y4mFrame *frame = &self->queue[self->head];
+        g_mutex_unlock(&self->lock);
+
+        if (!self->failed) {
+            /* Repeat the previous frame to fill gaps, e.g. while the page does not paint. */
+            for (uint64_t i = self->previous_index + 1; i < frame->index && !self->failed; i++)
+                self->failed = !y4m_write_frame(self, self->previous);
+            if (!self->failed)
+                self->failed = !y4m_write_frame(self, frame->data);
+        }
+
+        /* Keep the frame around for repeating it, and recycle the older buffer. */
+        uint8_t *previous = self->previous;
+        self->previous = frame->data;
+        self->previous_index = frame->index;
+
+        g_mutex_lock(&self->lock);
+        frame->data = previous;
+        self->head = (self->head + 1) % self->n_buffers;
+        self->count--;
+    }
+    g_mutex_unlock(&self->lock);
+
+    return NULL;
+}
+
+CogHeadlessY4mWriter *
+cog_headless_y4m_writer_new(const char *path,
+                            uint32_t    width,
+                            uint32_t    height,
+                            unsigned    fps,
+                            unsigned    n_buffers,
+                            GError    **error)
+{
+    g_return_val_if_fail(path, NULL);
+    g_return_val_if_fail(width > 0 && height > 0, NULL);
+    g_return_val_if_fail(fps > 0, NULL);
+    g_return_val_if_fail(n_buffers > 0, NULL);
+
+    int fd;
+    if (strcmp(path, "-") == 0) {
+        fd = dup(STDOUT_FILENO);
+    } else {
+        fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    }
+    if (fd == -1) {
+        int errsv = errno;
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errsv), "Cannot open %s: %s", path,
+                    g_strerror(errsv));
+        return NULL;
+    }
+
+    CogHeadlessY4mWriter *self = g_new0(CogHeadlessY4mWriter, 1);
+    self->fd = fd;
+    self->path = g_strdup(path);
+    self->width = width;
+    self->height = height;
+    self->fps = fps;
+    self->frame_size = (size_t) width * height + 2 * (size_t) ((width + 1) / 2) * ((height + 1) / 2);
+    self->first_timestamp = -1;
+
+    g_mutex_init(&self->lock);
+    g_cond_init(&self->cond);
+
+    self->n_buffers = n_buffers;
+    self->queue = g_new0(Y4mFrame, n_buffers);
+    for (unsigned i = 0; i < n_buffers; i++)
+        self->queue[i].data = g_malloc(self->frame_size);
+    self->previous = g_malloc(self->frame_size);
+
+    self->thread = g_thread_new("cog: y4m writer", y4m_writer_thread, self);
+
+    g_debug("%s: writer %p, %" PRIu32 "x%" PRIu32 " at %u fps to %s, %u buffers", G_STRFUNC, self, width, height, fps,
+            path, n_buffers);
+    return self;
+}
+
+void
+cog_headless_y4m_writer_free(CogHeadlessY4mWriter *self)
+{
+    if (!self)
+        return;
+
+    g_mutex_lock(&self->lock);
+    self->quit = true;
+    g_cond_signal(&self->cond);
+    g_mutex_unlock(&self->lock);
+
+    /* Pending frames are written before the thread exits. */
+    g_thread_join(self->thread);
+
+    g_debug("%s: writer %p, %" G_GUINT64_FORMAT " frames written, %" G_GUINT64_FORMAT " dropped", G_STRFUNC, self,
+            cog_headless_y4m_writer_get_written(self), cog_headless_y4m_writer_get_dropped(self));
+
+    for (unsigned i = 0; i < self->n_buffers; i++)
+        g_free(self->queue[i].data);
+    g_free(self->queue);
+    g_free(self->previous);
+
+    g_cond_clear(&self->cond);
+    g_mutex_clear(&self->lock);
+
+    close(self->fd);
+    g_free(self->path);
+    g_free(self);
+}
+
+bool
+cog_headless_y4m_writer_push(CogHeadlessY4mWriter *self,
+                             const uint8_t        *data,
+                             uint32_t              width,
+                             uint32_t              height,
+                             uint32_t              stride,
+                             int64_t               timestamp)
+{
+    g_assert(self);
+
+    if (self->first_timestamp < 0)
+        self->first_timestamp = timestamp;
+
+    /* Frame slot in the output stream, rounded to the nearest frame interval. */
+    const uint64_t elapsed = MAX(timestamp - self->first_timestamp, 0);
+    uint64_t       index = (elapsed * self->fps + G_USEC_PER_SEC / 2) / G_USEC_PER_SEC + 1;
+    if (index < self->next_index)
+        index = self->next_index;
+
+    g_mutex_lock(&self->lock);
+    if (self->count == self->n_buffers) {
+        g_mutex_unlock(&self->lock);
+        atomic_fetch_add_explicit(&self->dropped, 1, memory_order_relaxed);
+        return false;
+    }
+    /* The writer thread does not touch the slot past the last queued one. */
+    Y4mFrame *frame = &self->queue[(self->head + self->count) % self->n_buffers];
+    g_mutex_unlock(&self->lock);
+
+    const uint32_t uv_stride = (self->width + 1) / 2;
+    uint8_t       *y = frame->data;
+    uint8_t       *u = y + (size_t) self->width * self->height;
+    uint8_t       *v = u + (size_t) uv_stride * ((self->height + 1) / 2);
+
+    /* The stream size is fixed: crop larger frames, and pad smaller ones with black. */
+    if (width < self->width || height < self->height) {
+        memset(y, 16, (size_t) self->width * self->height);
+        memset(u, 128, (size_t) 2 * uv_stride * ((self->height + 1) / 2));
+    }
+    cog_headless_convert_bgra_to_i420(data, stride, MIN(width, self->width), MIN(height, self->height), y, self->width,
+                                      u, v, uv_stride);
+    frame->index = index;
+    self->next_index = index + 1;
+
+    g_mutex_lock(&self->lock);
+    self->count++;
+    g_cond_signal(&self->cond);
+    g_mutex_unlock(&self->lock);
+    return true;
+}
+
+uint64_t
+cog_headless_y4m_writer_get_written(CogHeadlessY4mWriter *self)
+{
+    g_assert(self);
+    return atomic_load_explicit(&self->written, memory_order_relaxed);
+}
+
+uint64_t
+cog_headless_y4m_writer_get_dropped(CogHeadlessY4mWriter *self)
+{
+    g_assert(self);
+    return atomic_load_explicit(&self->dropped, memory_order_relaxed);
+}
@@ -0,0 +1,60 @@
+/*
+ * cog-headless-y4m.h
+ * Copyright (C) 2024 Igalia S.L.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Converts BGRA pixels (i.e. little endian ARGB8888/XRGB8888) to planar
+ * I420 using BT.601 limited range coefficients. Chroma samples are the
+ * average of each 2x2 block of pixels. Uses SSE2 or NEON when available.
+ */
+void cog_headless_convert_bgra_to_i420(const uint8_t *src,
+                                       uint32_t       src_stride,
+                                       uint32_t       width,
+                                       uint32_t       height,
+                                       uint8_t       *dst_y,
+                                       uint32_t       y_stride,
+                                       uint8_t       *dst_u,
+                                       uint8_t       *dst_v,
+                                       uint32_t       uv_stride);
+
+/*
+ * Writes frames as a YUV4MPEG2 stream from a separate thread. Frames are
+ * converted into one of a fixed number of buffers on the calling thread,
+ * and frames are dropped when all the buffers are waiting to be written.
+ * Frame timestamps are used to repeat frames when there are gaps, so the
+ * output keeps a constant frame rate.
+ */
+typedef struct _CogHeadlessY4mWriter CogHeadlessY4mWriter;
+
+CogHeadlessY4mWriter *cog_headless_y4m_writer_new(const char *path,
+                                                  uint32_t    width,
+                                                  uint32_t    height,
+                                                  unsigned    fps,
+                                                  unsigned    n_buffers,
+                                                  GError    **error);
+void                  cog_headless_y4m_writer_free(CogHeadlessY4mWriter *self);
+
+bool cog_headless_y4m_writer_push(CogHeadlessY4mWriter *self,
+                                  const uint8_t        *data,
+                                  uint32_t              width,
+                                  uint32_t              height,
+                                  uint32_t              stride,
+                                  int64_t               timestamp);
+
+uint64_t cog_headless_y4m_writer_get_written(CogHeadlessY4mWriter *self);
+uint64_t cog_headless_y4m_writer_get_dropped(CogHeadlessY4mWriter *self);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(CogHeadlessY4mWriter, cog_headless_y4m_writer_free)
+
+G_END_DECLS
@@ -6,16 +6,69 @@
  */
 
 #include "../../core/cog.h"
+#include "cog-headless-egl.h"
+#include "cog-headless-frame-diff.h"
+#include "cog-headless-frame-ring.h"
+#include "cog-headless-frame-stats.h"
+#include "cog-headless-y4m.h"
 #include <errno.h>
 #include <glib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <wayland-server.h>
+#include <wpe/fdo-egl.h>
 #include <wpe/fdo.h>
 #include <wpe/unstable/fdo-shm.h>
 
+typedef enum {
+    COG_HEADLESS_CAPTURE_NONE,
+    COG_HEADLESS_CAPTURE_RING,
+    COG_HEADLESS_CAPTURE_Y4M,
+} CogHeadlessCaptureMode;
+
 struct _CogHeadlessView {
     CogView parent;
 
     bool                                    frame_ack_pending;
     struct wpe_view_backend_exportable_fdo *exportable;
+
+    CogHeadlessFrameRing *frame_ring;
+    CogHeadlessY4mWriter *y4m_writer;
+    char                 *y4m_path;
+    CogHeadlessFrameDiff *frame_diff;
+    GArray               *dirty_rects; /* CogHeadlessFrameRect */
+    uint8_t              *readback;
+    size_t                readback_size;
+
+    /* Copy of the last frame, in BGRA with rows tightly packed. */
+    bool     keep_last_frame;
+    uint8_t *last_frame;
+    size_t   last_frame_size;
+    uint32_t last_frame_width;
+    uint32_t last_frame_height;
+
+    CogHeadlessFrameStats stats;
+    bool                  print_stats;
+
+    uint32_t width;
+    uint32_t height;
+    double   device_scale;
+};
+
+enum {
+    VIEW_PROP_0,
+    VIEW_PROP_CAPTURE_FD,
+    VIEW_PROP_FRAME_STATS,
+    VIEW_PROP_WIDTH,
+    VIEW_PROP_HEIGHT,
+    VIEW_PROP_DEVICE_SCALE_FACTOR,
+    VIEW_PROP_KEEP_LAST_FRAME,
+    VIEW_N_PROPERTIES,
+};
+
+static GParamSpec *s_view_properties[VIEW_N_PROPERTIES] = {
+    NULL,
 };
 
 G_DECLARE_FINAL_TYPE(CogHeadlessView, cog_headless_view, COG, HEADLESS_VIEW, CogView)
@@ -29,7 +82,40 @@ struct _CogHeadlessPlatform {
     CogPlatform parent;
 
     unsigned max_fps;
-    unsigned tick_source;
+    bool     unthrottled;
+    bool     export_egl;
+
+    /* Defaults for views which do not set their own size or scale. */
+    unsigned view_width;
+    unsigned view_height;
+    double   device_scale;
+
+    /*
+     * Frame completions are aligned to a virtual vsync grid which starts
+     * at vsync_base and has one tick every frame_interval microseconds.
+     * The tick source is only armed while there are frames pending.
+     */
+    GSource *tick_source;
+    int64_t  vsync_base;
+    int64_t  frame_interval;
+
+    /* Exported images are read from the GPU only when frames are captured. */
+    CogHeadlessEgl *egl;
+
+    struct {
+        uint64_t wakeups;
+        uint64_t frames;
+        uint64_t readbacks;
+        int64_t  readback_time;
+    } stats;
+
+    struct {
+        CogHeadlessCaptureMode mode;
+        unsigned               slots;
+        char                  *path;
+        unsigned               n_views;
+        bool                   diff;
+    } capture;
 
     GPtrArray *viewports; /* CogViewport */
 };
@@ -43,11 +129,190 @@ G_DEFINE_DYNAMIC_TYPE_EXTENDED(
     0,
     g_io_extension_point_implement(COG_MODULES_PLATFORM_EXTENSION_POINT, g_define_type_id, "headless", 100);)
 
+static void
+cog_headless_view_record_frame(CogHeadlessView     *view,
+                               CogHeadlessPlatform *platform,
+                               const uint8_t       *data,
+                               uint32_t             width,
+                               uint32_t             height,
+                               uint32_t             stride,
+                               int64_t              timestamp)
+{
+    /* The stream size is that of the first frame, later ones are cropped or padded. */
+    if (!view->y4m_writer) {
+        g_autoptr(GError) error = NULL;
+        view->y4m_writer = cog_headless_y4m_writer_new(view->y4m_path, width, height, platform->max_fps,
+                                                       platform->capture.slots, &error);
+        if (!view->y4m_writer) {
+            g_warning("View %p: video recording disabled, %s", view, error->message);
+            g_clear_pointer(&view->y4m_path, g_free);
+            return;
+        }
+    }
+
+    /* Never blocks: the frame is dropped if the writer thread is behind. */
+    if (!cog_headless_y4m_writer_push(view->y4m_writer, data, width, height, stride, timestamp))
+        g_debug("%s: view %p, writer busy, frame dropped", G_STRFUNC, view);
+}
+
+static inline bool
+cog_headless_view_wants_pixels(CogHeadlessView *view)
+{
+    return view->frame_ring || view->y4m_path || view->frame_diff || view->keep_last_frame;
+}
+
+static void
+cog_headless_view_keep_frame(CogHeadlessView *view, const uint8_t *data, uint32_t width, uint32_t height,
+                             uint32_t stride)
+{
+    const size_t row_size = (size_t) width * 4;
+    const size_t size = row_size * height;
+    if (size > view->last_frame_size) {
+        g_free(view->last_frame);
+        view->last_frame = g_malloc(size);
+        view->last_frame_size = size;
+    }
+
+    if (stride == row_size) {
+        memcpy(view->last_frame, data, size);
+    } else {
+        for (uint32_t y = 0; y < height; y++)
+            memcpy(view->last_frame + y * row_size, data + (size_t) y * stride, row_size);
+    }
+
+    view->last_frame_width = width;
+    view->last_frame_height = height;
+}
+
+static void
+cog_headless_view_capture_frame(CogHeadlessView     *view,
+                                CogHeadlessPlatform *platform,
+                                const uint8_t       *data,
+                                uint32_t             width,
+                                uint32_t             height,
+                                uint32_t             stride,
+                                uint32_t             format,
+                                int64_t              timestamp)
+{
+    if (view->keep_last_frame)
+        cog_headless_view_keep_frame(view, data, width, height, stride);
+
+    if (view->frame_diff) {
+        const uint64_t dirty =
+            cog_headless_frame_diff_update(view->frame_diff, data, width, height, stride, view->dirty_rects);
+        cog_headless_frame_stats_frame_diffed(&view->stats, dirty, (uint64_t) width * height);
+
+        /* Consumers already have the same pixels from the previous frame. */
+        if (!dirty)
+            return;
+    }
+
+    if (view->frame_ring)
+        cog_headless_frame_ring_push(view->frame_ring, data, width, height, stride, format, timestamp,
+                                     view->dirty_rects);
+    if (view->y4m_path) {
+        if (format == WL_SHM_FORMAT_ARGB8888 || format == WL_SHM_FORMAT_XRGB8888) {
+            cog_headless_view_record_frame(view, platform, data, width, height, stride, timestamp);
+        } else {
+            static bool warning_emitted = false;
+            if (!warning_emitted) {
+                g_warning("Cannot record frames with format %#" PRIx32 ", video will be missing frames", format);
+                warning_emitted = true;
+            }
+        }
+    }
+}
+
+static void
+cog_headless_view_complete_frame(CogHeadlessView *view, CogHeadlessPlatform *platform)
+{
+    view->frame_ack_pending = false;
+    wpe_view_backend_exportable_fdo_dispatch_frame_complete(view->exportable);
+    cog_headless_frame_stats_frame_completed(&view->stats, g_get_monotonic_time());
+    platform->stats.frames++;
+}
+
+static void cog_headless_platform_schedule_tick(CogHeadlessPlatform *self);
+
+/*
+ * In unthrottled mode frames are stamped using a virtual clock which
+ * advances exactly one frame interval per frame, which makes captured
+ * output independent of how fast frames are actually produced.
+ */
+static inline int64_t
+cog_headless_view_frame_timestamp(CogHeadlessView *view, CogHeadlessPlatform *platform, int64_t now)
+{
+    return platform->unthrottled ? (view->stats.frames - 1) * platform->frame_interval : now;
+}
+
+static void
+cog_headless_view_frame_done(CogHeadlessView *view, CogHeadlessPlatform *platform)
+{
+    if (platform->unthrottled) {
+        cog_headless_view_complete_frame(view, platform);
+    } else {
+        view->frame_ack_pending = true;
+        cog_headless_platform_schedule_tick(platform);
+    }
+}
+
 static void on_export_shm_buffer(void* data, struct wpe_fdo_shm_exported_buffer* buffer)
 {
-    CogHeadlessView *view = data;
+    CogHeadlessView     *view = data;
+    CogHeadlessPlatform *platform = COG_HEADLESS_PLATFORM(cog_platform_get());
+
+    const int64_t now = g_get_monotonic_time();
+    cog_headless_frame_stats_frame_exported(&view->stats, now);
+
+    if (cog_headless_view_wants_pixels(view)) {
+        struct wl_shm_buffer *shm_buffer = wpe_fdo_shm_exported_buffer_get_shm_buffer(buffer);
+        wl_shm_buffer_begin_access(shm_buffer);
+        cog_headless_view_capture_frame(view, platform, wl_shm_buffer_get_data(shm_buffer),
+                                        wl_shm_buffer_get_width(shm_buffer), wl_shm_buffer_get_height(shm_buffer),
+                                        wl_shm_buffer_get_stride(shm_buffer), wl_shm_buffer_get_format(shm_buffer),
+                                        cog_headless_view_frame_timestamp(view, platform, now));
+        wl_shm_buffer_end_access(shm_buffer);
+    }
+
     wpe_view_backend_exportable_fdo_dispatch_release_shm_exported_buffer(view->exportable, buffer);
-    view->frame_ack_pending = true;
+    cog_headless_view_frame_done(view, platform);
+}
+
+static void
+on_export_fdo_egl_image(void *data, struct wpe_fdo_egl_exported_image *image)
+{
+    CogHeadlessView     *view = data;
+    CogHeadlessPlatform *platform = COG_HEADLESS_PLATFORM(cog_platform_get());
+
+    const int64_t now = g_get_monotonic_time();
+    cog_headless_frame_stats_frame_exported(&view->stats, now);
+
+    /* Without consumers the image is released untouched, which is as fast as it gets. */
+    if (cog_headless_view_wants_pixels(view)) {
+        const uint32_t width = wpe_fdo_egl_exported_image_get_width(image);
+        const uint32_t height = wpe_fdo_egl_exported_image_get_height(image);
+        const size_t   size = (size_t) width * height * 4;
+        if (size > view->readback_size) {
+            g_free(view->readback);
+            view->readback = g_malloc(size);
+            view->readback_size = size;
+        }
+
+        g_autoptr(GError) error = NULL;
+        if (cog_headless_egl_read_pixels(platform->egl, wpe_fdo_egl_exported_image_get_egl_image(image), width,
+                                         height, view->readback, &error)) {
+            platform->stats.readbacks++;
+            platform->stats.readback_time += g_get_monotonic_time() - now;
+            cog_headless_view_capture_frame(view, platform, view->readback, width, height, width * 4,
+                                            WL_SHM_FORMAT_ARGB8888,
+                                            cog_headless_view_frame_timestamp(view, platform, now));
+        } else {
+            g_warning("View %p: %s", view, error->message);
+        }
+    }
+
+    wpe_view_backend_exportable_fdo_egl_dispatch_release_exported_image(view->exportable, image);
+    cog_headless_view_frame_done(view, platform);
 }
 
 static void
@@ -66,18 +331,307 @@ cog_headless_view_create_backend(CogView *view)
     static const struct wpe_view_backend_exportable_fdo_client client = {
         .export_shm_buffer = on_export_shm_buffer,
     };
+    static const struct wpe_view_backend_exportable_fdo_egl_client egl_client = {
+        .export_fdo_egl_image = on_export_fdo_egl_image,
+    };
+
+    CogHeadlessPlatform *platform = COG_HEADLESS_PLATFORM(cog_platform_get());
+    if (platform->capture.mode == COG_HEADLESS_CAPTURE_RING) {
+        g_autoptr(GError) error = NULL;
+        if ((self->frame_ring = cog_headless_frame_ring_new("cog-headless-frames", platform->capture.slots, &error))) {
+            g_message("View %p: capturing frames into /proc/%d/fd/%d", self, getpid(),
+                      cog_headless_frame_ring_get_fd(self->frame_ring));
+        } else {
+            g_warning("View %p: frame capture disabled, %s", self, error->message);
+        }
+    } else if (platform->capture.mode == COG_HEADLESS_CAPTURE_Y4M) {
+        /* Each additional view records into its own file. */
+        if (platform->capture.n_views++ == 0)
+            self->y4m_path = g_strdup(platform->capture.path);
+        else
+            self->y4m_path = g_strdup_printf("%s.%u", platform->capture.path, platform->capture.n_views - 1);
+        g_message("View %p: recording video into %s", self, self->y4m_path);
+    }
+
+    if (platform->capture.diff) {
+        self->frame_diff = cog_headless_frame_diff_new();
+        self->dirty_rects = g_array_new(FALSE, FALSE, sizeof(CogHeadlessFrameRect));
+    }
 
-    self->exportable = wpe_view_backend_exportable_fdo_create(&client, self, 800, 600);
+    /* Statistics go to the standard output, which may be used for the recording. */
+    self->print_stats = platform->unthrottled && g_strcmp0(self->y4m_path, "-") != 0;
+
+    g_debug("%s: view %p, %" PRIu32 "x%" PRIu32 " @ %.2fx", G_STRFUNC, self, self->width, self->height,
+            self->device_scale);
+    if (platform->egl)
+        self->exportable = wpe_view_backend_exportable_fdo_egl_create(&egl_client, self, self->width, self->height);
+    else
+        self->exportable = wpe_view_backend_exportable_fdo_create(&client, self, self->width, self->height);
 
     struct wpe_view_backend *view_backend = wpe_view_backend_exportable_fdo_get_view_backend(self->exportable);
     return webkit_web_view_backend_new(view_backend, (GDestroyNotify) on_cog_headless_view_backend_destroy, self);
 }
 
+static void
+cog_headless_view_resize(CogHeadlessView *self)
+{
+    /* Before the backend is created the new size will be used to create it. */
+    if (!self->exportable)
+        return;
+
+    struct wpe_view_backend *backend = wpe_view_backend_exportable_fdo_get_view_backend(self->exportable);
+    wpe_view_backend_dispatch_set_size(backend, self->width, self->height);
+    wpe_view_backend_dispatch_set_device_scale_factor(backend, self->device_scale);
+
+    g_debug("%s: view %p, %" PRIu32 "x%" PRIu32 " @ %.2fx", G_STRFUNC, self, self->width, self->height,
+            self->device_scale);
+}
+
+static void
+cog_headless_view_set_property(GObject *object, unsigned prop_id, const GValue *value, GParamSpec *pspec)
+{
+    CogHeadlessView     *self = COG_HEADLESS_VIEW(object);
+    CogHeadlessPlatform *platform = COG_HEADLESS_PLATFORM(cog_platform_get());
+
+    /* Zero values pick the platform defaults. */
+    switch (prop_id) {
+    case VIEW_PROP_WIDTH:
+        self->width = g_value_get_uint(value);
+        if (!self->width)
+            self->width = platform->view_width;
+        break;
+    case VIEW_PROP_HEIGHT:
+        self->height = g_value_get_uint(value);
+        if (!self->height)
+            self->height = platform->view_height;
+        break;
+    case VIEW_PROP_DEVICE_SCALE_FACTOR:
+        self->device_scale = g_value_get_double(value);
+        if (self->device_scale == 0.0)
+            self->device_scale = platform->device_scale;
+        break;
+    case VIEW_PROP_KEEP_LAST_FRAME:
+        self->keep_last_frame = g_value_get_boolean(value);
+        if (!self->keep_last_frame) {
+            g_clear_pointer(&self->last_frame, g_free);
+            self->last_frame_size = 0;
+            self->last_frame_width = self->last_frame_height = 0;
+        }
+        return;
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+        return;
+    }
+
+    cog_headless_view_resize(self);
+}
+
+static void
+cog_headless_view_get_property(GObject *object, unsigned prop_id, GValue *value, GParamSpec *pspec)
+{
+    CogHeadlessView *self = COG_HEADLESS_VIEW(object);
+    switch (prop_id) {
+    case VIEW_PROP_CAPTURE_FD:
+        g_value_set_int(value, self->frame_ring ? cog_headless_frame_ring_get_fd(self->frame_ring) : -1);
+        break;
+    case VIEW_PROP_FRAME_STATS:
+        g_value_take_variant(value, cog_headless_frame_stats_to_variant(&self->stats));
+        break;
+    case VIEW_PROP_WIDTH:
+        g_value_set_uint(value, self->width);
+        break;
+    case VIEW_PROP_HEIGHT:
+        g_value_set_uint(value, self->height);
+        break;
+    case VIEW_PROP_DEVICE_SCALE_FACTOR:
+        g_value_set_double(value, self->device_scale);
+        break;
+    case VIEW_PROP_KEEP_LAST_FRAME:
+        g_value_set_boolean(value, self->keep_last_frame);
+        break;
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    }
+}
+
+static void
+cog_headless_view_constructed(GObject *object)
+{
+    G_OBJECT_CLASS(cog_headless_view_parent_class)->constructed(object);
+
+    /* The backend needs to be attached to the web view to apply the scale. */
+    CogHeadlessView *self = COG_HEADLESS_VIEW(object);
+    if (self->device_scale != 1.0)
+        cog_headless_view_resize(self);
+}
+
+static void
+cog_headless_view_finalize(GObject *object)
+{
+    CogHeadlessView *self = COG_HEADLESS_VIEW(object);
+
+    if (self->print_stats) {
+        g_autofree char *label = g_strdup_printf("view %p", self);
+        cog_headless_frame_stats_print(&self->stats, label);
+    }
+
+    g_clear_pointer(&self->frame_ring, cog_headless_frame_ring_free);
+    g_clear_pointer(&self->y4m_writer, cog_headless_y4m_writer_free);
+    g_clear_pointer(&self->y4m_path, g_free);
+    g_clear_pointer(&self->frame_diff, cog_headless_frame_diff_free);
+    g_clear_pointer(&self->dirty_rects, g_array_unref);
+    g_clear_pointer(&self->readback, g_free);
+    g_clear_pointer(&self->last_frame, g_free);
+
+    G_OBJECT_CLASS(cog_headless_view_parent_class)->finalize(object);
+}
+
+static gboolean
+cog_headless_view_write_snapshot(CogHeadlessView *self, const char *path)
+{
+    if (!self->last_frame_width) {
+        g_warning("View %p: no frame available to write into %s", self, path);
+        return FALSE;
+    }
+
+    /* Portable arbitrary map (PAM), which stores pixels as RGBA. */
+    const uint32_t width = self->last_frame_width;
+    const uint32_t height = self->last_frame_height;
+    g_autoptr(GByteArray) pam = g_byte_array_sized_new(64 + width * height * 4);
+
+    g_autofree char *header = g_strdup_printf("P7\nWIDTH %" PRIu32 "\nHEIGHT %" PRIu32
+                                              "\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n",
+                                              width, height);
+    const size_t     header_size = strlen(header);
+    g_byte_array_set_size(pam, header_size + (size_t) width * height * 4);
+    memcpy(pam->data, header, header_size);
+
+    const uint8_t *src = self->last_frame;
+    uint8_t       *dst = pam->data + header_size;
+    for (size_t i = 0; i < (size_t) width * height * 4; i += 4) {
+        dst[i] = src[i + 2];
+        dst[i + 1] = src[i + 1];
+        dst[i + 2] = src[i];
+        dst[i + 3] = src[i + 3];
+    }
+
+    g_autoptr(GError) error = NULL;
+    if (!g_file_set_contents(path, (const char *) pam->data, pam->len, &error)) {
+        g_warning("View %p: cannot write snapshot, %s", self, error->message);
+        return FALSE;
+    }
+
+    g_debug("%s: view %p, %" PRIu32 "x%" PRIu32 " into %s", G_STRFUNC, self, width, height, path);
+    return TRUE;
+}
+
 static void
 cog_headless_view_class_init(CogHeadlessViewClass *klass)
 {
+    GObjectClass *object_class = G_OBJECT_CLASS(klass);
+    object_class->constructed = cog_headless_view_constructed;
+    object_class->finalize = cog_headless_view_finalize;
+    object_class->set_property = cog_headless_view_set_property;
+    object_class->get_property = cog_headless_view_get_property;
+
     CogViewClass *view_class = COG_VIEW_CLASS(klass);
     view_class->create_backend = cog_headless_view_create_backend;
+
+    /**
+     * CogHeadlessView:capture-fd:
+     *
+     * File descriptor of the shared memory frame ring where rendered frames
+     * are captured, or `-1` if frame capture is disabled. The memory layout
+     * is described in `cog-headless-frame-ring.h`.
+     */
+    s_view_properties[VIEW_PROP_CAPTURE_FD] =
+        g_param_spec_int("capture-fd", "Capture file descriptor", "File descriptor of the captured frames ring", -1,
+                         G_MAXINT, -1, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+    /**
+     * CogHeadlessView:frame-stats:
+     *
+     * Frame statistics for the view, as a dictionary (`a{sv}`) with the
+     * following entries:
+     *
+     * - `frames` (`t`): Number of frames produced.
+     * - `fps` (`d`): Average frames per second produced.
+     * - `render-time-min`, `render-time-avg`, `render-time-max` (`x`):
+     *   Time in microseconds taken to produce a frame after the previous
+     *   one was completed. Missing if less than two frames were produced.
+     * - `histogram` (`at`): Render time histogram. The first bucket counts
+     *   times below 1 ms, and each following one the range up to twice
+     *   its lower bound; the last bucket counts times above 1024 ms.
+     * - `frames-unchanged` (`t`): Number of frames identical to the previous
+     *   one. Only present when frame differences are being tracked.
+     * - `dirty-area-last`, `dirty-area-avg` (`d`): Fraction of the frame
+     *   area which changed in the last frame, and on average. Only present
+     *   when frame differences are being tracked.
+     */
+    s_view_properties[VIEW_PROP_FRAME_STATS] =
+        g_param_spec_variant("frame-stats", "Frame statistics", "Frame counters and render time histogram",
+                             G_VARIANT_TYPE_VARDICT, NULL, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+    /**
+     * CogHeadlessView:width:
+     *
+     * Width of the view in logical pixels. Setting the value to zero uses
+     * the default from the platform parameters. Changing the value resizes
+     * the view without recreating its backend.
+     */
+    s_view_properties[VIEW_PROP_WIDTH] =
+        g_param_spec_uint("width", "View width", "Width of the view in logical pixels", 0, G_MAXUINT, 0,
+                          G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_STRINGS);
+
+    /**
+     * CogHeadlessView:height:
+     *
+     * Height of the view in logical pixels. Setting the value to zero uses
+     * the default from the platform parameters. Changing the value resizes
+     * the view without recreating its backend.
+     */
+    s_view_properties[VIEW_PROP_HEIGHT] =
+        g_param_spec_uint("height", "View height", "Height of the view in logical pixels", 0, G_MAXUINT, 0,
+                          G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_STRINGS);
+
+    /**
+     * CogHeadlessView:device-scale-factor:
+     *
+     * Scale factor applied to the rendered content, rendered frames are
+     * this many times bigger than the logical size of the view. Setting
+     * the value to zero uses the default from the platform parameters.
+     */
+    s_view_properties[VIEW_PROP_DEVICE_SCALE_FACTOR] =
+        g_param_spec_double("device-scale-factor", "Device scale factor", "Scale factor applied to the content", 0.0,
+                            64.0, 0.0, G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_STRINGS);
+
+    /**
+     * CogHeadlessView:keep-last-frame:
+     *
+     * Whether to keep a copy of the last rendered frame, which can then be
+     * saved using the [signal@CogHeadlessView::write-snapshot] signal.
+     */
+    s_view_properties[VIEW_PROP_KEEP_LAST_FRAME] =
+        g_param_spec_boolean("keep-last-frame", "Keep last frame", "Keep a copy of the last rendered frame", FALSE,
+                             G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
+    g_object_class_install_properties(object_class, VIEW_N_PROPERTIES, s_view_properties);
+
+    /**
+     * CogHeadlessView::write-snapshot:
+     * @self: The view.
+     * @path: Location of the file to write.
+     *
+     * Action signal which writes the last frame kept by the view as a PAM
+     * (Portable Arbitrary Map) image file. The
+     * [property@CogHeadlessView:keep-last-frame] property must have been
+     * enabled before the frame was rendered.
+     *
+     * Returns: Whether the file was written.
+     */
+    g_signal_new_class_handler("write-snapshot", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+                               G_CALLBACK(cog_headless_view_write_snapshot), NULL, NULL, NULL, G_TYPE_BOOLEAN, 1,
+                               G_TYPE_STRING);
 }
 
 static void
@@ -86,50 +640,198 @@ cog_headless_view_class_finalize(CogHeadlessViewClass *klass G_GNUC_UNUSED)
 }
 
 static void
-cog_headless_view_init(CogHeadlessView *self G_GNUC_UNUSED)
+cog_headless_view_init(CogHeadlessView *self)
 {
+    cog_headless_frame_stats_init(&self->stats);
 }
 
 static void
-cog_headless_view_tick(CogHeadlessView *view)
+cog_headless_view_tick(CogHeadlessView *view, CogHeadlessPlatform *platform)
 {
-    if (view->frame_ack_pending) {
-        view->frame_ack_pending = false;
-        wpe_view_backend_exportable_fdo_dispatch_frame_complete(view->exportable);
-    }
+    if (view->frame_ack_pending)
+        cog_headless_view_complete_frame(view, platform);
 }
 
 static void
-cog_headless_viewport_tick(CogViewport *viewport)
+cog_headless_viewport_tick(CogViewport *viewport, CogHeadlessPlatform *platform)
 {
-    cog_viewport_foreach(viewport, (GFunc) cog_headless_view_tick, NULL);
+    cog_viewport_foreach(viewport, (GFunc) cog_headless_view_tick, platform);
 }
 
 static gboolean
-on_cog_headless_platform_tick(CogHeadlessPlatform *self)
+on_cog_headless_platform_tick(GSource *source, GSourceFunc callback G_GNUC_UNUSED, void *userdata)
 {
-    g_ptr_array_foreach(self->viewports, (GFunc) cog_headless_viewport_tick, NULL);
+    CogHeadlessPlatform *self = userdata;
+
+    /*
+     * Disarm before completing frames: views which produce a new frame
+     * in response will schedule the next tick again.
+     */
+    g_source_set_ready_time(source, -1);
+
+    self->stats.wakeups++;
+    g_ptr_array_foreach(self->viewports, (GFunc) cog_headless_viewport_tick, self);
     return G_SOURCE_CONTINUE;
 }
 
+static void
+cog_headless_platform_schedule_tick(CogHeadlessPlatform *self)
+{
+    if (g_source_get_ready_time(self->tick_source) != -1)
+        return;
+
+    /* Next point of the virtual vsync grid strictly after the current time. */
+    const int64_t now = g_get_monotonic_time();
+    const int64_t ticks = (now - self->vsync_base) / self->frame_interval + 1;
+    g_source_set_ready_time(self->tick_source, self->vsync_base + ticks * self->frame_interval);
+}
+
+static bool
+parse_unsigned(const char *value, unsigned min_value, unsigned *result)
+{
+    char *endp = NULL;
+    errno = 0;
+    uint64_t parsed = g_ascii_strtoull(value, &endp, 0);
+    if ((parsed == UINT64_MAX && errno == ERANGE) || endp == value || *endp != '\0' || parsed < min_value ||
+        parsed > UINT_MAX)
+        return false;
+
+    *result = (unsigned) parsed;
+    return true;
+}
+
+static bool
+parse_double(const char *value, double min_value, double max_value, double *result)
+{
+    char *endp = NULL;
+    errno = 0;
+    double parsed = g_ascii_strtod(value, &endp);
+    if (errno == ERANGE || endp == value || *endp != '\0' || parsed < min_value || parsed > max_value)
+        return false;
+
+    *result = parsed;
+    return true;
+}
+
+static void
+cog_headless_platform_parse_params(CogHeadlessPlatform *self, const char *params_string)
+{
+    g_auto(GStrv) params = g_strsplit(params_string, ",", 0);
+    for (unsigned i = 0; params[i]; i++) {
+        g_auto(GStrv) kv = g_strsplit(params[i], "=", 2);
+
+        /* A lone number is the refresh rate, for backwards compatibility. */
+        if (g_strv_length(kv) == 1) {
+            if (!parse_unsigned(g_strstrip(kv[0]), 1, &self->max_fps))
+                g_warning("Invalid refresh rate value '%s', ignored", kv[0]);
+            continue;
+        }
+
+        const char *k = g_strstrip(kv[0]);
+        const char *v = g_strstrip(kv[1]);
+
+        if (g_strcmp0(k, "fps") == 0) {
+            if (!parse_unsigned(v, 1, &self->max_fps))
+                g_warning("Invalid value '%s' for parameter '%s'.", v, k);
+        } else if (g_strcmp0(k, "width") == 0) {
+            if (!parse_unsigned(v, 1, &self->view_width))
+                g_warning("Invalid value '%s' for parameter '%s'.", v, k);
+        } else if (g_strcmp0(k, "height") == 0) {
+            if (!parse_unsigned(v, 1, &self->view_height))
+                g_warning("Invalid value '%s' for parameter '%s'.", v, k);
+        } else if (g_strcmp0(k, "device-scale-factor") == 0) {
+            if (!parse_double(v, 0.05, 64.0, &self->device_scale))
+                g_warning("Invalid value '%s' for parameter '%s'.", v, k);
+        } else if (g_strcmp0(k, "mode") == 0) {
+            if (g_strcmp0(v, "throttled") == 0)
+                self->unthrottled = false;
+            else if (g_strcmp0(v, "unthrottled") == 0)
+                self->unthrottled = true;
+            else
+                g_warning("Invalid value '%s' for parameter '%s'.", v, k);
+        } else if (g_strcmp0(k, "export") == 0) {
+            if (g_strcmp0(v, "shm") == 0)
+                self->export_egl = false;
+            else if (g_strcmp0(v, "egl") == 0)
+                self->export_egl = true;
+            else
+                g_warning("Invalid value '%s' for parameter '%s'.", v, k);
+        } else if (g_strcmp0(k, "capture") == 0) {
+            if (g_strcmp0(v, "none") == 0)
+                self->capture.mode = COG_HEADLESS_CAPTURE_NONE;
+            else if (g_strcmp0(v, "ring") == 0)
+                self->capture.mode = COG_HEADLESS_CAPTURE_RING;
+            else if (g_strcmp0(v, "y4m") == 0)
+                self->capture.mode = COG_HEADLESS_CAPTURE_Y4M;
+            else
+                g_warning("Invalid value '%s' for parameter '%s'.", v, k);
+        } else if (g_strcmp0(k, "capture-slots") == 0) {
+            if (!parse_unsigned(v, 2, &self->capture.slots))
+                g_warning("Invalid value '%s' for parameter '%s'.", v, k);
+        } else if (g_strcmp0(k, "capture-diff") == 0) {
+            if (g_strcmp0(v, "none") == 0)
+                self->capture.diff = false;
+            else if (g_strcmp0(v, "tiles") == 0)
+                self->capture.diff = true;
+            else
+                g_warning("Invalid value '%s' for parameter '%s'.", v, k);
+        } else if (g_strcmp0(k, "capture-path") == 0) {
+            if (v[0] != '\0') {
+                g_free(self->capture.path);
+                self->capture.path = g_strdup(v);
+            } else {
+                g_warning("Invalid value '%s' for parameter '%s'.", v, k);
+            }
+        } else {
+            g_warning("Invalid parameter '%s'.", k);
+        }
+    }
+}
+
 static gboolean
-cog_headless_platform_setup(CogPlatform* platform, CogShell* shell G_GNUC_UNUSED, const char* params, GError** error)
+cog_headless_platform_setup(CogPlatform* platform, CogShell* shell, const char* params, GError** error)
 {
     CogHeadlessPlatform *self = COG_HEADLESS_PLATFORM(platform);
 
+    if (shell)
+        self->device_scale = cog_shell_get_device_scale_factor(shell);
+
     wpe_loader_init("libWPEBackend-fdo-1.0.so");
-    wpe_fdo_initialize_shm();
 
-    if (params && params[0] != '\0') {
-        uint64_t value = g_ascii_strtoull(params, NULL, 0);
-        if ((value == UINT64_MAX && errno == ERANGE) || value == 0 || value > UINT_MAX)
-            g_warning("Invalid refresh rate value '%s', ignored", params);
-        else
-            self->max_fps = (unsigned) value;
+    if (params && params[0] != '\0')
+        cog_headless_platform_parse_params(self, params);
+
+    if (self->export_egl) {
+        g_autoptr(GError) egl_error = NULL;
+        if ((self->egl = cog_headless_egl_new(&egl_error))) {
+            if (!wpe_fdo_initialize_for_egl_display(cog_headless_egl_get_display(self->egl))) {
+                g_set_error_literal(error, COG_PLATFORM_WPE_ERROR, COG_PLATFORM_WPE_ERROR_INIT,
+                                    "Failed to initialize WPEBackend-fdo with EGL");
+                return FALSE;
+            }
+        } else {
+            g_warning("Cannot use EGL export, falling back to SHM: %s", egl_error->message);
+        }
     }
-    g_debug("Maximum refresh rate: %u FPS", self->max_fps);
+    if (!self->egl)
+        wpe_fdo_initialize_shm();
+    if (self->unthrottled)
+        g_debug("Unthrottled, virtual clock at %u FPS", self->max_fps);
+    else
+        g_debug("Maximum refresh rate: %u FPS", self->max_fps);
+
+    static GSourceFuncs tick_source_funcs = {
+        .dispatch = on_cog_headless_platform_tick,
+    };
+
+    self->frame_interval = G_USEC_PER_SEC / self->max_fps;
+    self->vsync_base = g_get_monotonic_time();
 
-    self->tick_source = g_timeout_add(1000.0 / self->max_fps, G_SOURCE_FUNC(on_cog_headless_platform_tick), self);
+    self->tick_source = g_source_new(&tick_source_funcs, sizeof(GSource));
+    g_source_set_name(self->tick_source, "cog: headless tick");
+    g_source_set_callback(self->tick_source, NULL, self, NULL);
+    g_source_set_ready_time(self->tick_source, -1);
+    g_source_attach(self->tick_source, g_main_context_get_thread_default());
     return TRUE;
 }
 
@@ -138,8 +840,19 @@ cog_headless_platform_finalize(GObject* object)
 {
     CogHeadlessPlatform *self = COG_HEADLESS_PLATFORM(object);
 
-    g_clear_handle_id(&self->tick_source, g_source_remove);
+    g_debug("%s: %" G_GUINT64_FORMAT " wakeups, %" G_GUINT64_FORMAT " frames completed", G_STRFUNC,
+            self->stats.wakeups, self->stats.frames);
+    if (self->stats.readbacks) {
+        g_debug("%s: %" G_GUINT64_FORMAT " frames read back, %.3f ms average", G_STRFUNC, self->stats.readbacks,
+                self->stats.readback_time / 1000.0 / self->stats.readbacks);
+    }
+
+    if (self->tick_source)
+        g_source_destroy(self->tick_source);
+    g_clear_pointer(&self->tick_source, g_source_unref);
     g_clear_pointer(&self->viewports, g_ptr_array_unref);
+    g_clear_pointer(&self->capture.path, g_free);
+    g_clear_pointer(&self->egl, cog_headless_egl_free);
 
     G_OBJECT_CLASS(cog_headless_platform_parent_class)->finalize(object);
 }
@@ -189,6 +902,12 @@ cog_headless_platform_init(CogHeadlessPlatform* self)
 {
     self->viewports = g_ptr_array_sized_new(3);
     self->max_fps = 30; /* Default value */
+    self->capture.mode = COG_HEADLESS_CAPTURE_NONE;
+    self->capture.slots = 3;
+    self->capture.path = g_strdup("cog-headless.y4m");
+    self->view_width = 800;
+    self->view_height = 600;
+    self->device_scale = 1.0;
 }
 
 G_MODULE_EXPORT void